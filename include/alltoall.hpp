@@ -0,0 +1,76 @@
+#ifndef ALLTOALL_HPP
+#define ALLTOALL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <mpi.h>
+
+#include "io.hpp"
+#include "policy.hpp"
+
+/*
+ * Encrypted MPI_Alltoall and MPI_Alltoallv with AES-128-CTR.
+ *
+ * Every ordered pair of ranks (src, dst) of a communicator has a key of its
+ * own, see Exchange::pair_key and kdf::KeyDerivation::pair_key. The counter
+ * block of the 16 bytes at byte position p of a message is seq || p / 16,
+ * seq counts the exchanges on the communicator, which all its ranks call in
+ * the same order. There is no integrity protection.
+ *
+ * The messages are sent point-to-point on a private duplicate of the
+ * communicator, to (rank + i) % size and from (rank - i) % size in step i,
+ * in chunks of HEAR_ALLTOALL_CHUNK_BYTES. A chunk is encrypted while the
+ * previous ones are sent, and every received chunk is decrypted in place as
+ * soon as it has arrived. Messages below the policy's plaintext_below are not
+ * encrypted, both ends of a pair decide alike as they agree on its size.
+ * The data is moved as bytes, both datatypes have to be contiguous. The
+ * messages that are sent from a copy are staged in a scratch buffer from
+ * libhear's memory pool.
+ */
+
+namespace alltoall {
+
+/* the scratch buffer, nullptr without memory */
+using acquire_fn_t = std::function<void *(std::size_t)>;
+using release_fn_t = std::function<void(void *, std::size_t)>;
+
+class Exchange
+{
+
+private:
+
+    MPI_Comm _comm;
+    std::size_t _chunk_bytes;
+    /* keys of (rank, dst) and (src, rank) */
+    std::vector<io::Cipher> _send;
+    std::vector<io::Cipher> _recv;
+    std::uint64_t _seq;
+    acquire_fn_t _acquire;
+    release_fn_t _release;
+
+public:
+
+    /* takes comm, a duplicate of the user's communicator, which is freed with the exchange */
+    Exchange(MPI_Comm comm, const std::vector<io::cipher_key_t> &send_keys,
+	     const std::vector<io::cipher_key_t> &recv_keys, std::size_t chunk_bytes,
+	     acquire_fn_t acquire, release_fn_t release);
+    ~Exchange();
+
+    /* without HEAR_LOCAL_KEYS, from the keys libhear exchanges for MPI_Allreduce */
+    static io::cipher_key_t pair_key(unsigned int k_n, const std::vector<unsigned int> &k_s, int src, int dst);
+
+    /* counts and displacements in bytes */
+    int alltoallv(const void *sendbuf, const std::size_t sendbytes[], const std::size_t sdispls[],
+		  void *recvbuf, const std::size_t recvbytes[], const std::size_t rdispls[],
+		  const policy::Decision &decision);
+
+    std::size_t bytes() const { return sizeof(*this) + (_send.capacity() + _recv.capacity()) * sizeof(io::Cipher); }
+
+};
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef CALLSITE_HPP
+#define CALLSITE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include <mpi.h>
+
+#include "tsc_x86.hpp"
+
+/*
+ * Per-callsite cost attribution for intercepted collectives.
+ *
+ * Statistics are keyed by the caller's return address, the communicator
+ * and the power-of-two size class of the message. Symbols are resolved
+ * only when the report is printed, so the per-call cost is two fenced
+ * TSC reads and one hash map lookup. Cycles have the probes' own overhead
+ * subtracted and are reported in nanoseconds as well, see tsc_x86.hpp.
+ */
+
+namespace callsite {
+
+struct Key
+{
+    void *ret_addr;
+    MPI_Comm comm;
+    int size_class;
+
+    bool operator==(const Key &other) const
+    {
+	return ret_addr == other.ret_addr && comm == other.comm &&
+	    size_class == other.size_class;
+    }
+};
+
+struct KeyHash
+{
+    std::size_t operator()(const Key &key) const
+    {
+	std::size_t h = std::hash<void *>()(key.ret_addr);
+	/* MPI_Comm is a pointer in Open MPI and an int in MPICH, its Fortran handle is neither */
+	h ^= std::hash<MPI_Fint>()(MPI_Comm_c2f(key.comm)) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	return h ^ (static_cast<std::size_t>(key.size_class) << 48);
+    }
+};
+
+struct Stats
+{
+    unsigned long long ncalls = 0;
+    unsigned long long nbytes = 0;
+    unsigned long long total_cycles = 0;
+    unsigned long long crypto_cycles = 0;
+    int comm_size = 0;
+    std::string comm_name;
+};
+
+int size_class(std::size_t nbytes);
+
+class Profiler
+{
+
+private:
+
+    std::unordered_map<Key, Stats, KeyHash> _stats;
+    Stats *_current;
+    unsigned long long _start;
+
+public:
+
+    Profiler();
+
+    void begin(void *ret_addr, MPI_Comm comm, std::size_t nbytes);
+    void end();
+
+    inline void add_crypto(unsigned long long cycles)
+    {
+	if (_current)
+	    _current->crypto_cycles += cycles;
+    }
+
+    void report(std::ostream &os, int rank, std::size_t max_entries) const;
+
+};
+
+/* Closes the current record on every return path of the wrapper */
+class Scope
+{
+
+private:
+
+    Profiler &_prof;
+
+public:
+
+    Scope(Profiler &prof, void *ret_addr, MPI_Comm comm, std::size_t nbytes)
+	: _prof(prof)
+    {
+	_prof.begin(ret_addr, comm, nbytes);
+    }
+
+    ~Scope()
+    {
+	_prof.end();
+    }
+
+};
+
+}
+
+#endif
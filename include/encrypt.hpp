@@ -1,6 +1,7 @@
 #ifndef ENCRYPT_HPP
 #define ENCRYPT_HPP
 
+#include <cstring>
 #include <vector>
 #include <random>
 
@@ -12,35 +13,47 @@
 #endif
 
 
+/* the simulated ranks of tests/simmpi are threads of one process */
+#ifdef HEAR_SIMMPI
+#define RANK_LOCAL thread_local
+#else
+#define RANK_LOCAL
+#endif
+
 namespace encryption {
 
 using encr_key_t = unsigned int;
 
-extern std::mt19937 encr_noise_generator;
-
-static unsigned int hashed_value_uint;
-static __m128i hashed_value_m128i;
-static __m256i hashed_value_m256i;
+extern RANK_LOCAL std::mt19937 encr_noise_generator;
 
+/* the leading bytes of the digest, which is longer than __m128i, let alone unsigned int */
 inline unsigned int prng_uint(unsigned int input)
 {
-    SHA1(reinterpret_cast<unsigned char*>(&input), sizeof(unsigned int),
-	 reinterpret_cast<unsigned char*>(&hashed_value_uint));
-    return hashed_value_uint;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    unsigned int hashed_value;
+
+    SHA1(reinterpret_cast<unsigned char*>(&input), sizeof(unsigned int), digest);
+    std::memcpy(&hashed_value, digest, sizeof(hashed_value));
+    return hashed_value;
 }
 
 inline __m128i prng_m128(__m128i input)
 {
-    SHA1(reinterpret_cast<unsigned char*>(&input), sizeof(__m128i),
-	 reinterpret_cast<unsigned char*>(&hashed_value_m128i));
-    return hashed_value_m128i;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    __m128i hashed_value;
+
+    SHA1(reinterpret_cast<unsigned char*>(&input), sizeof(__m128i), digest);
+    std::memcpy(&hashed_value, digest, sizeof(hashed_value));
+    return hashed_value;
 }
 
 inline __m256i prng_m256(__m256i input)
 {
+    __m256i hashed_value;
+
     SHA1(reinterpret_cast<unsigned char*>(&input), sizeof(__m256i),
-	 reinterpret_cast<unsigned char*>(&hashed_value_m256i));
-    return hashed_value_m256i;
+	 reinterpret_cast<unsigned char*>(&hashed_value));
+    return hashed_value;
 }
 
 void encrypt_int_sum_naive(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
@@ -61,10 +74,21 @@ void encrypt_float_sum_naive(float *encr_sbuf, const float *sbuf, int count, int
 			     std::vector<unsigned int> &k_s, unsigned int k_n);
 void decrypt_float_sum_naive(float *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n);
 
+/*
+ * Kernels applying a precomputed keystream: noise[i] is the PRNG output the
+ * matching kernel above would derive for element i, e.g., a keystream shared
+ * by all ranks of a node.
+ */
+void decrypt_int_sum_noise(unsigned int *rbuf, int count, const unsigned int *noise);
+void encrypt_float_sum_noise(float *encr_sbuf, const float *sbuf, int count, const unsigned int *noise);
+void decrypt_float_sum_noise(float *rbuf, int count, const unsigned int *noise);
+
 #ifdef AESNI
 
 unsigned int aesni128_prng(unsigned int);
 void aesni128_load_key(char *enc_key);
+const __m128i* aesni128_key_schedule();
+void aesni128_keystream(unsigned int *noise, int count, unsigned int ctr);
 
 void encrypt_int_sum_aesni128(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
 			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge);
@@ -76,6 +100,16 @@ void encrypt_float_sum_aesni128_unroll(float *encr_sbuf, const float *sbuf, int
 				       std::vector<unsigned int> &k_s, unsigned int k_n);
 void decrypt_float_sum_aesni128_unroll(float *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n);
 
+/*
+ * Float kernels drawing 16 instead of 32 noise bits per element (see
+ * FLOAT_NARROW_NOISE_* in hfloat.hpp): one AES block covers eight elements.
+ * Elements i..i+7 (i % 8 == 0) use the block of counters k_n + 1 + i .. k_n + 4 + i,
+ * so that a sub-range starting at a multiple of 8 is processed with k_n + offset.
+ */
+void encrypt_float_sum_aesni128_narrow(float *encr_sbuf, const float *sbuf, int count, int rank,
+				       std::vector<unsigned int> &k_s, unsigned int k_n);
+void decrypt_float_sum_aesni128_narrow(float *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n);
+
 #endif
 
 }
@@ -1,9 +1,13 @@
 #ifndef HEAR_HPP
 #define HEAR_HPP
 
+#include <stddef.h>
+
 #include <mpi.h>
 
-extern "C"
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
                   MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
@@ -11,6 +15,178 @@ int MPI_Init(int *argc, char ***argv);
 int MPI_Init_thread(int *argc, char ***argv, int required, int *provided);
 int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm);
 int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm);
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm *newcomm);
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm);
+int MPI_Comm_free(MPI_Comm *comm);
 int MPI_Finalize();
 
+/*
+ * What setting up communicators has cost this rank since MPI_Init, e.g.,
+ * for control-plane benchmarks. Times are in seconds, bytes is what is
+ * held for the communicators that are still alive.
+ */
+typedef struct HEAR_Comm_profile_s
+{
+    unsigned long long ncomms;  /* set up, including MPI_COMM_WORLD */
+    double key_exchange;        /* PMPI_Allgather of the k_s, or their derivation with HEAR_LOCAL_KEYS */
+    double k_n_bcast;           /* PMPI_Bcast of k_n, or of the job secret */
+    double insertion;           /* storage and map insertion */
+    double policy;              /* evaluating HEAR_POLICY, with its PMPI_Bcast and node split */
+    size_t bytes;
+} HEAR_Comm_profile;
+
+int HEAR_Get_comm_profile(HEAR_Comm_profile *profile);
+
+/*
+ * With HEAR_IO_KEY set to 32 hex digits, files opened with MPI_File_open are
+ * encrypted with AES-128-CTR, see io.hpp. The explicit offset and
+ * individual file pointer reads and writes below are encrypted, including
+ * their split collective forms. The nonblocking, shared file pointer and
+ * ordered variants fail with MPI_ERR_UNSUPPORTED_OPERATION on an encrypted
+ * file.
+ */
+int MPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh);
+int MPI_File_close(MPI_File *fh);
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                          MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                         MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_write_all(MPI_File fh, const void *buf, int count,
+                       MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_read_all(MPI_File fh, void *buf, int count,
+                      MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                      MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                     MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_write(MPI_File fh, const void *buf, int count,
+                   MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_read(MPI_File fh, void *buf, int count,
+                  MPI_Datatype datatype, MPI_Status *status);
+int MPI_File_write_at_all_begin(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                                MPI_Datatype datatype);
+int MPI_File_write_at_all_end(MPI_File fh, const void *buf, MPI_Status *status);
+int MPI_File_read_at_all_begin(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                               MPI_Datatype datatype);
+int MPI_File_read_at_all_end(MPI_File fh, void *buf, MPI_Status *status);
+int MPI_File_write_all_begin(MPI_File fh, const void *buf, int count, MPI_Datatype datatype);
+int MPI_File_write_all_end(MPI_File fh, const void *buf, MPI_Status *status);
+int MPI_File_read_all_begin(MPI_File fh, void *buf, int count, MPI_Datatype datatype);
+int MPI_File_read_all_end(MPI_File fh, void *buf, MPI_Status *status);
+
+/*
+ * Fused decrypt-and-apply: MPI_Allreduce that hands every block of recvbuf
+ * to fn right after it has been decrypted, while the block is still in
+ * cache, e.g., to apply an optimizer step to the reduced gradients. offset
+ * is the index of the block's first element in recvbuf. With pipelining the
+ * blocks are the pipelining blocks, otherwise, and for reductions that are
+ * not encrypted, fn gets all of recvbuf at once.
+ */
+typedef void HEAR_Block_function(void *block, int offset, int count,
+                                 MPI_Datatype datatype, void *extra_state);
+
+int HEAR_Allreduce_apply(const void *sendbuf, void *recvbuf, int count,
+                         MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                         HEAR_Block_function *fn, void *extra_state);
+
+/*
+ * With HEAR_LAZY_DECRYPT set, MPI_Allreduce returns large results with
+ * pages still encrypted, which are decrypted on first access or by a worker
+ * thread (see lazy.hpp). RDMA, and system calls where the process may not
+ * handle kernel faults with userfaultfd, do not wait for such pages, so
+ * buffers handed to them have to be waited for first.
+ */
+int HEAR_Decrypt_wait(const void *buf, size_t len);
+
+/*
+ * Declares op, from MPI_Op_create, as additively homomorphic over datatype:
+ * it adds up the nfields MPI_INT or MPI_FLOAT fields at field_displs bytes
+ * into each element, like MPI_SUM would. MPI_Allreduce then masks every
+ * field with the MPI_SUM kernels and runs op on the masked elements. The
+ * declaration holds until op is declared again.
+ */
+int HEAR_Op_declare_linear(MPI_Op op, MPI_Datatype datatype, int nfields,
+                           const MPI_Datatype field_types[], const MPI_Aint field_displs[]);
+
+/*
+ * Encrypt-on-produce staging: a libhear-owned send buffer, allocated with
+ * MPI_Alloc_mem, that the application fills region by region. A region is
+ * encrypted in place as soon as it is marked ready, so encryption overlaps
+ * with producing the rest of the buffer and HEAR_Stage_allreduce only has
+ * to encrypt what was never marked ready before it reduces the buffer.
+ *
+ * Regions start at multiples of HEAR_STAGE_GRANULE elements and end at one
+ * or at the end of the buffer, and are marked ready once per reduction.
+ * HEAR_Stage_create and HEAR_Stage_allreduce are collective over comm, the
+ * buffer holds ciphertext after HEAR_Stage_allreduce.
+ */
+#define HEAR_STAGE_GRANULE 64
+
+typedef struct HEAR_Stage_s *HEAR_Stage;
+
+int HEAR_Stage_create(int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                      HEAR_Stage *stage);
+void *HEAR_Stage_buffer(HEAR_Stage stage);
+int HEAR_Stage_ready(HEAR_Stage stage, int offset, int count);
+/* fn writes the region (buffer + offset elements), which is then marked ready */
+int HEAR_Stage_produce(HEAR_Stage stage, int offset, int count,
+                       HEAR_Block_function *fn, void *extra_state);
+int HEAR_Stage_allreduce(HEAR_Stage stage, void *recvbuf);
+int HEAR_Stage_free(HEAR_Stage *stage);
+
+/*
+ * Prioritized nonblocking MPI_Allreduce, e.g., for per-layer gradient
+ * buckets that the next forward pass needs in layer order. Outstanding
+ * reductions go out block by block (pipelining blocks) on
+ * HEAR_SCHED_CHANNELS (4) private duplicates of comm, see sched.hpp:
+ * priorities 0 to HEAR_SCHED_CHANNELS - 2 have a channel each, lower ones
+ * share the first and higher ones the last. Reductions on different
+ * channels are in flight at the same time, one posted with a higher
+ * priority does not wait for a large one of a lower priority that is
+ * already underway, and the local en- and decryption serves the highest
+ * priority first. On a shared channel, reductions go out in posting order.
+ *
+ * The first blocks are sent by HEAR_Iallreduce, the others as the blocks
+ * before them arrive, in HEAR_Test, HEAR_Wait(all) and the intercepted
+ * MPI_Allreduce and MPI_Alltoall(v). Calling HEAR_Test now and then keeps
+ * them moving during computation. All ranks of comm have to post the same
+ * reductions at the same priorities in the same order, and the first post
+ * that uses a channel is collective over comm. Deadlines would differ between
+ * ranks, map them to priorities instead. Reductions with ops declared by
+ * HEAR_Op_declare_linear are not split into blocks. HEAR_Wait(all) skips
+ * NULL requests, those HEAR_Test has completed.
+ */
+typedef struct HEAR_Request_s *HEAR_Request;
+
+int HEAR_Iallreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+                    MPI_Op op, MPI_Comm comm, int priority, HEAR_Request *request);
+/* *flag is 1, and *request NULL, once the reduction is complete */
+int HEAR_Test(HEAR_Request *request, int *flag);
+int HEAR_Wait(HEAR_Request *request);
+int HEAR_Waitall(int count, HEAR_Request requests[]);
+
+#ifdef __cplusplus
+}
+
+/*
+ * Per-element flavour of HEAR_Allreduce_apply, f(T &elem, int index) is
+ * inlined into the block loop, so it can be vectorized.
+ */
+template <typename T, typename F>
+int HEAR_Allreduce_apply_elements(const T *sendbuf, T *recvbuf, int count,
+                                  MPI_Datatype datatype, MPI_Op op, MPI_Comm comm, F &f)
+{
+    HEAR_Block_function *block_fn = [](void *block, int offset, int count,
+				       MPI_Datatype, void *extra_state) {
+	F &f = *static_cast<F *>(extra_state);
+	T *elems = static_cast<T *>(block);
+
+	for (int i = 0; i < count; i++)
+	    f(elems[i], offset + i);
+    };
+
+    return HEAR_Allreduce_apply(sendbuf, recvbuf, count, datatype, op, comm, block_fn, &f);
+}
+#endif
+
 #endif
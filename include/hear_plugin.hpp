@@ -0,0 +1,87 @@
+#ifndef HEAR_PLUGIN_HPP
+#define HEAR_PLUGIN_HPP
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * C interface of kernel backends that libhear loads at MPI_Init from the
+ * shared object HEAR_PLUGIN names.
+ *
+ * The object exports HEAR_PLUGIN_ENTRY, which libhear calls with its
+ * HEAR_PLUGIN_ABI_VERSION. It returns its HEAR_Plugin, which must stay valid
+ * until finalize, or NULL if it cannot serve that version. Later versions
+ * only append fields: libhear reads those within size and treats the others
+ * as NULL, and HEAR_PLUGIN_ABI_VERSION changes only when existing fields do.
+ * size covers at least abi_version, size and name.
+ *
+ * init is called once MPI_COMM_WORLD is set up, with a key of
+ * HEAR_PLUGIN_KEY_LEN bytes that is the same on all ranks and new for every
+ * job: derived from the job secret with HEAR_LOCAL_KEYS, else drawn by rank
+ * 0 of MPI_COMM_WORLD. A backend that fails init is not used.
+ *
+ * The backend's kernels are selected under its name, which is the default
+ * once it is loaded and can be chosen per communicator with the policy's
+ * int_kernel= and float_kernel=. Every rank of a communicator needs the same
+ * backend, the ranks agree on it like on the built-in kernel families and
+ * fall back to a built-in one where a rank has not loaded it, or loaded one
+ * that differs in name, ABI version or size.
+ *
+ * Element i of a reduction is encrypted under counter k_n + k_s[rank] + i
+ * (int) or k_n + i (float), k_s holding one key per rank and one more. Of
+ * those, only k_s[0], k_s[rank] and k_s[rank + 1] are set everywhere, with
+ * HEAR_LOCAL_KEYS the others are 0. With only keystream, libhear applies
+ * noise[i] to element i like its own kernels do, see encrypt.hpp. The fused kernels replace that with the backend's own
+ * scheme and must be provided in en-/decrypt pairs. Kernels are called from
+ * several threads at once with HEAR_CRYPTO_THREADS, on any sub-range of the
+ * elements starting at a multiple of 64 (with k_n moved by as much), and must
+ * give the same result as one call over the whole range.
+ */
+
+#define HEAR_PLUGIN_ABI_VERSION 1
+#define HEAR_PLUGIN_ENTRY "hear_plugin_entry"
+#define HEAR_PLUGIN_KEY_LEN 32
+
+/* the CPU features the kernels need, the backend is not loaded without them */
+#define HEAR_PLUGIN_CAP_SSE2    (1u << 0)
+#define HEAR_PLUGIN_CAP_AVX2    (1u << 1)
+#define HEAR_PLUGIN_CAP_AES     (1u << 2)
+#define HEAR_PLUGIN_CAP_VAES    (1u << 3)
+#define HEAR_PLUGIN_CAP_AVX512  (1u << 4)
+#define HEAR_PLUGIN_CAP_SHA     (1u << 5)
+
+typedef struct HEAR_Plugin_s
+{
+    unsigned int abi_version;           /* HEAR_PLUGIN_ABI_VERSION it was built with */
+    size_t size;                        /* sizeof(HEAR_Plugin) it was built with */
+    const char *name;                   /* under 16 characters */
+
+    unsigned int (*capabilities)(void);                             /* NULL: none */
+    int (*init)(const unsigned char *key, size_t key_len);          /* 0 on success, NULL: nothing to do */
+    void (*finalize)(void);                                         /* NULL: nothing to do */
+
+    /* noise[i] for counter ctr + i, i < count */
+    void (*keystream)(unsigned int *noise, int count, unsigned int ctr);
+
+    /* NULL: from keystream (sums) or the built-in ones (products) */
+    void (*encrypt_int_sum)(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+                            const unsigned int *k_s, unsigned int k_n, int is_edge);
+    void (*decrypt_int_sum)(unsigned int *rbuf, int count, const unsigned int *k_s, unsigned int k_n);
+    void (*encrypt_int_prod)(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+                             const unsigned int *k_s, unsigned int k_n, int is_edge);
+    void (*decrypt_int_prod)(unsigned int *rbuf, int count, const unsigned int *k_s, unsigned int k_n);
+    void (*encrypt_float_sum)(float *encr_sbuf, const float *sbuf, int count, int rank,
+                              const unsigned int *k_s, unsigned int k_n);
+    void (*decrypt_float_sum)(float *rbuf, int count, const unsigned int *k_s, unsigned int k_n);
+} HEAR_Plugin;
+
+typedef const HEAR_Plugin *(*HEAR_Plugin_entry)(unsigned int abi_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,6 +18,14 @@
 #define IEEE_DOUBLE_MANTISSA 52
 #define IEEE_DOUBLE_EXPONENT 11
 #define SHIFT (FLOAT_EXPONENT - IEEE_FLOAT_EXPONENT)
+/*
+ * Reduced-width float noise: 16 keystream bits per element, split into a
+ * mantissa of FLOAT_NARROW_NOISE_MANTISSA bits (the most significant ones
+ * of crypto.mantissa) and a signed exponent of the remaining bits.
+ */
+#define FLOAT_NARROW_NOISE_BITS 16
+#define FLOAT_NARROW_NOISE_MANTISSA 10
+#define FLOAT_NARROW_NOISE_EXPONENT (FLOAT_NARROW_NOISE_BITS - FLOAT_NARROW_NOISE_MANTISSA)
 
 namespace HNumbers
 {
@@ -0,0 +1,91 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <mpi.h>
+
+/*
+ * Encrypted MPI-IO with AES-128-CTR.
+ *
+ * The counter block of the 16 bytes at file position p is nonce || p / 16,
+ * so any byte range of a file can be en- or decrypted on its own, whichever
+ * rank wrote it and in whichever chunks. The nonce is derived from the
+ * canonical path of the file as rank 0 sees it, so files in different
+ * directories get different keystreams, and a file has to be opened under
+ * the same path to be read back. Rewriting a range reuses its keystream, and
+ * there is no integrity protection.
+ *
+ * A transfer is split into chunks. While PMPI_File_write_at(_all) writes a
+ * chunk, a helper thread encrypts the next one, and while
+ * PMPI_File_read_at(_all) reads a chunk, the previous one is decrypted. The
+ * nonblocking file operations are not used, they only progress inside
+ * MPI_Wait in some implementations. A chunk is en-/decrypted by up to
+ * nthreads threads. Only native data
+ * representation, contiguous file views and contiguous datatypes are
+ * supported, other transfers fail with MPI_ERR_UNSUPPORTED_OPERATION. So do
+ * the nonblocking, shared file pointer and ordered calls on an encrypted
+ * file, the split collectives do all of the work in *_begin.
+ */
+
+namespace io {
+
+#define IO_KEY_LEN 16
+
+using cipher_key_t = std::array<unsigned char, IO_KEY_LEN>;
+
+/* an encrypted file, from MPI_File_open */
+struct File
+{
+    std::uint64_t nonce;
+    /* private duplicate of the open communicator, the ranks agree on the number of chunks over it */
+    MPI_Comm comm;
+    /* of the split collective in progress, for its *_end call */
+    MPI_Status split_status;
+};
+
+/* without gaps at either end or in between, e.g., for MPI_Alltoall(v) */
+bool is_contiguous(MPI_Datatype datatype);
+
+class Cipher
+{
+
+private:
+
+    cipher_key_t _key;
+    int _nthreads;
+    std::size_t _chunk_bytes;
+
+    void apply_range(unsigned char *dst, const unsigned char *src, std::size_t len,
+		     std::uint64_t nonce, std::uint64_t pos) const;
+
+public:
+
+    Cipher(const cipher_key_t &key, int nthreads, std::size_t chunk_bytes);
+
+    /* 2 * IO_KEY_LEN hex digits */
+    static bool parse_key(const char *hex, cipher_key_t &key);
+    /* collective over comm, which must be the communicator the file is open on */
+    static int file_nonce(const char *filename, MPI_Comm comm, std::uint64_t &nonce);
+
+    /* dst = src ^ keystream of [pos, pos + len), dst may be src */
+    void apply(void *dst, const void *src, std::size_t len, std::uint64_t nonce, std::uint64_t pos) const;
+
+    int write_at(const File &file, MPI_File fh, MPI_Offset offset, const void *buf, int count,
+		 MPI_Datatype datatype, MPI_Status *status, bool collective) const;
+    int read_at(const File &file, MPI_File fh, MPI_Offset offset, void *buf, int count,
+		MPI_Datatype datatype, MPI_Status *status, bool collective) const;
+
+    /* at and past the individual file pointer */
+    int write(const File &file, MPI_File fh, const void *buf, int count,
+	      MPI_Datatype datatype, MPI_Status *status, bool collective) const;
+    int read(const File &file, MPI_File fh, void *buf, int count,
+	     MPI_Datatype datatype, MPI_Status *status, bool collective) const;
+
+};
+
+}
+
+#endif
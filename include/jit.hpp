@@ -0,0 +1,94 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+/*
+ * Runtime generated MPI_INT + MPI_SUM kernels.
+ *
+ * The kernels are emitted once per process, when libhear is initialized,
+ * and specialized to the vector width of the CPU (VAES on ymm registers or
+ * AES-NI on xmm registers), to the unroll factor, to the alignment of the
+ * buffers, to non-temporal stores for buffers larger than the last level
+ * cache, and, when the unroll factor leaves enough registers, keep the
+ * round keys in registers for the whole loop.
+ *
+ * The counter layout is the one of the aesni128 kernels, element i of a
+ * rank is masked by lane i % 4 of AES(k_n + k_s[rank] + i - i % 4, ...),
+ * and every generated kernel is checked against them before it is used.
+ */
+
+namespace jit {
+
+/* dst[i] = src[i] +/- AES(ctr1 + i) [- AES(ctr2 + i)] for niters * step elements */
+using kernel_fn_t = void (*)(unsigned int *dst, const unsigned int *src, std::size_t niters,
+			     unsigned int ctr1, unsigned int ctr2, const void *key_schedule);
+
+enum Kind { ENCRYPT, ENCRYPT_EDGE, DECRYPT, NKINDS };
+enum Variant { UNALIGNED, ALIGNED, ALIGNED_NT, NVARIANTS };
+
+struct Spec
+{
+    Kind kind;
+    int width;
+    int unroll;
+    bool key_in_regs;
+    Variant variant;
+
+    bool operator<(const Spec &other) const
+    {
+	return std::tie(kind, width, unroll, key_in_regs, variant) <
+	    std::tie(other.kind, other.width, other.unroll, other.key_in_regs, other.variant);
+    }
+};
+
+class Kernels
+{
+
+private:
+
+    int _width;
+    int _unroll[NKINDS];
+    std::size_t _nt_threshold;
+    bool _valid;
+
+    kernel_fn_t _fns[NKINDS][NVARIANTS];
+    std::map<Spec, kernel_fn_t> _cache;
+    std::vector<std::pair<void *, std::size_t>> _regions;
+
+    kernel_fn_t generate(const Spec &spec);
+    bool validate(const Spec &spec, kernel_fn_t fn);
+    void run(Kind kind, unsigned int *dst, const unsigned int *src, int count,
+	     unsigned int ctr1, unsigned int ctr2);
+
+public:
+
+    /*
+     * block_size is the pipelining block size in elements (0 if unused),
+     * unroll forces the unroll factor and width = 4 the xmm kernels (0
+     * picks them).
+     */
+    Kernels(std::size_t block_size, int unroll = 0, int width = 0);
+    ~Kernels();
+
+    Kernels(const Kernels &) = delete;
+    Kernels& operator=(const Kernels &) = delete;
+
+    /* false if the CPU lacks AES/AVX2 or a generated kernel failed validation */
+    bool valid() const { return _valid; }
+    void describe(std::ostream &os) const;
+
+    /* drop-in replacements of encryption::{en,de}crypt_int_sum_aesni128 */
+    void encrypt_int_sum(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			 std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge);
+    void decrypt_int_sum(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n);
+
+};
+
+}
+
+#endif
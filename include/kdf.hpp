@@ -0,0 +1,64 @@
+#ifndef KDF_HPP
+#define KDF_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Communicator keys derived without communication.
+ *
+ * A job secret is broadcast once on MPI_COMM_WORLD. Every communicator gets
+ * an identifier that all of its ranks compute locally: MPI_COMM_WORLD's is
+ * derived from the secret, a child's from the parent's identifier, the number
+ * of communicators created from the parent so far (creation calls are
+ * collective over the parent, so the count agrees across its ranks), and the
+ * parent ranks of the child's members in child rank order. k_n and all the
+ * k_s of a communicator are then HMAC-SHA256(secret, identifier, label, rank),
+ * and the AES key of the MPI_Alltoall(v) messages from src to dst is the
+ * first KDF_PAIR_KEY_LEN bytes of HMAC-SHA256(secret, identifier, label, src, dst).
+ * The key of a HEAR_PLUGIN backend is HMAC-SHA256(secret, label).
+ */
+
+namespace kdf {
+
+#define KDF_SECRET_LEN 32
+#define KDF_ID_LEN 32
+#define KDF_PAIR_KEY_LEN 16
+#define KDF_PLUGIN_KEY_LEN 32
+
+using secret_t = std::array<unsigned char, KDF_SECRET_LEN>;
+using comm_id_t = std::array<unsigned char, KDF_ID_LEN>;
+using pair_key_t = std::array<unsigned char, KDF_PAIR_KEY_LEN>;
+using plugin_key_t = std::array<unsigned char, KDF_PLUGIN_KEY_LEN>;
+
+class KeyDerivation
+{
+
+private:
+
+    secret_t _secret;
+
+    void hmac(const unsigned char *data, std::size_t len, unsigned char *out) const;
+
+public:
+
+    /* secret_t filled from std::random_device, e.g., on the root of MPI_COMM_WORLD */
+    static secret_t random_secret();
+
+    void set_secret(const secret_t &secret) { _secret = secret; }
+
+    comm_id_t world_id() const;
+    comm_id_t child_id(const comm_id_t &parent, unsigned long long seq,
+		       const std::vector<int> &parent_ranks) const;
+
+    unsigned int k_n(const comm_id_t &id) const;
+    unsigned int k_s(const comm_id_t &id, int rank) const;
+    pair_key_t pair_key(const comm_id_t &id, int src, int dst) const;
+    plugin_key_t plugin_key() const;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef KEYSTREAM_HPP
+#define KEYSTREAM_HPP
+
+#include <cstddef>
+#include <functional>
+
+#include <mpi.h>
+
+namespace keystream {
+
+using fill_fn_t = std::function<void(unsigned int *, int, unsigned int)>;
+
+/*
+ * Keystream shared by the ranks of one node through an MPI-3 shared memory
+ * window. Noise that depends only on rank-independent inputs (k_n, k_s[0])
+ * is the same on every rank, so each rank of the node generates 1/ppn of it
+ * and all of them read the whole stream.
+ *
+ * The window is double-buffered: a rank can only overwrite a buffer after
+ * passing the barrier of the following generation, i.e., after every node
+ * rank is done reading it. One node barrier per generated stream.
+ */
+class NodeKeystream
+{
+
+private:
+
+    MPI_Comm _node_comm;
+    MPI_Win _win;
+    unsigned int *_bufs[2];
+    std::size_t _capacity;
+    int _node_rank;
+    int _node_size;
+
+    int _generation;
+    unsigned int _ctr;
+    int _count;
+
+public:
+
+    NodeKeystream(MPI_Comm node_comm, std::size_t capacity);
+    ~NodeKeystream();
+
+    std::size_t capacity() const { return _capacity; }
+    int node_size() const { return _node_size; }
+
+    /* Collective over the node communicator */
+    const unsigned int* get(unsigned int ctr, int count, const fill_fn_t &fill);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef LAZY_HPP
+#define LAZY_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace lazy {
+
+#define LAZY_MAX_REGIONS 64
+
+/* decrypts a copy of the page'th page of a region in place */
+using decrypt_fn_t = std::function<void(void *, std::size_t)>;
+
+/*
+ * Page-granular lazy decryption of receive buffers, with userfaultfd.
+ *
+ * add() moves the pages of a region out of the receive buffer with
+ * mremap(MREMAP_DONTUNMAP), which leaves the range mapped but empty, and
+ * registers the range for missing-page faults. The moved pages hold the
+ * ciphertext. A page is decrypted there and copied back in with
+ * UFFDIO_COPY, either on first access or by a worker thread that walks the
+ * regions front to back. A thread that touches a missing page sleeps in the
+ * kernel until the page is copied in. Nothing runs in signal context, so
+ * the kernels may do whatever they like, except wait for the faulting
+ * thread.
+ *
+ * A page is claimed with a CAS, so each one is decrypted exactly once, and
+ * UFFDIO_COPY maps it atomically, so no thread ever sees a half-decrypted
+ * page. A range that the application unmaps or maps anew is no longer
+ * registered, UFFDIO_COPY fails there and the page is dropped rather than
+ * written into memory that is not the buffer any more. Pages the
+ * application releases with madvise (free() does) fault in as zeros.
+ * Without the privilege to handle kernel faults (vm.unprivileged_userfaultfd),
+ * system calls that touch a page that is not decrypted yet fail with EFAULT,
+ * HEAR_Decrypt_wait first.
+ *
+ * Regions live in a fixed array of slots, which the fault thread scans
+ * without locks. A slot is only reused once no thread is inside it.
+ */
+class Decryptor
+{
+
+private:
+
+    enum PageState : unsigned char { ENCRYPTED, BUSY, DONE };
+    enum SlotState : int { FREE, ACTIVE, RETIRING };
+
+    struct Region
+    {
+	std::atomic<int> state;
+	std::atomic<int> users;
+	char *base;
+	/* the ciphertext, moved out of base */
+	char *cipher;
+	std::size_t npages;
+	std::atomic<std::size_t> remaining;
+	std::atomic<unsigned char> *pages;
+	decrypt_fn_t decrypt;
+	unsigned long long seq;
+    };
+
+    std::size_t _page_size;
+    int _uffd;
+    /* wakes the fault thread up to stop */
+    int _stop_fd;
+    Region _regions[LAZY_MAX_REGIONS];
+    unsigned long long _next_seq;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _worker;
+    std::thread _fault_thread;
+    bool _stop;
+
+    /* false where someone else has claimed the page */
+    bool decrypt_page(Region &region, std::size_t page);
+    void resolve_fault(char *addr);
+    bool overlaps(Region &region, const char *begin, const char *end) const;
+    void retire(Region &region);
+    void work();
+    void serve_faults();
+
+public:
+
+    Decryptor();
+    ~Decryptor();
+
+    /* false where userfaultfd is not available, add() then always fails */
+    bool usable() const { return _uffd >= 0; }
+    std::size_t page_size() const { return _page_size; }
+
+    /*
+     * Takes over npages pages from base, which must be page-aligned and
+     * private anonymous memory (the heap or a private mapping), and queues
+     * them for decryption. Returns false, with the pages untouched, when all
+     * slots are taken or the range cannot be taken over.
+     */
+    bool add(void *base, std::size_t npages, decrypt_fn_t decrypt);
+
+    /* Waits until no region overlaps [buf, buf + len) */
+    void wait(const void *buf, std::size_t len);
+    void wait_all();
+
+};
+
+}
+
+#endif
@@ -22,6 +22,7 @@ public:
     SbufMpool(const size_t pool_size, const size_t buf_len);
     ~SbufMpool();
 
+    /* grows the pool when it is empty, nullptr only without memory */
     void* acquire_buf();
     void release_buf(void *buf);
 
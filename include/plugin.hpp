@@ -0,0 +1,80 @@
+#ifndef PLUGIN_HPP
+#define PLUGIN_HPP
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hear_plugin.hpp"
+
+/*
+ * A kernel backend loaded from a shared object, HEAR_PLUGIN, see
+ * hear_plugin.hpp. Its kernels are wrapped in the signatures of the built-in
+ * ones, so that HearState selects them like any other.
+ */
+
+namespace plugin {
+
+class Backend
+{
+
+private:
+
+    void *_handle;
+    std::string _name;
+    unsigned int _id;
+
+    /* the fields the plugin has, NULL where it was built without them */
+    decltype(HEAR_Plugin::init) _init;
+    decltype(HEAR_Plugin::keystream) _keystream;
+    decltype(HEAR_Plugin::encrypt_int_sum) _encrypt_int_sum;
+    decltype(HEAR_Plugin::decrypt_int_sum) _decrypt_int_sum;
+    decltype(HEAR_Plugin::encrypt_int_prod) _encrypt_int_prod;
+    decltype(HEAR_Plugin::decrypt_int_prod) _decrypt_int_prod;
+    decltype(HEAR_Plugin::encrypt_float_sum) _encrypt_float_sum;
+    decltype(HEAR_Plugin::decrypt_float_sum) _decrypt_float_sum;
+    decltype(HEAR_Plugin::finalize) _finalize;
+    bool _initialised;
+
+    Backend() = default;
+
+public:
+
+    ~Backend();
+
+    /*
+     * Opens path. Returns nullptr, and says why on err, if it cannot be
+     * loaded, serves another ABI version or needs CPU features that are not
+     * in caps (HEAR_PLUGIN_CAP_*).
+     */
+    static std::unique_ptr<Backend> load(const char *path, unsigned int caps, std::ostream &err);
+    /* before the kernels are used, false (and why on err) where the backend refuses key */
+    bool init(const unsigned char *key, std::size_t key_len, std::ostream &err);
+
+    const std::string& name() const { return _name; }
+    /* of the name, ABI version and struct size, which the ranks compare */
+    unsigned int id() const { return _id; }
+
+    bool has_int_sum() const { return _keystream || _encrypt_int_sum; }
+    bool has_int_prod() const { return _encrypt_int_prod; }
+    bool has_float_sum() const { return _keystream || _encrypt_float_sum; }
+
+    void keystream(unsigned int *noise, int count, unsigned int ctr) const { _keystream(noise, count, ctr); }
+
+    void encrypt_int_sum(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			 std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge) const;
+    void decrypt_int_sum(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const;
+    void encrypt_int_prod(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			  std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge) const;
+    void decrypt_int_prod(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const;
+    void encrypt_float_sum(float *encr_sbuf, const float *sbuf, int count, int rank,
+			   std::vector<unsigned int> &k_s, unsigned int k_n) const;
+    void decrypt_float_sum(float *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const;
+
+};
+
+}
+
+#endif
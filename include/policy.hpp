@@ -0,0 +1,98 @@
+#ifndef POLICY_HPP
+#define POLICY_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Per-communicator encryption policy.
+ *
+ * Rules come from HEAR_POLICY (separated by ';') and HEAR_POLICY_FILE (one
+ * per line, '#' starts a comment) and are evaluated once per communicator,
+ * when it is created. The first rule whose selectors all match decides:
+ *
+ *   <selector>... encrypt|plaintext [<option>=<value>]...
+ *
+ * selectors:  all, world, node_local, inter_node, size<=N, size>=N
+ * options:    plaintext_below=BYTES  messages smaller than that are not encrypted
+ *             block_size=COUNT       pipelining block size, 0 disables pipelining
+ *             int_kernel=NAME        MPI_INT + MPI_SUM kernel (naive, sha1sse2,
+ *                                    sha1avx2, aesni, aesni_unroll, jit, or
+ *                                    the name of the HEAR_PLUGIN backend)
+ *             float_kernel=NAME      MPI_FLOAT + MPI_SUM kernel (naive,
+ *                                    aesni_unroll, aesni_narrow, or the
+ *                                    HEAR_PLUGIN backend's)
+ *
+ * e.g. HEAR_POLICY="node_local plaintext; all encrypt plaintext_below=64"
+ *
+ * Every rank must see the same rules, the decision of the communicator's
+ * rank 0 is broadcast to the others.
+ */
+
+namespace policy {
+
+#define POLICY_KERNEL_NAME_LEN 16
+
+struct Topology
+{
+    int comm_size;
+    bool world;
+    bool node_local;
+};
+
+/* plain data, broadcast as bytes */
+struct Decision
+{
+    bool encrypt;
+    std::size_t plaintext_below;
+    long block_size;                             /* -1: HEAR_PIPELINING_BLOCK_SIZE */
+    char int_kernel[POLICY_KERNEL_NAME_LEN];     /* empty: the global default */
+    char float_kernel[POLICY_KERNEL_NAME_LEN];
+
+    Decision();
+    bool encrypted(std::size_t nbytes) const { return encrypt && nbytes >= plaintext_below; }
+};
+
+struct Rule
+{
+    bool world;
+    bool node_local;
+    bool inter_node;
+    int min_size;
+    int max_size;
+    Decision decision;
+
+    Rule();
+    bool matches(const Topology &topology) const;
+};
+
+class Engine
+{
+
+private:
+
+    std::vector<Rule> _rules;
+
+    bool parse_rule(const std::string &text, std::ostream &err);
+
+public:
+
+    /* text holds rules separated by sep, returns false on syntax errors */
+    bool parse(const std::string &text, char sep, std::ostream &err);
+    /* HEAR_POLICY and HEAR_POLICY_FILE */
+    void load_env(std::ostream &err);
+
+    bool empty() const { return _rules.empty(); }
+    /* whether evaluating needs Topology::node_local, i.e., a collective */
+    bool needs_topology() const;
+    Decision decide(const Topology &topology) const;
+
+};
+
+void describe(std::ostream &os, const Decision &decision);
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool {
+
+/* en-/decrypts elements [begin, end) */
+using range_fn_t = std::function<void(std::size_t, std::size_t)>;
+
+/* the CPUs the process may run on, in ascending order */
+std::vector<int> allowed_cpus();
+
+/*
+ * Work-stealing pool for the en-/decryption kernels, HEAR_CRYPTO_THREADS.
+ *
+ * parallel_for() cuts a range into grains, HEAR_CRYPTO_GRAIN_BYTES, and
+ * deals them out in contiguous runs to per-worker deques. A worker takes
+ * grains from the front of its own deque, in the order they were dealt, so
+ * it walks its run forwards. When that is empty it steals from the back of
+ * the others', first those on its own NUMA node, away from where their
+ * owners are. The caller steals as well, so a run left behind a busy worker
+ * is finished by whoever is free, and whatever the calling operation is, its
+ * grains go through the same deques.
+ *
+ * The workers are pinned to the CPUs the process may run on, one per
+ * physical core before any hyperthread sibling, from the first_cpu-th of
+ * them on. The deques are locked, a grain is far longer than taking a lock.
+ */
+class Pool
+{
+
+private:
+
+    struct Job
+    {
+	const range_fn_t *fn;
+	std::atomic<std::size_t> remaining;
+    };
+
+    struct Task
+    {
+	Job *job;
+	std::size_t begin;
+	std::size_t end;
+    };
+
+    struct Worker
+    {
+	std::mutex mutex;
+	std::deque<Task> tasks;
+	int cpu;
+	int node;
+	/* the other workers, those on the same node first */
+	std::vector<int> victims;
+	std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    /* NUMA node by CPU number */
+    std::vector<int> _cpu_nodes;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::atomic<std::size_t> _queued;
+    bool _stop;
+
+    bool pop(Worker &worker, Task &task);
+    bool steal(const std::vector<int> &victims, Task &task);
+    void run(const Task &task);
+    void work(Worker &worker);
+    std::vector<int> victims_of(int node, int self) const;
+
+public:
+
+    /*
+     * With 0 threads, parallel_for() runs everything on the caller. Ranks
+     * that share their CPUs pass different first_cpu, so that their workers
+     * are not all pinned to the same cores.
+     */
+    Pool(int nthreads, int first_cpu);
+    ~Pool();
+
+    int nthreads() const { return _workers.size(); }
+
+    /* fn over [0, count) in grains of grain elements, returns once all are done */
+    void parallel_for(std::size_t count, std::size_t grain, const range_fn_t &fn);
+
+};
+
+}
+
+#endif
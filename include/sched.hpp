@@ -0,0 +1,115 @@
+#ifndef SCHED_HPP
+#define SCHED_HPP
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <mpi.h>
+
+/*
+ * Priority scheduling of outstanding collectives, block by block.
+ *
+ * A job is a collective split into blocks. Its blocks go out on a channel,
+ * a private duplicate of the job's communicator: channel i serves priority
+ * i, the first one also the lower priorities and the last one the higher
+ * ones. A job only shares its channel with jobs of a lower priority where
+ * both priorities are 0 or less, or both at least the number of channels
+ * less 1. A channel issues the blocks of its jobs in posting order, at most
+ * SCHED_WINDOW of them in flight at a time. That order is all the ranks
+ * have to agree on, so a rank issues blocks whenever it gets to: when a job
+ * is posted and in progress(), which HEAR_Test, HEAR_Wait and the
+ * intercepted collectives call. (Reordering a channel by priority would
+ * depend on which jobs a rank has seen posted by then.) Jobs on different
+ * channels are in flight at the same time, so a job posted with a higher
+ * priority does not queue behind the blocks of a large one with a lower
+ * priority. Where several channels can issue, and several blocks arrived,
+ * progress() serves the job with the highest priority first, the earliest
+ * posted among equals.
+ *
+ * A block is prepared (encrypted) right before it is issued and finished
+ * (decrypted) in the progress() call that sees it arrive, while the other
+ * blocks in flight move on. The channels are created by the first job that
+ * needs them, on all ranks alike, and freed with the communicator.
+ */
+
+namespace sched {
+
+#define SCHED_WINDOW 2
+
+struct Job
+{
+    MPI_Comm comm;
+    int priority;
+    int nblocks;
+
+    /* of block i: encrypt it, start its collective on a channel, decrypt it */
+    std::function<int(int)> prepare;
+    std::function<int(int, MPI_Comm, MPI_Request *)> start;
+    std::function<int(int)> finish;
+
+    /* the scheduler's */
+    unsigned long long seq;
+    int next;
+    int ndone;
+    /* issued and not finished yet */
+    int inflight;
+    int error;
+
+    bool complete() const { return !inflight && (ndone == nblocks || error != MPI_SUCCESS); }
+};
+
+class Scheduler
+{
+
+private:
+
+    struct Block
+    {
+	std::shared_ptr<Job> job;
+	int index;
+	MPI_Request req;
+    };
+
+    struct Channel
+    {
+	MPI_Comm comm;
+	/* jobs with blocks that were not issued yet, the first one issues next */
+	std::deque<std::shared_ptr<Job>> jobs;
+	std::vector<Block> inflight;
+    };
+
+    int _nchannels;
+    std::unordered_map<MPI_Comm, std::vector<Channel>> _channels;
+    unsigned long long _next_seq;
+
+    /* arrived, not finished yet */
+    std::vector<Block> _received;
+
+    int channel(const Job &job, Channel **channel);
+    void fail(Job &job, int error);
+    bool test(bool block);
+    bool issue();
+    bool finish();
+
+public:
+
+    explicit Scheduler(int nchannels) : _nchannels(nchannels > 0 ? nchannels : 1), _next_seq(0) {}
+    ~Scheduler();
+
+    /* collective over job->comm where it creates a channel */
+    int post(const std::shared_ptr<Job> &job);
+    /* false where nothing was issued, arrived or finished */
+    bool progress();
+    /* progresses until job is complete, returns its first error */
+    int wait(const std::shared_ptr<Job> &job);
+    /* with MPI_Comm_free, jobs on comm have to be complete */
+    void remove_comm(MPI_Comm comm);
+
+};
+
+}
+
+#endif
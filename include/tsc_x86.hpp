@@ -1,3 +1,11 @@
+#ifndef TSC_X86_HPP
+#define TSC_X86_HPP
+
+#include <stdio.h>
+#include <time.h>
+#include <cpuid.h>
+#include <x86intrin.h>
+
 /* ==================== GNU C and possibly other UNIX compilers ===================== */
 #if !defined(WIN32) || defined(__GNUC__)
 
@@ -74,20 +82,99 @@
 #endif
 
 
-void init_tsc() {
-	; // no need to initialize anything for x86
+/*
+ * The probes fence rdtsc with lfence instead of serialising with CPUID,
+ * which costs hundreds of cycles and as much again under virtualisation:
+ * lfence waits for earlier instructions to complete and keeps later ones
+ * from starting. stop_tsc() reads with rdtscp, which waits for the timed
+ * code, and subtracts what an empty start/stop pair measures, so that it
+ * is 0 for no work rather than the probes' own cost.
+ *
+ * init_tsc() measures that overhead and the TSC frequency against
+ * CLOCK_MONOTONIC_RAW, for tsc_to_ns(). The conversion only holds with an
+ * invariant TSC, which ticks at a constant rate through frequency and
+ * power state changes; tsc_calibration().invariant says whether the CPU
+ * has one, and the calibration warns on stderr where it does not. It runs
+ * on first use, init_tsc() moves that out of the timed region.
+ */
+
+#define TSC_OVERHEAD_SAMPLES 1000
+#define TSC_CALIBRATION_NS 10000000 /* 10 ms */
+
+struct tsc_calibration_t
+{
+	myInt64 overhead;       /* cycles of an empty start/stop pair */
+	double ns_per_cycle;
+	bool invariant;
+};
+
+inline myInt64 start_tsc(void) {
+	myInt64 start;
+	_mm_lfence();
+	start = __rdtsc();
+	_mm_lfence();
+	return start;
+}
+
+inline myInt64 read_tsc_end(void) {
+	unsigned int aux;
+	myInt64 end = __rdtscp(&aux);
+	_mm_lfence();
+	return end;
 }
 
-myInt64 start_tsc(void) {
-    tsc_counter start;
-    CPUID();
-    RDTSC(start);
-    return COUNTER_VAL(start);
+inline myInt64 clock_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (myInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-myInt64 stop_tsc(myInt64 start) {
-	tsc_counter end;
-	RDTSC(end);
-	CPUID();
-	return COUNTER_VAL(end) - start;
+inline tsc_calibration_t calibrate_tsc(void) {
+	tsc_calibration_t cal;
+	unsigned int eax, ebx, ecx, edx;
+	myInt64 t0, c0, t1, c1;
+
+	/* CPUID.80000007H:EDX[8] */
+	cal.invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+	if (!cal.invariant)
+		fprintf(stderr, "HEAR tsc: the TSC is not invariant, times in nanoseconds may be off\n");
+
+	cal.overhead = ~0ULL;
+	for (int i = 0; i < TSC_OVERHEAD_SAMPLES; i++) {
+		myInt64 start = start_tsc();
+		myInt64 cycles = read_tsc_end() - start;
+		if (cycles < cal.overhead)
+			cal.overhead = cycles;
+	}
+
+	t0 = clock_ns();
+	c0 = start_tsc();
+	do {
+		t1 = clock_ns();
+	} while (t1 - t0 < TSC_CALIBRATION_NS);
+	c1 = read_tsc_end();
+	cal.ns_per_cycle = (double)(t1 - t0) / (c1 - c0);
+
+	return cal;
 }
+
+inline const tsc_calibration_t &tsc_calibration(void) {
+	static const tsc_calibration_t cal = calibrate_tsc();
+	return cal;
+}
+
+inline void init_tsc() {
+	tsc_calibration();
+}
+
+inline myInt64 stop_tsc(myInt64 start) {
+	myInt64 cycles = read_tsc_end() - start;
+	myInt64 overhead = tsc_calibration().overhead;
+	return cycles > overhead ? cycles - overhead : 0;
+}
+
+inline double tsc_to_ns(myInt64 cycles) {
+	return cycles * tsc_calibration().ns_per_cycle;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef TUNE_HPP
+#define TUNE_HPP
+
+#include <map>
+#include <string>
+
+#include <mpi.h>
+
+/*
+ * Tuning results that persist across runs.
+ *
+ * HEAR_TUNE_CACHE names a text file with one section per machine key, the
+ * CPU model, the number of ranks, the ranks per node and the MPI library:
+ *
+ *   [cpu=...;ranks=96;ranks_per_node=48;mpi=Open MPI v4.1.4]
+ *   block_size=262144
+ *   int_kernel=aesni_unroll
+ *
+ * Known names are block_size, int_kernel, node_keystream_min_count and
+ * lazy_decrypt_min_bytes, the HEAR_* variable of the same setting takes
+ * precedence. Entries come from HEAR_TUNE=1, which calibrates what a run
+ * did not find in the cache during MPI_Init, or are written by hand, e.g.,
+ * from a sweep. Values out of range are ignored with a warning, and a
+ * block_size that is ignored is calibrated again, with or without HEAR_TUNE.
+ */
+
+namespace tune {
+
+using Values = std::map<std::string, std::string>;
+
+/* collective over comm, the same string on all of its ranks */
+std::string machine_key(MPI_Comm comm);
+
+/* false where text is not a decimal integer in [min, max], e.g., from a cache edited by hand */
+bool parse_integer(const std::string &text, long long min, long long max, long long &value);
+
+class Cache
+{
+
+private:
+
+    std::string _path;
+    std::map<std::string, Values> _entries;
+
+public:
+
+    explicit Cache(const std::string &path) : _path(path) {}
+
+    /* false if the file does not exist or cannot be read */
+    bool load();
+    /* replaces the file, concurrent savers do not see half-written files */
+    bool save() const;
+
+    bool lookup(const std::string &key, Values &values) const;
+    void store(const std::string &key, const Values &values);
+
+    /* name=value lines, as in the file */
+    static std::string serialize(const Values &values);
+    static Values parse(const std::string &text);
+
+};
+
+}
+
+#endif
@@ -3,10 +3,13 @@ import seaborn as sns
 import pandas as pd
 import numpy as np
 import itertools
+import sys
 plt.rcParams.update({'font.size': 14})
 
 # Load data and constants
-dataframe = pd.read_csv("../tests/implementation/results/osu_allreduce.csv")
+# scripts/simulate_scaling.py writes the same columns, pass its output to compare
+csv_path = sys.argv[1] if len(sys.argv) > 1 else "../tests/implementation/results/osu_allreduce.csv"
+dataframe = pd.read_csv(csv_path)
 markers = itertools.cycle(["X", "+", "o", "^"])
 marker = next(markers)
 colors = itertools.cycle(['#1f77b4', '#ff7f0e', '#2ca02c', '#d62728', '#9467bd', '#8c564b', '#e377c2', '#7f7f7f',
@@ -0,0 +1,29 @@
+import sys
+import os
+import subprocess
+from pathlib import Path
+
+scriptpath = sys.argv[1] + "/bin/encr_contention_test"
+logdir = sys.argv[2] + "/logs_multi_core_tput/"
+maxthreads = int(sys.argv[3])
+expname = "multi_core_encr_tput"
+niters = "100"
+nthreads = [str(j) for j in range(1, maxthreads + 1)]
+bufsizes = [str(2**j) for j in range(12, 27, 2)]
+dtypes = ["int", "float"]
+funcs = {"int": ["sha1sse2", "sha1avx2", "aesni", "aesni_unroll"],
+         "float": ["aesni_unroll", "aesni_narrow"]}
+nts = ["0", "1"]
+
+if not Path(logdir).is_dir():
+    os.mkdir(logdir)
+
+for dtype in dtypes:
+    for func in funcs[dtype]:
+        for nt in nts:
+            for bufsize in bufsizes:
+                for nthread in nthreads:
+                    with open(logdir + expname + "." + dtype + "." + func + "." + nt + "." + bufsize + "." + nthread + ".log", "w") as log:
+                        cmd = [scriptpath, niters, bufsize, nthread, dtype, func, nt]
+                        print(cmd)
+                        subprocess.call(cmd, stdout=log, stderr=log)
@@ -0,0 +1,218 @@
+import sys
+import os
+import re
+import math
+import argparse
+from pathlib import Path
+
+# Analytical model of libhear's MPI_Allreduce at scale.
+#
+# Kernel costs are calibrated from the logs written by
+# scripts/single_core_encr_tput.py (encr_perf_test output) or given as
+# constant throughputs; the network follows LogGP (L, o, g, G) with
+# separate intra- and inter-node parameters. The output uses the same
+# columns as the osu_allreduce.csv consumed by plotting/latency_scaling.py.
+
+LOG_PATTERN = re.compile(r"single_core_encr_tput_float\.(\w+)\.(\w+)\.(\w+)\.(\d+)\.log")
+
+
+class KernelModel:
+    """Encryption/decryption time as a function of the number of items."""
+
+    def __init__(self, points_encr, points_decr, const_encr_gbps, const_decr_gbps):
+        self.points_encr = sorted(points_encr)
+        self.points_decr = sorted(points_decr)
+        self.const_encr_gbps = const_encr_gbps
+        self.const_decr_gbps = const_decr_gbps
+
+    @staticmethod
+    def _interpolate(points, nitems):
+        # piecewise linear in (log nitems, time per item), constant outside
+        if nitems <= 0:
+            return 0.0
+        if nitems <= points[0][0]:
+            return points[0][1] / points[0][0] * nitems
+        if nitems >= points[-1][0]:
+            return points[-1][1] / points[-1][0] * nitems
+        for (n0, t0), (n1, t1) in zip(points, points[1:]):
+            if n0 <= nitems <= n1:
+                w = (math.log(nitems) - math.log(n0)) / (math.log(n1) - math.log(n0))
+                per_item = (1 - w) * t0 / n0 + w * t1 / n1
+                return per_item * nitems
+
+    def encrypt(self, nitems, item_size):
+        if self.points_encr:
+            return self._interpolate(self.points_encr, nitems)
+        return nitems * item_size / (self.const_encr_gbps * 1e9)
+
+    def decrypt(self, nitems, item_size):
+        if self.points_decr:
+            return self._interpolate(self.points_decr, nitems)
+        return nitems * item_size / (self.const_decr_gbps * 1e9)
+
+
+def load_kernel_logs(logdir, dtype, op, func):
+    points_encr = []
+    points_decr = []
+
+    for filename in os.listdir(logdir):
+        match = LOG_PATTERN.fullmatch(filename)
+        if not match or match.groups()[:3] != (dtype, op, func):
+            continue
+        nitems = int(match.group(4))
+        with open(os.path.join(logdir, filename), "r") as log:
+            for line in log:
+                if line.startswith("Avg encryption time:"):
+                    points_encr.append((nitems, float(line.split()[3])))
+                if line.startswith("Avg decryption time:"):
+                    points_decr.append((nitems, float(line.split()[3])))
+
+    if not points_encr or not points_decr:
+        sys.exit(f"No kernel measurements for {dtype}.{op}.{func} in {logdir}")
+
+    return points_encr, points_decr
+
+
+class LogGP:
+
+    def __init__(self, L, o, g, G):
+        self.L = L
+        self.o = o
+        self.g = g
+        self.G = G
+
+    def message(self, nbytes):
+        return self.L + 2 * self.o + max(self.g, max(nbytes - 1, 0) * self.G)
+
+
+def recursive_doubling(nranks, nbytes, net, gamma):
+    rounds = math.ceil(math.log2(nranks)) if nranks > 1 else 0
+    return rounds * (net.message(nbytes) + gamma * nbytes)
+
+
+def ring(nranks, nbytes, net, gamma):
+    if nranks == 1:
+        return 0.0
+    chunk = nbytes / nranks
+    reduce_scatter = (nranks - 1) * (net.message(chunk) + gamma * chunk)
+    allgather = (nranks - 1) * net.message(chunk)
+    return reduce_scatter + allgather
+
+
+def flat_allreduce(nranks, nbytes, net, gamma, algorithm):
+    if algorithm == "recursive_doubling":
+        return recursive_doubling(nranks, nbytes, net, gamma)
+    if algorithm == "ring":
+        return ring(nranks, nbytes, net, gamma)
+    # what MPI libraries do: pick the cheaper one for the message size
+    return min(recursive_doubling(nranks, nbytes, net, gamma), ring(nranks, nbytes, net, gamma))
+
+
+def allreduce(nranks, ppn, nbytes, args, hierarchical):
+    intra = LogGP(args.L_intra, args.o_intra, args.g_intra, args.G_intra)
+    inter = LogGP(args.L, args.o, args.g, args.G)
+    gamma = args.gamma
+
+    if nranks <= ppn:
+        return flat_allreduce(nranks, nbytes, intra, gamma, args.algorithm)
+
+    if not hierarchical:
+        # the inter-node links bound every step of a flat algorithm
+        return flat_allreduce(nranks, nbytes, inter, gamma, args.algorithm)
+
+    nnodes = math.ceil(nranks / ppn)
+    node_steps = math.ceil(math.log2(ppn)) if ppn > 1 else 0
+    reduce = node_steps * (intra.message(nbytes) + gamma * nbytes)
+    bcast = node_steps * intra.message(nbytes)
+    return reduce + flat_allreduce(nnodes, nbytes, inter, gamma, args.algorithm) + bcast
+
+
+def hear_allreduce(nranks, ppn, nitems, item_size, block_size, kernels, args, hierarchical):
+    comm = lambda n: allreduce(nranks, ppn, n * item_size, args, hierarchical)
+
+    if block_size == 0:
+        # USE_PIPELINING unset: encrypt, communicate, decrypt
+        return kernels.encrypt(nitems, item_size) + comm(nitems) + kernels.decrypt(nitems, item_size)
+
+    # Mirrors the loop in MPI_Allreduce: block i is in flight while
+    # block i - 1 is decrypted and block i + 1 is encrypted.
+    blocks = [block_size] * (nitems // block_size)
+    if nitems % block_size:
+        blocks.append(nitems % block_size)
+
+    latency = kernels.encrypt(blocks[0], item_size)
+    for i, cur in enumerate(blocks):
+        crypto = 0.0
+        if i > 0:
+            crypto += kernels.decrypt(blocks[i - 1], item_size)
+        if i + 1 < len(blocks):
+            crypto += kernels.encrypt(blocks[i + 1], item_size)
+        latency += max(comm(cur), crypto)
+    latency += kernels.decrypt(blocks[-1], item_size)
+
+    return latency
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Predict libhear MPI_Allreduce latency at scale")
+    parser.add_argument("output", help="CSV file in the osu_allreduce.csv format")
+    parser.add_argument("--logdir", help="logs_single_core_tput directory of single_core_encr_tput.py")
+    parser.add_argument("--dtype", default="int", choices=["int", "float"])
+    parser.add_argument("--op", default="sum")
+    parser.add_argument("--func", default="aesni", help="kernel name used by encr_perf_test")
+    parser.add_argument("--encr-gbps", type=float, default=10.0, help="used when no logs are given")
+    parser.add_argument("--decr-gbps", type=float, default=10.0, help="used when no logs are given")
+    parser.add_argument("--ranks", default="2,4,8,16,32,64,128,256,512,1024,2048,4096")
+    parser.add_argument("--ppn", type=int, default=36)
+    parser.add_argument("--msgsizes", default="16,8388608", help="message sizes in bytes")
+    parser.add_argument("--block-sizes", default="65536", help="pipelining block sizes in items, 0 disables pipelining")
+    parser.add_argument("--algorithm", default="auto", choices=["auto", "ring", "recursive_doubling"])
+    parser.add_argument("--hierarchical", action="store_true", help="also emit node-aware variants")
+    # LogGP, seconds and seconds/byte; defaults roughly match an EDR-class network
+    parser.add_argument("--L", type=float, default=1.0e-6)
+    parser.add_argument("--o", type=float, default=0.3e-6)
+    parser.add_argument("--g", type=float, default=0.4e-6)
+    parser.add_argument("--G", type=float, default=1.0 / 10e9)
+    parser.add_argument("--L-intra", type=float, default=0.2e-6)
+    parser.add_argument("--o-intra", type=float, default=0.1e-6)
+    parser.add_argument("--g-intra", type=float, default=0.1e-6)
+    parser.add_argument("--G-intra", type=float, default=1.0 / 20e9)
+    parser.add_argument("--gamma", type=float, default=1.0 / 20e9, help="reduction cost, seconds/byte")
+    args = parser.parse_args()
+
+    if args.logdir:
+        points_encr, points_decr = load_kernel_logs(args.logdir, args.dtype, args.op, args.func)
+    else:
+        points_encr, points_decr = [], []
+    kernels = KernelModel(points_encr, points_decr, args.encr_gbps, args.decr_gbps)
+
+    item_size = 4
+    ranks = [int(r) for r in args.ranks.split(",")]
+    msgsizes = [int(m) for m in args.msgsizes.split(",")]
+    block_sizes = [int(b) for b in args.block_sizes.split(",")]
+    variants = [False, True] if args.hierarchical else [False]
+
+    Path(args.output).parent.mkdir(parents=True, exist_ok=True)
+    with open(args.output, "w") as csv_out:
+        csv_out.write("dtype,op,mode,nranks,block_size,msgsize,trial,avg_lat,avg_tput,min_lat,min_tput,max_lat,max_tput\n")
+
+        for hierarchical in variants:
+            suffix = "_hierarchical" if hierarchical else ""
+            for nranks in ranks:
+                for msg_size in msgsizes:
+                    nitems = max(msg_size // item_size, 1)
+                    rows = [("baseline" + suffix, 0, allreduce(nranks, args.ppn, msg_size, args, hierarchical))]
+                    for block_size in block_sizes:
+                        rows.append(("optimized" + suffix, block_size,
+                                     hear_allreduce(nranks, args.ppn, nitems, item_size, block_size,
+                                                    kernels, args, hierarchical)))
+                    for mode, block_size, latency in rows:
+                        # us and bytes/us * 1e-3 like postprocess_synthetic_perf.py
+                        lat = round(latency * 1e6, 3)
+                        tput = round(msg_size / lat * 1e-3, 3) if lat > 0 else 0
+                        csv_out.write(f"{args.dtype},{args.op},{mode},{nranks},{block_size},{msg_size},1,"
+                                      f"{lat},{tput},{lat},{tput},{lat},{tput}\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -64,4 +64,6 @@ make clean
 make correctness
 mv hfloat_correctness build/bin
 mv integer_correctness build/bin
+mv keystream_correctness build/bin
+mv jit_correctness build/bin
 make clean
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <openssl/sha.h>
+
+#include "alltoall.hpp"
+
+namespace alltoall {
+
+#define ALLTOALL_TAG 0
+
+Exchange::Exchange(MPI_Comm comm, const std::vector<io::cipher_key_t> &send_keys,
+		   const std::vector<io::cipher_key_t> &recv_keys, std::size_t chunk_bytes,
+		   acquire_fn_t acquire, release_fn_t release)
+    : _comm(comm), _chunk_bytes(std::max<std::size_t>(chunk_bytes / 16 * 16, 16)), _seq(0),
+      _acquire(std::move(acquire)), _release(std::move(release))
+{
+    _send.reserve(send_keys.size());
+    for (const auto &key : send_keys)
+	_send.emplace_back(key, 1, 0);
+    _recv.reserve(recv_keys.size());
+    for (const auto &key : recv_keys)
+	_recv.emplace_back(key, 1, 0);
+}
+
+Exchange::~Exchange()
+{
+    PMPI_Comm_free(&_comm);
+}
+
+io::cipher_key_t Exchange::pair_key(unsigned int k_n, const std::vector<unsigned int> &k_s, int src, int dst)
+{
+    /* the k_s may coincide, the ranks tell the pairs apart */
+    unsigned int data[5] = {k_n, static_cast<unsigned int>(src), k_s[src], static_cast<unsigned int>(dst), k_s[dst]};
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    io::cipher_key_t key;
+
+    SHA256(reinterpret_cast<const unsigned char *>(data), sizeof(data), digest);
+    std::memcpy(key.data(), digest, key.size());
+    return key;
+}
+
+/* chunk i of a message of len bytes */
+static std::size_t chunk_len(std::size_t i, std::size_t chunk_bytes, std::size_t len)
+{
+    return std::min(chunk_bytes, len - i * chunk_bytes);
+}
+
+static std::size_t nchunks(std::size_t chunk_bytes, std::size_t len)
+{
+    return (len + chunk_bytes - 1) / chunk_bytes;
+}
+
+/* cancels and completes reqs */
+static void abandon(std::vector<MPI_Request> &reqs)
+{
+    for (auto &req : reqs) {
+	if (req != MPI_REQUEST_NULL)
+	    PMPI_Cancel(&req);
+    }
+    PMPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+}
+
+int Exchange::alltoallv(const void *sendbuf, const std::size_t sendbytes[], const std::size_t sdispls[],
+			void *recvbuf, const std::size_t recvbytes[], const std::size_t rdispls[],
+			const policy::Decision &decision)
+{
+    const unsigned char *src = static_cast<const unsigned char *>(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+    unsigned char *dst = static_cast<unsigned char *>(recvbuf);
+    bool in_place = sendbuf == MPI_IN_PLACE;
+    std::size_t scratch_len = 0;
+    /* given back on every return */
+    std::unique_ptr<unsigned char, std::function<void(unsigned char *)>> scratch(
+	nullptr, [this, &scratch_len](unsigned char *buf) { _release(buf, scratch_len); });
+    std::vector<std::size_t> scratch_displs;
+    std::vector<MPI_Request> send_reqs, recv_reqs;
+    /* (rank, chunk) of every receive */
+    std::vector<std::pair<int, std::size_t>> recv_chunks;
+    std::vector<int> landed;
+    std::uint64_t seq = _seq++;
+    int comm_size, my_rank;
+    int nrecvs = 0;
+    int ret;
+
+    PMPI_Comm_size(_comm, &comm_size);
+    PMPI_Comm_rank(_comm, &my_rank);
+
+    /* on an error, so that no request still reads or writes the buffers once they are returned */
+    auto fail = [&](int err) {
+	abandon(recv_reqs);
+	abandon(send_reqs);
+	return err;
+    };
+    auto encrypted = [&decision](std::size_t nbytes) { return nbytes && decision.encrypted(nbytes); };
+    /* sent from scratch: the encrypted messages, and in place all of them, the receives overwrite recvbuf */
+    auto staged = [&](int rank) { return rank != my_rank && (in_place || encrypted(sendbytes[rank])); };
+    auto stage = [&](int rank, std::size_t chunk) {
+	std::size_t begin = chunk * _chunk_bytes;
+	std::size_t len = chunk_len(chunk, _chunk_bytes, sendbytes[rank]);
+
+	if (encrypted(sendbytes[rank]))
+	    _send[rank].apply(scratch.get() + scratch_displs[rank] + begin, src + sdispls[rank] + begin,
+			      len, seq, begin);
+	else
+	    std::memcpy(scratch.get() + scratch_displs[rank] + begin, src + sdispls[rank] + begin, len);
+    };
+
+    scratch_displs.assign(comm_size, 0);
+    for (int rank = 0; rank < comm_size; rank++) {
+	scratch_displs[rank] = scratch_len;
+	if (staged(rank))
+	    scratch_len += sendbytes[rank];
+    }
+    if (scratch_len) {
+	scratch.reset(static_cast<unsigned char *>(_acquire(scratch_len)));
+	if (!scratch)
+	    return MPI_ERR_BUFFER;
+    }
+
+    if (in_place) {
+	for (int rank = 0; rank < comm_size; rank++) {
+	    for (std::size_t chunk = 0; staged(rank) && chunk < nchunks(_chunk_bytes, sendbytes[rank]); chunk++)
+		stage(rank, chunk);
+	}
+    } else if (sendbytes[my_rank]) {
+	std::memcpy(dst + rdispls[my_rank], src + sdispls[my_rank], sendbytes[my_rank]);
+    }
+
+    /* from (rank - step) % size in step */
+    for (int step = 1; step < comm_size; step++) {
+	int rank = (my_rank - step + comm_size) % comm_size;
+
+	for (std::size_t chunk = 0; chunk < nchunks(_chunk_bytes, recvbytes[rank]); chunk++)
+	    recv_chunks.push_back({rank, chunk});
+    }
+    recv_reqs.assign(recv_chunks.size(), MPI_REQUEST_NULL);
+    landed.resize(recv_chunks.size());
+
+    for (std::size_t i = 0; i < recv_chunks.size(); i++) {
+	int rank = recv_chunks[i].first;
+	std::size_t begin = recv_chunks[i].second * _chunk_bytes;
+
+	ret = PMPI_Irecv(dst + rdispls[rank] + begin, chunk_len(recv_chunks[i].second, _chunk_bytes, recvbytes[rank]),
+			 MPI_BYTE, rank, ALLTOALL_TAG, _comm, &recv_reqs[i]);
+	if (ret != MPI_SUCCESS) {
+	    recv_reqs[i] = MPI_REQUEST_NULL;
+	    return fail(ret);
+	}
+	nrecvs++;
+    }
+
+    auto decrypt_landed = [&](int outcount) {
+	for (int i = 0; i < outcount; i++) {
+	    int rank = recv_chunks[landed[i]].first;
+	    std::size_t chunk = recv_chunks[landed[i]].second;
+	    unsigned char *begin = dst + rdispls[rank] + chunk * _chunk_bytes;
+
+	    if (encrypted(recvbytes[rank]))
+		_recv[rank].apply(begin, begin, chunk_len(chunk, _chunk_bytes, recvbytes[rank]),
+				  seq, chunk * _chunk_bytes);
+	}
+	nrecvs -= outcount;
+    };
+
+    /* to (rank + step) % size in step, a chunk is encrypted while the previous ones are sent */
+    for (int step = 1; step < comm_size; step++) {
+	int rank = (my_rank + step) % comm_size;
+
+	for (std::size_t chunk = 0; chunk < nchunks(_chunk_bytes, sendbytes[rank]); chunk++) {
+	    std::size_t begin = chunk * _chunk_bytes;
+	    const unsigned char *msg = src + sdispls[rank];
+	    int outcount;
+
+	    if (!in_place && staged(rank))
+		stage(rank, chunk);
+	    if (staged(rank))
+		msg = scratch.get() + scratch_displs[rank];
+
+	    send_reqs.push_back(MPI_REQUEST_NULL);
+	    ret = PMPI_Isend(msg + begin, chunk_len(chunk, _chunk_bytes, sendbytes[rank]), MPI_BYTE,
+			     rank, ALLTOALL_TAG, _comm, &send_reqs.back());
+	    if (ret != MPI_SUCCESS) {
+		send_reqs.back() = MPI_REQUEST_NULL;
+		return fail(ret);
+	    }
+
+	    /* also progresses the sends */
+	    ret = PMPI_Testsome(recv_reqs.size(), recv_reqs.data(), &outcount, landed.data(), MPI_STATUSES_IGNORE);
+	    if (ret != MPI_SUCCESS)
+		return fail(ret);
+	    if (outcount != MPI_UNDEFINED)
+		decrypt_landed(outcount);
+	}
+    }
+
+    while (nrecvs) {
+	int outcount;
+
+	ret = PMPI_Waitsome(recv_reqs.size(), recv_reqs.data(), &outcount, landed.data(), MPI_STATUSES_IGNORE);
+	if (ret != MPI_SUCCESS)
+	    return fail(ret);
+	decrypt_landed(outcount);
+    }
+
+    return PMPI_Waitall(send_reqs.size(), send_reqs.data(), MPI_STATUSES_IGNORE);
+}
+
+}
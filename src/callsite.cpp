@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+
+#include <dlfcn.h>
+#include <cxxabi.h>
+
+#include "callsite.hpp"
+
+namespace callsite {
+
+int size_class(std::size_t nbytes)
+{
+    int cls = 0;
+
+    while (nbytes >>= 1)
+	cls++;
+
+    return cls;
+}
+
+Profiler::Profiler()
+    : _current(nullptr), _start(0)
+{
+    _stats.reserve(256);
+}
+
+void Profiler::begin(void *ret_addr, MPI_Comm comm, std::size_t nbytes)
+{
+    Stats &stats = _stats[{ret_addr, comm, size_class(nbytes)}];
+
+    if (!stats.ncalls) {
+	char name[MPI_MAX_OBJECT_NAME];
+	int len = 0;
+
+	MPI_Comm_size(comm, &stats.comm_size);
+	MPI_Comm_get_name(comm, name, &len);
+	if (len > 0) {
+	    stats.comm_name.assign(name, len);
+	} else {
+	    std::ostringstream os;
+	    os << "comm" << MPI_Comm_c2f(comm);
+	    stats.comm_name = os.str();
+	}
+    }
+
+    stats.ncalls++;
+    stats.nbytes += nbytes;
+    _current = &stats;
+    _start = start_tsc();
+}
+
+void Profiler::end()
+{
+    if (!_current)
+	return;
+
+    _current->total_cycles += stop_tsc(_start);
+    _current = nullptr;
+}
+
+/*
+ * Resolve a return address to "symbol+offset", falling back to
+ * "object+offset" (usable with addr2line) for stripped or non-exported
+ * symbols. Link applications with -rdynamic to get full names.
+ */
+static std::string resolve(void *ret_addr)
+{
+    std::ostringstream os;
+    Dl_info info;
+    /* point into the call instruction, not past it */
+    char *addr = static_cast<char *>(ret_addr) - 1;
+
+    if (!dladdr(addr, &info) || !info.dli_fname) {
+	os << ret_addr;
+	return os.str();
+    }
+
+    if (info.dli_sname) {
+	int status;
+	char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+	os << (status == 0 ? demangled : info.dli_sname);
+	os << "+0x" << std::hex << (addr - static_cast<char *>(info.dli_saddr) + 1);
+	std::free(demangled);
+    } else {
+	os << info.dli_fname;
+	os << "+0x" << std::hex << (addr - static_cast<char *>(info.dli_fbase) + 1);
+    }
+
+    return os.str();
+}
+
+void Profiler::report(std::ostream &os, int rank, std::size_t max_entries) const
+{
+    std::vector<std::pair<Key, Stats>> entries(_stats.begin(), _stats.end());
+    unsigned long long crypto_total = 0;
+    unsigned long long cycles_total = 0;
+
+    for (auto &entry: entries) {
+	crypto_total += entry.second.crypto_cycles;
+	cycles_total += entry.second.total_cycles;
+    }
+
+    /* where the encryption overhead is concentrated comes first */
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+	return a.second.crypto_cycles > b.second.crypto_cycles;
+    });
+
+    os << "rank=" << rank << " callsites=" << entries.size()
+       << " total_cycles=" << cycles_total << " crypto_cycles=" << crypto_total << std::endl;
+    os << "callsite,comm,comm_size,size_class,ncalls,nbytes,avg_cycles,avg_crypto_cycles,crypto_pct,crypto_share_pct,avg_ns,avg_crypto_ns" << std::endl;
+
+    for (std::size_t i = 0; i < entries.size() && i < max_entries; i++) {
+	const Key &key = entries[i].first;
+	const Stats &stats = entries[i].second;
+
+	os << resolve(key.ret_addr) << ","
+	   << stats.comm_name << ","
+	   << stats.comm_size << ","
+	   << (1ULL << key.size_class) << ","
+	   << stats.ncalls << ","
+	   << stats.nbytes << ","
+	   << stats.total_cycles / stats.ncalls << ","
+	   << stats.crypto_cycles / stats.ncalls << ","
+	   << std::fixed << std::setprecision(1)
+	   << (stats.total_cycles ? 100.0 * stats.crypto_cycles / stats.total_cycles : 0.0) << ","
+	   << (crypto_total ? 100.0 * stats.crypto_cycles / crypto_total : 0.0) << ","
+	   << std::setprecision(0)
+	   << tsc_to_ns(stats.total_cycles / stats.ncalls) << ","
+	   << tsc_to_ns(stats.crypto_cycles / stats.ncalls)
+	   << std::defaultfloat << std::endl;
+    }
+}
+
+}
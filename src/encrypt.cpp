@@ -1,17 +1,18 @@
 #include <cassert>
+#include <algorithm>
 
 #include "encrypt.hpp"
 #include "hfloat.hpp"
 
 namespace encryption {
 
-std::mt19937 encr_noise_generator;
+RANK_LOCAL std::mt19937 encr_noise_generator;
 
 void encrypt_int_sum_naive(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
 			   std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
 {
     unsigned int tmp1 = k_n + k_s[rank];
-    unsigned int tmp2 = k_n + k_s[rank + 1];
+    unsigned int tmp2 = is_edge ? 0 : k_n + k_s[rank + 1];
 
     if (!is_edge) {
 	for (unsigned int i = 0; i < count; i++) {
@@ -38,7 +39,7 @@ void encrypt_int_sum_sha1sse2(unsigned int *encr_sbuf, const unsigned int *sbuf,
 			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
 {
     unsigned int tmp1 = k_n + k_s[rank];
-    unsigned int tmp2 = k_n + k_s[rank + 1];
+    unsigned int tmp2 = is_edge ? 0 : k_n + k_s[rank + 1];
     __m128i ind1 = _mm_set_epi32(3 + tmp1, 2 + tmp1, 1 + tmp1, tmp1);
     __m128i ind2 = _mm_set_epi32(3 + tmp2, 2 + tmp2, 1 + tmp2, tmp2);
     __m128i incr = _mm_set_epi32(4, 4, 4, 4);
@@ -86,7 +87,7 @@ void encrypt_int_sum_sha1avx2(unsigned int *encr_sbuf, const unsigned int *sbuf,
 			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
 {
     unsigned int tmp1 = k_n + k_s[rank];
-    unsigned int tmp2 = k_n + k_s[rank + 1];
+    unsigned int tmp2 = is_edge ? 0 : k_n + k_s[rank + 1];
     __m256i ind1 = _mm256_set_epi32(7 + tmp1, 6 + tmp1, 5 + tmp1, 4 + tmp1, 3 + tmp1, 2 + tmp1, 1 + tmp1, tmp1);
     __m256i ind2 = _mm256_set_epi32(7 + tmp1, 6 + tmp1, 5 + tmp1, 4 + tmp1, 3 + tmp1, 2 + tmp1, 1 + tmp1, tmp1);
     __m256i incr = _mm256_set_epi32(8, 8, 8, 8, 8, 8, 8, 8);
@@ -178,6 +179,131 @@ void decrypt_float_sum_naive(float *rbuf, int count, std::vector<unsigned int> &
     }
 }
 
+/*
+ * Four-lane bodies of the float kernels, shared by the AES-NI and the
+ * precomputed-keystream kernels so that both compile to the same
+ * arithmetic (-ffast-math may approximate the division differently
+ * otherwise) and stay bit-exact.
+ */
+static inline void encrypt_float_sum_x4(float * __restrict__ encr_sbuf, const float * __restrict__ sbuf,
+					HNumbers::HNumber *hnum)
+{
+    signed int exponent[4];
+
+    exponent[0] = hnum[0].crypto.exponent;
+    exponent[1] = hnum[1].crypto.exponent;
+    exponent[2] = hnum[2].crypto.exponent;
+    exponent[3] = hnum[3].crypto.exponent;
+
+    hnum[0].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    hnum[1].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    hnum[2].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    hnum[3].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+
+    hnum[0].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[1].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[2].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[3].ieee_float.ieee.mantissa <<= SHIFT;
+
+    hnum[0].native_float *= sbuf[0];
+    hnum[1].native_float *= sbuf[1];
+    hnum[2].native_float *= sbuf[2];
+    hnum[3].native_float *= sbuf[3];
+
+    hnum[0].crypto_simplified.remainder >>= SHIFT;
+    hnum[1].crypto_simplified.remainder >>= SHIFT;
+    hnum[2].crypto_simplified.remainder >>= SHIFT;
+    hnum[3].crypto_simplified.remainder >>= SHIFT;
+
+    hnum[0].crypto.exponent += exponent[0] - IEEE754_FLOAT_BIAS;
+    hnum[1].crypto.exponent += exponent[1] - IEEE754_FLOAT_BIAS;
+    hnum[2].crypto.exponent += exponent[2] - IEEE754_FLOAT_BIAS;
+    hnum[3].crypto.exponent += exponent[3] - IEEE754_FLOAT_BIAS;
+
+    encr_sbuf[0] = hnum[0].native_float;
+    encr_sbuf[1] = hnum[1].native_float;
+    encr_sbuf[2] = hnum[2].native_float;
+    encr_sbuf[3] = hnum[3].native_float;
+}
+
+static inline void decrypt_float_sum_x4(float * __restrict__ rbuf, HNumbers::HNumber *noise)
+{
+    HNumbers::HNumber hnum[4];
+
+    hnum[0] = reinterpret_cast<HNumbers::HNumber &>(rbuf[0]);
+    hnum[1] = reinterpret_cast<HNumbers::HNumber &>(rbuf[1]);
+    hnum[2] = reinterpret_cast<HNumbers::HNumber &>(rbuf[2]);
+    hnum[3] = reinterpret_cast<HNumbers::HNumber &>(rbuf[3]);
+
+    hnum[0].crypto.exponent -= noise[0].crypto.exponent;
+    hnum[1].crypto.exponent -= noise[1].crypto.exponent;
+    hnum[2].crypto.exponent -= noise[2].crypto.exponent;
+    hnum[3].crypto.exponent -= noise[3].crypto.exponent;
+
+    hnum[0].crypto.exponent += IEEE754_FLOAT_BIAS;
+    hnum[1].crypto.exponent += IEEE754_FLOAT_BIAS;
+    hnum[2].crypto.exponent += IEEE754_FLOAT_BIAS;
+    hnum[3].crypto.exponent += IEEE754_FLOAT_BIAS;
+
+    hnum[0].crypto.exponent <<= SHIFT;
+    hnum[1].crypto.exponent <<= SHIFT;
+    hnum[2].crypto.exponent <<= SHIFT;
+    hnum[3].crypto.exponent <<= SHIFT;
+
+    hnum[0].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[1].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[2].ieee_float.ieee.mantissa <<= SHIFT;
+    hnum[3].ieee_float.ieee.mantissa <<= SHIFT;
+
+    noise[0].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    noise[1].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    noise[2].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+    noise[3].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
+
+    noise[0].ieee_float.ieee.mantissa <<= SHIFT;
+    noise[1].ieee_float.ieee.mantissa <<= SHIFT;
+    noise[2].ieee_float.ieee.mantissa <<= SHIFT;
+    noise[3].ieee_float.ieee.mantissa <<= SHIFT;
+
+    rbuf[0]     = hnum[0].native_float / noise[0].native_float;
+    rbuf[1] = hnum[1].native_float / noise[1].native_float;
+    rbuf[2] = hnum[2].native_float / noise[2].native_float;
+    rbuf[3] = hnum[3].native_float / noise[3].native_float;
+}
+
+void decrypt_int_sum_noise(unsigned int * __restrict__ rbuf, int count, const unsigned int * __restrict__ noise)
+{
+    for (unsigned int i = 0; i < count; i++) {
+	rbuf[i] = rbuf[i] - noise[i];
+    }
+}
+
+void encrypt_float_sum_noise(float * __restrict__ encr_sbuf, const float * __restrict__ sbuf,
+			     int count, const unsigned int * __restrict__ noise)
+{
+    HNumbers::HNumber hnum[4];
+
+    encr_sbuf = (float *)__builtin_assume_aligned(encr_sbuf, 32);
+    sbuf = (const float *)__builtin_assume_aligned(sbuf, 32);
+
+    for (unsigned int i = 0; i < count; i+=4) {
+	*((__m128i *)hnum) = _mm_loadu_si128(reinterpret_cast<const __m128i *>(noise + i));
+	encrypt_float_sum_x4(encr_sbuf + i, sbuf + i, hnum);
+    }
+}
+
+void decrypt_float_sum_noise(float * __restrict__ rbuf, int count, const unsigned int * __restrict__ noise)
+{
+    HNumbers::HNumber hnoise[4];
+
+    rbuf = (float *)__builtin_assume_aligned(rbuf, 32);
+
+    for (unsigned int i = 0; i < count; i+=4) {
+	*((__m128i *)hnoise) = _mm_loadu_si128(reinterpret_cast<const __m128i *>(noise + i));
+	decrypt_float_sum_x4(rbuf + i, hnoise);
+    }
+}
+
 #ifdef AESNI
 
 static __m128i key_schedule[11];
@@ -188,16 +314,16 @@ static __m128i key_schedule[11];
 #define AESNI128_ENC_BLOCK(m, n, k)	    \
     do {				    \
         n = _mm_xor_si128(m, k[0]);	    \
-        n = _mm_aesenc_si128(m, k[1]);	    \
-        n = _mm_aesenc_si128(m, k[2]);	    \
-        n = _mm_aesenc_si128(m, k[3]);	    \
-        n = _mm_aesenc_si128(m, k[4]);	    \
-        n = _mm_aesenc_si128(m, k[5]);	    \
-        n = _mm_aesenc_si128(m, k[6]);	    \
-        n = _mm_aesenc_si128(m, k[7]);	    \
-        n = _mm_aesenc_si128(m, k[8]);	    \
-        n = _mm_aesenc_si128(m, k[9]);	    \
-        n = _mm_aesenclast_si128(m, k[10]); \
+        n = _mm_aesenc_si128(n, k[1]);	    \
+        n = _mm_aesenc_si128(n, k[2]);	    \
+        n = _mm_aesenc_si128(n, k[3]);	    \
+        n = _mm_aesenc_si128(n, k[4]);	    \
+        n = _mm_aesenc_si128(n, k[5]);	    \
+        n = _mm_aesenc_si128(n, k[6]);	    \
+        n = _mm_aesenc_si128(n, k[7]);	    \
+        n = _mm_aesenc_si128(n, k[8]);	    \
+        n = _mm_aesenc_si128(n, k[9]);	    \
+        n = _mm_aesenclast_si128(n, k[10]); \
     } while (0)
 
 static __m128i aesni128_key_expand(__m128i key, __m128i keygened)
@@ -243,11 +369,34 @@ void aesni128_load_key(char *enc_key)
     key_schedule[10] = AESNI128_KEY_EXPAND(key_schedule[9], 0x36);
 }
 
+const __m128i* aesni128_key_schedule()
+{
+    return key_schedule;
+}
+
+/*
+ * Same counter layout as the aesni128 kernels: element i gets lane i % 4 of
+ * the block encrypting {ctr + i - i % 4, ..., ctr + i - i % 4 + 3}. Writes
+ * count rounded up to a multiple of 4.
+ */
+void aesni128_keystream(unsigned int * __restrict__ noise, int count, unsigned int ctr)
+{
+    __m128i ind = _mm_set_epi32(3 + ctr, 2 + ctr, 1 + ctr, ctr);
+    __m128i incr = _mm_set_epi32(4, 4, 4, 4);
+    __m128i block;
+
+    for (unsigned int i = 0; i < count; i+=4) {
+	AESNI128_ENC_BLOCK(ind, block, key_schedule);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(noise + i), block);
+	ind = _mm_add_epi32(ind, incr);
+    }
+}
+
 void encrypt_int_sum_aesni128(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
 			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
 {
     unsigned int tmp1 = k_n + k_s[rank];
-    unsigned int tmp2 = k_n + k_s[rank + 1];
+    unsigned int tmp2 = is_edge ? 0 : k_n + k_s[rank + 1];
     __m128i ind1 = _mm_set_epi32(3 + tmp1, 2 + tmp1, 1 + tmp1, tmp1);
     __m128i ind2 = _mm_set_epi32(3 + tmp2, 2 + tmp2, 1 + tmp2, tmp2);
     __m128i incr = _mm_set_epi32(4, 4, 4, 4);
@@ -295,7 +444,7 @@ void encrypt_int_sum_aesni128_unroll(unsigned int * __restrict__ encr_sbuf, cons
 				     int count, int rank, std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
 {
     unsigned int tmp1 = k_n + k_s[rank];
-    unsigned int tmp2 = k_n + k_s[rank + 1];
+    unsigned int tmp2 = is_edge ? 0 : k_n + k_s[rank + 1];
     unsigned int ind1[4] = {tmp1, tmp1 + 1, tmp1 + 2, tmp1 + 3};
     unsigned int ind2[4] = {tmp2, tmp2 + 1, tmp2 + 2, tmp2 + 3};
     unsigned int noise1[4];
@@ -384,7 +533,6 @@ void encrypt_float_sum_aesni128_unroll(float * __restrict__ encr_sbuf, const flo
 				       int count, int rank, std::vector<unsigned int> &k_s, unsigned int k_n)
 {
     unsigned int ind[4] = {k_n + 1, k_n + 2, k_n + 3, k_n + 4};
-    signed int exponent[4];
     HNumbers::HNumber hnum[4];
 
     encr_sbuf = (float *)__builtin_assume_aligned(encr_sbuf, 32);
@@ -393,40 +541,7 @@ void encrypt_float_sum_aesni128_unroll(float * __restrict__ encr_sbuf, const flo
     for (unsigned int i = 0; i < count; i+=4) {
         AESNI128_ENC_BLOCK(*((__m128i *)ind), *((__m128i *)hnum), key_schedule);
 
-	exponent[0] = hnum[0].crypto.exponent;
-	exponent[1] = hnum[1].crypto.exponent;
-	exponent[2] = hnum[2].crypto.exponent;
-	exponent[3] = hnum[3].crypto.exponent;
-
-	hnum[0].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	hnum[1].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	hnum[2].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	hnum[3].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-
-	hnum[0].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[1].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[2].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[3].ieee_float.ieee.mantissa <<= SHIFT;
-
-	hnum[0].native_float *= sbuf[i];
-	hnum[1].native_float *= sbuf[i + 1];
-	hnum[2].native_float *= sbuf[i + 2];
-	hnum[3].native_float *= sbuf[i + 3];
-
-	hnum[0].crypto_simplified.remainder >>= SHIFT;
-	hnum[1].crypto_simplified.remainder >>= SHIFT;
-	hnum[2].crypto_simplified.remainder >>= SHIFT;
-	hnum[3].crypto_simplified.remainder >>= SHIFT;
-
-	hnum[0].crypto.exponent += exponent[0] - IEEE754_FLOAT_BIAS;
-	hnum[1].crypto.exponent += exponent[1] - IEEE754_FLOAT_BIAS;
-	hnum[2].crypto.exponent += exponent[2] - IEEE754_FLOAT_BIAS;
-	hnum[3].crypto.exponent += exponent[3] - IEEE754_FLOAT_BIAS;
-
-	encr_sbuf[i] = hnum[0].native_float;
-	encr_sbuf[i + 1] = hnum[1].native_float;
-	encr_sbuf[i + 2] = hnum[2].native_float;
-	encr_sbuf[i + 3] = hnum[3].native_float;
+	encrypt_float_sum_x4(encr_sbuf + i, sbuf + i, hnum);
 
 	ind[0] += 4;
 	ind[1] += 4;
@@ -439,7 +554,6 @@ void decrypt_float_sum_aesni128_unroll(float * __restrict__ rbuf, int count,
 				       std::vector<unsigned int> &k_s, unsigned int k_n)
 {
     unsigned int ind[4] = {k_n + 1, k_n + 2, k_n + 3, k_n + 4};
-    HNumbers::HNumber hnum[4];
     HNumbers::HNumber noise[4];
 
     rbuf = (float *)__builtin_assume_aligned(rbuf, 32);
@@ -447,45 +561,7 @@ void decrypt_float_sum_aesni128_unroll(float * __restrict__ rbuf, int count,
     for (unsigned int i = 0; i < count; i+=4) {
         AESNI128_ENC_BLOCK(*((__m128i *)ind), *((__m128i *)noise), key_schedule);
 
-	hnum[0] = reinterpret_cast<HNumbers::HNumber &>(rbuf[i + 0]);
-	hnum[1] = reinterpret_cast<HNumbers::HNumber &>(rbuf[i + 1]);
-	hnum[2] = reinterpret_cast<HNumbers::HNumber &>(rbuf[i + 2]);
-	hnum[3] = reinterpret_cast<HNumbers::HNumber &>(rbuf[i + 3]);
-
-	hnum[0].crypto.exponent -= noise[0].crypto.exponent;
-	hnum[1].crypto.exponent -= noise[1].crypto.exponent;
-	hnum[2].crypto.exponent -= noise[2].crypto.exponent;
-	hnum[3].crypto.exponent -= noise[3].crypto.exponent;
-
-	hnum[0].crypto.exponent += IEEE754_FLOAT_BIAS;
-	hnum[1].crypto.exponent += IEEE754_FLOAT_BIAS;
-	hnum[2].crypto.exponent += IEEE754_FLOAT_BIAS;
-	hnum[3].crypto.exponent += IEEE754_FLOAT_BIAS;
-
-	hnum[0].crypto.exponent <<= SHIFT;
-	hnum[1].crypto.exponent <<= SHIFT;
-	hnum[2].crypto.exponent <<= SHIFT;
-	hnum[3].crypto.exponent <<= SHIFT;
-
-	hnum[0].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[1].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[2].ieee_float.ieee.mantissa <<= SHIFT;
-	hnum[3].ieee_float.ieee.mantissa <<= SHIFT;
-
-	noise[0].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	noise[1].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	noise[2].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-	noise[3].ieee_float.ieee.exponent = IEEE754_FLOAT_BIAS;
-
-	noise[0].ieee_float.ieee.mantissa <<= SHIFT;
-	noise[1].ieee_float.ieee.mantissa <<= SHIFT;
-	noise[2].ieee_float.ieee.mantissa <<= SHIFT;
-	noise[3].ieee_float.ieee.mantissa <<= SHIFT;
-
-	rbuf[i]     = hnum[0].native_float / noise[0].native_float;
-	rbuf[i + 1] = hnum[1].native_float / noise[1].native_float;
-	rbuf[i + 2] = hnum[2].native_float / noise[2].native_float;
-	rbuf[i + 3] = hnum[3].native_float / noise[3].native_float;
+	decrypt_float_sum_x4(rbuf + i, noise);
 
 	ind[0] += 4;
 	ind[1] += 4;
@@ -494,6 +570,100 @@ void decrypt_float_sum_aesni128_unroll(float * __restrict__ rbuf, int count,
     }
 }
 
+/*
+ * Expands eight 16-bit keystream values into crypto.{mantissa,exponent}
+ * noise: the low FLOAT_NARROW_NOISE_MANTISSA bits become the top of the
+ * mantissa, the remaining bits the sign-extended exponent.
+ */
+static inline void aesni128_narrow_noise_x8(HNumbers::HNumber *noise, __m128i block)
+{
+    const __m128i mantissa_mask = _mm_set1_epi32((1 << FLOAT_NARROW_NOISE_MANTISSA) - 1);
+    const __m128i exponent_mask = _mm_set1_epi32(((1 << FLOAT_EXPONENT) - 1) << FLOAT_MANTISSA);
+    __m128i lanes[2];
+
+    lanes[0] = _mm_cvtepi16_epi32(block);
+    lanes[1] = _mm_cvtepi16_epi32(_mm_srli_si128(block, 8));
+
+    for (int k = 0; k < 2; k++) {
+	__m128i mantissa = _mm_slli_epi32(_mm_and_si128(lanes[k], mantissa_mask),
+					  FLOAT_MANTISSA - FLOAT_NARROW_NOISE_MANTISSA);
+	__m128i exponent = _mm_and_si128(_mm_slli_epi32(_mm_srai_epi32(lanes[k], FLOAT_NARROW_NOISE_MANTISSA),
+							FLOAT_MANTISSA), exponent_mask);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(noise + 4 * k), _mm_or_si128(mantissa, exponent));
+    }
+}
+
+void encrypt_float_sum_aesni128_narrow(float * __restrict__ encr_sbuf, const float * __restrict__ sbuf,
+				       int count, int rank, std::vector<unsigned int> &k_s, unsigned int k_n)
+{
+    unsigned int ind[4] = {k_n + 1, k_n + 2, k_n + 3, k_n + 4};
+    HNumbers::HNumber hnum[8];
+    __m128i block;
+    unsigned int i;
+
+    encr_sbuf = (float *)__builtin_assume_aligned(encr_sbuf, 32);
+    sbuf = (const float *)__builtin_assume_aligned(sbuf, 32);
+
+    for (i = 0; i + 8 <= count; i+=8) {
+        AESNI128_ENC_BLOCK(*((__m128i *)ind), block, key_schedule);
+	aesni128_narrow_noise_x8(hnum, block);
+
+	encrypt_float_sum_x4(encr_sbuf + i, sbuf + i, hnum);
+	encrypt_float_sum_x4(encr_sbuf + i + 4, sbuf + i + 4, hnum + 4);
+
+	ind[0] += 8;
+	ind[1] += 8;
+	ind[2] += 8;
+	ind[3] += 8;
+    }
+
+    if (i < count) {
+	float in[8] = {0}, out[8];
+
+	std::copy(sbuf + i, sbuf + count, in);
+        AESNI128_ENC_BLOCK(*((__m128i *)ind), block, key_schedule);
+	aesni128_narrow_noise_x8(hnum, block);
+	encrypt_float_sum_x4(out, in, hnum);
+	encrypt_float_sum_x4(out + 4, in + 4, hnum + 4);
+	std::copy(out, out + (count - i), encr_sbuf + i);
+    }
+}
+
+void decrypt_float_sum_aesni128_narrow(float * __restrict__ rbuf, int count,
+				       std::vector<unsigned int> &k_s, unsigned int k_n)
+{
+    unsigned int ind[4] = {k_n + 1, k_n + 2, k_n + 3, k_n + 4};
+    HNumbers::HNumber noise[8];
+    __m128i block;
+    unsigned int i;
+
+    rbuf = (float *)__builtin_assume_aligned(rbuf, 32);
+
+    for (i = 0; i + 8 <= count; i+=8) {
+        AESNI128_ENC_BLOCK(*((__m128i *)ind), block, key_schedule);
+	aesni128_narrow_noise_x8(noise, block);
+
+	decrypt_float_sum_x4(rbuf + i, noise);
+	decrypt_float_sum_x4(rbuf + i + 4, noise + 4);
+
+	ind[0] += 8;
+	ind[1] += 8;
+	ind[2] += 8;
+	ind[3] += 8;
+    }
+
+    if (i < count) {
+	float buf[8] = {0};
+
+	std::copy(rbuf + i, rbuf + count, buf);
+        AESNI128_ENC_BLOCK(*((__m128i *)ind), block, key_schedule);
+	aesni128_narrow_noise_x8(noise, block);
+	decrypt_float_sum_x4(buf, noise);
+	decrypt_float_sum_x4(buf + 4, noise + 4);
+	std::copy(buf, buf + (count - i), rbuf + i);
+    }
+}
+
 #endif
 
 }
@@ -6,6 +6,15 @@
 #include <functional>
 #include <cassert>
 #include <cstring>
+#include <memory>
+#include <numeric>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+
+#include <cpuid.h>
+#include <unistd.h>
 
 #include <mpi.h>
 
@@ -15,7 +24,26 @@
 #define TSC_WARMUP_CUTOFF 200 /* similar to OSU benchmarks */
 #endif
 
+#ifdef CALLSITE_PROF
+#include <fstream>
+#include "callsite.hpp"
+#define CALLSITE_REPORT_ENTRIES 20
+#endif
+
 #include "encrypt.hpp"
+#include "keystream.hpp"
+#include "policy.hpp"
+#include "kdf.hpp"
+#include "lazy.hpp"
+#include "io.hpp"
+#include "alltoall.hpp"
+#include "tune.hpp"
+#include "sched.hpp"
+#include "pool.hpp"
+#include "plugin.hpp"
+#ifdef USE_JIT
+#include "jit.hpp"
+#endif
 #include "hear.hpp"
 
 /*
@@ -25,39 +53,266 @@
 
 #ifdef USE_MPOOL
 #include "mpool.hpp"
-size_t mpool_size = 4;
-size_t mpool_sbuf_len = 8388608;
+RANK_LOCAL size_t mpool_size = 4;
+RANK_LOCAL size_t mpool_sbuf_len = 8388608;
 #endif
 
 #ifdef USE_PIPELINING
-int pipelining_block_size = 65536;
+RANK_LOCAL int pipelining_block_size = 65536;
+#endif
+
+#ifdef USE_JIT
+/* generated kernels are specialized to the pipelining block, 0 lets them pick the unroll */
+RANK_LOCAL std::size_t jit_block_size = 0;
+RANK_LOCAL int jit_unroll = 0;
 #endif
 
 const int root_rank = 0;
 
-struct HearState
+/*
+ * Node-shared keystream for the rank-independent noise (float en-/decryption
+ * and integer decryption). Below the min count the node barrier costs more
+ * than the AES work it saves.
+ */
+RANK_LOCAL std::size_t node_keystream_min_count = 16384;
+RANK_LOCAL std::size_t node_keystream_max_count = 1048576;
+
+/* HEAR_LAZY_DECRYPT: below this, faulting pages in costs more than decrypting up front */
+RANK_LOCAL std::size_t lazy_decrypt_min_bytes = 16777216;
+
+/* HEAR_IO_KEY: MPI-IO transfers are en-/decrypted in chunks of this many bytes by io_threads threads */
+RANK_LOCAL std::size_t io_chunk_bytes = 4194304;
+RANK_LOCAL int io_threads = 1;
+
+/* HEAR_CRYPTO_THREADS: the kernels run in grains of crypto_grain_bytes on this many pool threads, 0 for none */
+RANK_LOCAL int crypto_threads = 0;
+RANK_LOCAL std::size_t crypto_grain_bytes = 0;
+
+/* MPI_Alltoall(v) messages are sent in chunks of this many bytes, see alltoall.hpp */
+RANK_LOCAL std::size_t alltoall_chunk_bytes = 1048576;
+
+/* HEAR_Iallreduce: channels per communicator, see sched.hpp, the same on all ranks */
+RANK_LOCAL int sched_channels = 4;
+
+/*
+ * CPU features that kernels need, every rank's are known to the others of a
+ * communicator, see HearState::negotiate_kernels()
+ */
+enum Capability : unsigned int
 {
+    CAP_SSE2 = 1 << 0,
+    CAP_AVX2 = 1 << 1,
+    CAP_AES = 1 << 2,
+    CAP_VAES = 1 << 3,
+    CAP_AVX512 = 1 << 4,
+    CAP_SHA = 1 << 5,
+    CAP_PLUGIN = 1 << 6,   /* a HEAR_PLUGIN backend is loaded */
+};
 
-private:
+static_assert(CAP_SSE2 == HEAR_PLUGIN_CAP_SSE2 && CAP_AVX2 == HEAR_PLUGIN_CAP_AVX2 &&
+	      CAP_AES == HEAR_PLUGIN_CAP_AES && CAP_VAES == HEAR_PLUGIN_CAP_VAES &&
+	      CAP_AVX512 == HEAR_PLUGIN_CAP_AVX512 && CAP_SHA == HEAR_PLUGIN_CAP_SHA,
+	      "plugins are checked against the same bits");
 
-    std::vector<std::vector<unsigned int>> _k_s_storage;
-    std::unordered_map<MPI_Comm, std::size_t> _k_s_map;
+/*
+ * All the kernels of a family generate the same keystream, so the ranks of
+ * a communicator have to agree on the family but not on the kernel, e.g.,
+ * jit with VAES on one rank and aesni on another.
+ */
+enum Family : unsigned int
+{
+    FAMILY_AES,
+    FAMILY_AES_NARROW,     /* float, 16 noise bits */
+    FAMILY_SHA1,           /* prng_uint, the fallback that runs everywhere */
+    FAMILY_SHA1_X4,
+    FAMILY_SHA1_X8,
+    FAMILY_PLUGIN,         /* the HEAR_PLUGIN backend's, the same one on every rank */
+    NFAMILIES,
+};
 
-    std::vector<unsigned int> _k_n_storage;
-    std::unordered_map<MPI_Comm, std::size_t> _k_n_map;
+struct KernelInfo
+{
+    const char *name;
+    Family family;
+    unsigned int caps;
+};
+
+/* in order of preference within a family */
+static const KernelInfo int_sum_kernels[] = {
+    {"aesni_unroll", FAMILY_AES, CAP_AES},
+    {"aesni", FAMILY_AES, CAP_AES},
+    {"jit", FAMILY_AES, CAP_AES | CAP_AVX2},
+    {"naive", FAMILY_SHA1, 0},
+    {"sha1sse2", FAMILY_SHA1_X4, CAP_SSE2},
+    {"sha1avx2", FAMILY_SHA1_X8, CAP_AVX2},
+};
+
+static const KernelInfo float_sum_kernels[] = {
+    {"aesni_unroll", FAMILY_AES, CAP_AES},
+    {"aesni_narrow", FAMILY_AES_NARROW, CAP_AES},
+    {"naive", FAMILY_SHA1, 0},
+};
+
+/* de-/encryption kernels, chosen per communicator by the policy */
+struct KernelSet
+{
+    /* names as in policy.hpp */
+    std::string int_sum_name;
+    std::string float_sum_name;
 
     /* MPI_INT + MPI_SUM */
-    std::function<void(unsigned int *, const unsigned int *, int, int, std::vector<unsigned int> &, unsigned int, bool)> encrypt_block_int_sum;
-    std::function<void(unsigned int *, int, std::vector<unsigned int> &, unsigned int)> decrypt_block_int_sum;
+    std::function<void(unsigned int *, const unsigned int *, int, int, std::vector<unsigned int> &, unsigned int, bool)> encrypt_int_sum;
+    std::function<void(unsigned int *, int, std::vector<unsigned int> &, unsigned int)> decrypt_int_sum;
 
     /* MPI_INT + MPI_PROD */
-    std::function<void(unsigned int *, const unsigned int *, int, int, std::vector<unsigned int> &, unsigned int, bool)> encrypt_block_int_prod;
-    std::function<void(unsigned int *, int, std::vector<unsigned int> &, unsigned int)> decrypt_block_int_prod;
+    std::function<void(unsigned int *, const unsigned int *, int, int, std::vector<unsigned int> &, unsigned int, bool)> encrypt_int_prod;
+    std::function<void(unsigned int *, int, std::vector<unsigned int> &, unsigned int)> decrypt_int_prod;
 
     /* MPI_FLOAT + MPI_SUM*/
-    std::function<void(float *, const float *, int, int, std::vector<unsigned int> &, unsigned int)> encrypt_block_float_sum;
-    std::function<void(float *, int, std::vector<unsigned int> &, unsigned int)> decrypt_block_float_sum;
+    std::function<void(float *, const float *, int, int, std::vector<unsigned int> &, unsigned int)> encrypt_float_sum;
+    std::function<void(float *, int, std::vector<unsigned int> &, unsigned int)> decrypt_float_sum;
+
+    /* the kernels use the aesni128 counter layout, which the node keystream replicates */
+    bool int_sum_aes_layout;
+    bool float_sum_aes_layout;
+
+    /* elements per counter block: a range that starts on one is en-/decrypted on its own under k_n + its offset */
+    int int_sum_block;
+    int float_sum_block;
+
+    /* steps k_n, FAMILY_AES or FAMILY_SHA1 */
     std::function<unsigned int(unsigned int)> prng;
+    Family prng_family;
+};
+
+struct CommPolicy
+{
+    policy::Decision decision;
+    KernelSet kernels;
+};
+
+struct CommIdentity
+{
+    kdf::comm_id_t id;
+    unsigned long long nchildren;
+};
+
+/* HEAR_Op_declare_linear: an MPI_Op that sums the MPI_INT/MPI_FLOAT fields of its elements */
+struct LinearOp
+{
+    MPI_Datatype datatype;
+    MPI_Aint extent;
+    std::vector<MPI_Datatype> field_types;
+    std::vector<MPI_Aint> field_displs;
+};
+
+/*
+ * The per-communicator state lives in vectors of slots, indexed through a
+ * map from the handle. A freed communicator's slots go on a free list, so
+ * the vectors grow with the number of live communicators, not with the
+ * number ever created.
+ */
+template <typename T>
+static std::size_t acquire_slot(std::vector<T> &storage, std::vector<std::size_t> &free_slots, T value)
+{
+    std::size_t index;
+
+    if (free_slots.empty()) {
+	storage.push_back(std::move(value));
+	return storage.size() - 1;
+    }
+
+    index = free_slots.back();
+    free_slots.pop_back();
+    storage[index] = std::move(value);
+    return index;
+}
+
+struct HearState
+{
+
+private:
+
+    std::vector<std::vector<unsigned int>> _k_s_storage;
+    std::vector<std::size_t> _k_s_free;
+    std::unordered_map<MPI_Comm, std::size_t> _k_s_map;
+
+    std::vector<unsigned int> _k_n_storage;
+    std::vector<std::size_t> _k_n_free;
+    std::unordered_map<MPI_Comm, std::size_t> _k_n_map;
+
+    /* HEAR_LOCAL_KEYS: k_s and k_n derived from a job secret, see kdf.hpp */
+    bool _local_keys;
+    kdf::KeyDerivation _kdf;
+    std::vector<CommIdentity> _comm_id_storage;
+    std::vector<std::size_t> _comm_id_free;
+    std::unordered_map<MPI_Comm, std::size_t> _comm_id_map;
+
+    /* defaults, HEAR_ENABLE_* */
+    KernelSet _kernels;
+
+    /* this rank's Capability bits, and whether all ranks of MPI_COMM_WORLD have the same ones and defaults */
+    unsigned int _caps;
+    bool _uniform_kernels;
+
+    policy::Engine _policy;
+    std::vector<CommPolicy> _comm_policy_storage;
+    std::vector<std::size_t> _comm_policy_free;
+    std::unordered_map<MPI_Comm, std::size_t> _comm_policy_map;
+
+    std::vector<LinearOp> _linear_op_storage;
+    std::unordered_map<MPI_Op, std::size_t> _linear_op_map;
+
+    bool select_int_sum_kernel(KernelSet &kernels, const std::string &name);
+    bool select_float_sum_kernel(KernelSet &kernels, const std::string &name);
+    void select_prng(KernelSet &kernels, Family family);
+    int negotiate_kernels(MPI_Comm comm, KernelSet &kernels);
+    int apply_policy(MPI_Comm comm);
+
+    bool _node_keystream;
+    std::vector<std::unique_ptr<keystream::NodeKeystream>> _node_ks_storage;
+    std::vector<std::size_t> _node_ks_free;
+    std::unordered_map<MPI_Comm, std::size_t> _node_ks_map;
+    /* slots in the order their windows were created, which slot reuse does not keep */
+    std::vector<std::size_t> _node_ks_order;
+
+    const unsigned int* shared_noise(MPI_Comm comm, unsigned int ctr, int count);
+
+    std::unique_ptr<lazy::Decryptor> _lazy;
+
+    /* HEAR_PLUGIN, see hear_plugin.hpp */
+    std::unique_ptr<plugin::Backend> _plugin;
+    /* the defaults the backend took over, back where it fails to initialise */
+    std::string _builtin_int_sum;
+    std::string _builtin_float_sum;
+    void load_plugin(const char *path);
+    int init_plugin();
+    Family int_sum_family(const KernelSet &kernels) const;
+    Family float_sum_family(const KernelSet &kernels) const;
+
+    /* HEAR_CRYPTO_THREADS, see pool.hpp */
+    std::unique_ptr<pool::Pool> _pool;
+    void crypto_for(int count, int dtype_size, const std::function<void(int, int)> &fn);
+
+    /* HEAR_Iallreduce */
+    sched::Scheduler _scheduler;
+
+    /* MPI_Alltoall(v), set up by the first one on the communicator */
+    std::vector<std::unique_ptr<alltoall::Exchange>> _exchange_storage;
+    std::vector<std::size_t> _exchange_free;
+    std::unordered_map<MPI_Comm, std::size_t> _exchange_map;
+
+    /* control-plane cost, see HEAR_Get_comm_profile */
+    HEAR_Comm_profile _comm_profile;
+
+    /* HEAR_IO_KEY: files opened with MPI_File_open are encrypted, see io.hpp */
+    std::unique_ptr<io::Cipher> _io;
+    std::unordered_map<MPI_File, io::File> _file_map;
+
+#ifdef USE_JIT
+    std::unique_ptr<jit::Kernels> _jit_kernels;
+    bool _jit_failed;
+#endif
 
 #ifdef USE_MPOOL
     mpool::SbufMpool _sbuf_mpool;
@@ -73,13 +328,57 @@ public:
     ~HearState();
 
     void release_memory(void *buf);
-    int insert_new_comm(MPI_Comm comm);
+    /* len bytes, 64-byte aligned, from the pool where they fit in its buffers */
+    void* acquire_memory(std::size_t len);
+    void release_memory(void *buf, std::size_t len);
+    int insert_new_comm(MPI_Comm comm, MPI_Comm parent = MPI_COMM_NULL);
+    void remove_comm(MPI_Comm comm);
+    /* held for the live communicators, approximately */
+    std::size_t comm_bytes() const;
+    HEAR_Comm_profile comm_profile() const { return _comm_profile; }
+    const policy::Decision& decision(MPI_Comm comm);
+    /* the default for communicators created from now on */
+    bool set_int_sum_kernel(const std::string &name) { return select_int_sum_kernel(_kernels, name); }
+    /* collective over comm, by the slowest rank */
+    std::string fastest_int_sum_kernel(MPI_Comm comm);
     void update_k_n(MPI_Comm comm);
-    void* encrypt_sendbuf(const void *sendbuf, void *recvbuf, int count,
+    unsigned int k_n(MPI_Comm comm) { return _k_n_storage[_k_n_map[comm]]; }
+    void declare_linear_op(MPI_Op op, const LinearOp &linear);
+    const LinearOp* linear_op(MPI_Op op, MPI_Datatype datatype);
+    void* encrypt_sendbuf(const void *sendbuf, int count,
                           MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+    /* the block at element offset of a buffer encrypted under k_n, see encrypt_region */
+    void* encrypt_sendbuf(const void *sendbuf, int offset, int count, MPI_Datatype datatype,
+                          MPI_Op op, MPI_Comm comm, unsigned int k_n, bool node_shared);
     int decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype datatype,
                         MPI_Op op, MPI_Comm comm);
 
+    /* encrypt-on-produce staging, regions en-/decrypted under a k_n of their own */
+    unsigned int stage_k_n(MPI_Comm comm);
+    unsigned int next_stage_k_n(MPI_Comm comm, unsigned int k_n)
+    {
+        return _comm_policy_storage[_comm_policy_map[comm]].kernels.prng(k_n);
+    }
+    int encrypt_region(void *dst, const void *src, int offset, int count, MPI_Datatype datatype,
+                       MPI_Op op, MPI_Comm comm, unsigned int k_n, bool node_shared);
+    int decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype datatype,
+                        MPI_Op op, MPI_Comm comm, unsigned int k_n, bool node_shared);
+
+    bool lazy_decrypt(std::size_t nbytes) const { return _lazy && nbytes >= lazy_decrypt_min_bytes; }
+    void lazy_wait(const void *buf, std::size_t len) { if (_lazy) _lazy->wait(buf, len); }
+    int decrypt_lazily(void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+
+    int insert_new_file(MPI_File fh, MPI_Comm comm, const char *filename);
+    void remove_file(MPI_File fh);
+    /* nullptr if fh is not encrypted */
+    io::File* file(MPI_File fh);
+    const io::Cipher& io_cipher() const { return *_io; }
+
+    sched::Scheduler& scheduler() { return _scheduler; }
+
+    /* collective over comm the first time */
+    int exchange(MPI_Comm comm, alltoall::Exchange **exchange);
+
 #ifdef TSC_PROF
     std::vector<myInt64> tsc_comm;
     std::vector<myInt64> tsc_mmalloc;
@@ -87,9 +386,117 @@ public:
     std::vector<myInt64> tsc_encrypt;
     std::vector<myInt64> tsc_decrypt;
 #endif
+
+#ifdef CALLSITE_PROF
+    callsite::Profiler callsites;
+#endif
 };
 
-class HearState *hear;
+/* with HEAR_SIMMPI, one per simulated rank, see RANK_LOCAL */
+RANK_LOCAL class HearState *hear;
+
+/* of the aesni128 prng and keystream */
+static const unsigned char prng_key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+					   0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+
+/* what the CPU has, this build may lack the kernels for some of it */
+static unsigned int cpu_caps()
+{
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int caps = 0;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+	caps |= CAP_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+	caps |= CAP_AVX2;
+    if (__builtin_cpu_supports("vaes"))
+	caps |= CAP_VAES;
+    if (__builtin_cpu_supports("avx512f"))
+	caps |= CAP_AVX512;
+    if (__builtin_cpu_supports("aes"))
+	caps |= CAP_AES;
+    /* not known to __builtin_cpu_supports() everywhere */
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29)))
+	caps |= CAP_SHA;
+
+    return caps;
+}
+
+/* what a rank needs for at least one kernel of the family */
+static unsigned int family_caps(Family family)
+{
+    static const unsigned int caps[NFAMILIES] = {CAP_AES, CAP_AES, 0, CAP_SSE2, CAP_AVX2, CAP_PLUGIN};
+
+    return caps[family];
+}
+
+template <std::size_t N>
+static bool builtin_kernel(const KernelInfo (&table)[N], const std::string &name)
+{
+    for (const auto &kernel : table) {
+	if (name == kernel.name)
+	    return true;
+    }
+    return false;
+}
+
+template <std::size_t N>
+static Family kernel_family(const KernelInfo (&table)[N], const std::string &name)
+{
+    for (const auto &kernel : table) {
+	if (name == kernel.name)
+	    return kernel.family;
+    }
+    return FAMILY_SHA1;
+}
+
+/* the requested family if all ranks can run it, else the fastest one that all ranks can run */
+static Family common_family(Family requested, unsigned int common_caps)
+{
+    if (!(family_caps(requested) & ~common_caps))
+	return requested;
+    if (!(family_caps(FAMILY_AES) & ~common_caps))
+	return FAMILY_AES;
+    return FAMILY_SHA1;
+}
+
+static const char* family_name(Family family)
+{
+    static const char *names[NFAMILIES] = {"aes", "aes_narrow", "sha1", "sha1_x4", "sha1_x8", "plugin"};
+
+    return names[family];
+}
+
+/*
+ * Where this rank's crypto workers start in its CPU list. Ranks on a node
+ * that share CPUs, e.g., unbound ones that all have the node's mask, start
+ * nthreads apart by node rank instead of all pinning to the first cores.
+ */
+static int crypto_first_cpu(int nthreads)
+{
+    std::vector<int> cpus = pool::allowed_cpus();
+    MPI_Comm node_comm;
+    int node_rank, local_max, max_cpu;
+    bool exclusive = true;
+
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    PMPI_Comm_rank(node_comm, &node_rank);
+    local_max = cpus.empty() ? 0 : cpus.back();
+    PMPI_Allreduce(&local_max, &max_cpu, 1, MPI_INT, MPI_MAX, node_comm);
+
+    /* how many ranks of the node may run on each CPU */
+    std::vector<int> mine(max_cpu + 1), ranks(max_cpu + 1);
+    for (int cpu : cpus)
+	mine[cpu] = 1;
+    PMPI_Allreduce(mine.data(), ranks.data(), max_cpu + 1, MPI_INT, MPI_SUM, node_comm);
+    PMPI_Comm_free(&node_comm);
+
+    for (int cpu : cpus)
+	exclusive = exclusive && ranks[cpu] == 1;
+
+    return exclusive ? 0 : node_rank * nthreads;
+}
 
 
 HearState::HearState(
@@ -98,30 +505,87 @@ HearState::HearState(
 		     std::size_t mpool_sbuf_len
 #endif
 		     )
+    : _scheduler(sched_channels)
 #ifdef USE_MPOOL
-    : _sbuf_mpool(mpool_size, mpool_sbuf_len)
+    , _sbuf_mpool(mpool_size, mpool_sbuf_len)
 #endif
 {
-    this->encrypt_block_int_sum = encryption::encrypt_int_sum_naive;
-    this->decrypt_block_int_sum = encryption::decrypt_int_sum_naive;
-    this->encrypt_block_float_sum = encryption::encrypt_float_sum_naive;
-    this->decrypt_block_float_sum = encryption::decrypt_float_sum_naive;
-    this->encrypt_block_int_prod = encryption::encrypt_int_prod_naive;
-    this->decrypt_block_int_prod = encryption::decrypt_int_prod_naive;
-    this->prng = encryption::prng_uint;
+    std::string int_sum_kernel = "naive";
+    std::string float_sum_kernel = "naive";
+
+    this->_kernels.encrypt_int_prod = encryption::encrypt_int_prod_naive;
+    this->_kernels.decrypt_int_prod = encryption::decrypt_int_prod_naive;
+    select_prng(this->_kernels, FAMILY_SHA1);
+    this->_caps = cpu_caps();
+#ifndef AESNI
+    this->_caps &= ~CAP_AES;
+#endif
+    this->_uniform_kernels = true;
+
+    this->_node_keystream = false;
+    this->_comm_profile = HEAR_Comm_profile();
+    this->_local_keys = std::getenv("HEAR_LOCAL_KEYS") != nullptr;
+#ifdef USE_JIT
+    this->_jit_failed = false;
+#endif
 
 #ifdef AESNI
     if (const char* env = std::getenv("HEAR_ENABLE_AESNI")) {
-        this->encrypt_block_int_sum = encryption::encrypt_int_sum_aesni128;
-	this->decrypt_block_int_sum = encryption::decrypt_int_sum_aesni128;
-	this->encrypt_block_float_sum = encryption::encrypt_float_sum_aesni128_unroll;
-	this->decrypt_block_float_sum = encryption::decrypt_float_sum_aesni128_unroll;
-	this->prng = encryption::aesni128_prng;
+	int_sum_kernel = "aesni";
+	float_sum_kernel = "aesni_unroll";
+	select_prng(this->_kernels, FAMILY_AES);
+	/* the shared stream replicates the aesni128 counter layout */
+	this->_node_keystream = std::getenv("HEAR_NODE_KEYSTREAM") != nullptr;
+
+	/* 16 noise bits per float, trading precision and security for keystream */
+	if (std::getenv("HEAR_FLOAT_NARROW_NOISE"))
+	    float_sum_kernel = "aesni_narrow";
+
+#ifdef USE_JIT
+	if (std::getenv("HEAR_ENABLE_JIT"))
+	    int_sum_kernel = "jit";
+#endif
     }
 #endif
 
-#ifdef TSC_PROF
+    if (!select_int_sum_kernel(this->_kernels, int_sum_kernel))
+	select_int_sum_kernel(this->_kernels, "aesni");
+    select_float_sum_kernel(this->_kernels, float_sum_kernel);
+
+    if (const char* env = std::getenv("HEAR_PLUGIN"))
+	load_plugin(env);
+
+    this->_policy.load_env(std::cerr);
+
+#ifndef HEAR_SIMMPI
+    /* one fault thread per process, not per simulated rank */
+    if (std::getenv("HEAR_LAZY_DECRYPT")) {
+	this->_lazy.reset(new lazy::Decryptor());
+	if (!this->_lazy->usable()) {
+	    std::cerr << "HEAR_LAZY_DECRYPT: userfaultfd is not available, results are decrypted eagerly" << std::endl;
+	    this->_lazy.reset();
+	}
+    }
+#endif
+
+    if (crypto_threads > 0)
+	this->_pool.reset(new pool::Pool(crypto_threads, crypto_first_cpu(crypto_threads)));
+
+    if (const char* env = std::getenv("HEAR_IO_KEY")) {
+	io::cipher_key_t key;
+
+	if (io::Cipher::parse_key(env, key))
+	    this->_io.reset(new io::Cipher(key, io_threads, io_chunk_bytes));
+	else
+	    std::cerr << "HEAR_IO_KEY: expected " << 2 * IO_KEY_LEN
+		      << " hex digits, MPI-IO is not encrypted" << std::endl;
+    }
+
+#if defined(TSC_PROF) || defined(CALLSITE_PROF)
+    /* the calibration takes 10 ms, not in the first measurement or profiler window */
     init_tsc();
+#endif
+#ifdef TSC_PROF
     tsc_comm.reserve(TSC_NUM_MEASUREMENTS);
     tsc_mmalloc.reserve(TSC_NUM_MEASUREMENTS);
     tsc_mfree.reserve(TSC_NUM_MEASUREMENTS);
@@ -145,10 +609,25 @@ static myInt64 get_tsc_avg(std::vector<myInt64> &measurements, int comm_size)
 
     return sum / (measurements.size() - TSC_WARMUP_CUTOFF);
 }
+
+/* in cycles, as before, and in nanoseconds */
+static void print_tsc_avg(const char *name, std::vector<myInt64> &measurements, int comm_size)
+{
+    myInt64 avg = get_tsc_avg(measurements, comm_size);
+
+    std::cout << name << "=" << avg << std::endl;
+    std::cout << name << "_ns=" << tsc_to_ns(avg) << std::endl;
+}
 #endif
 
 HearState::~HearState()
 {
+    /* windows are freed collectively, in the reverse of the creation order on every rank */
+    while (!_node_ks_order.empty()) {
+	_node_ks_storage[_node_ks_order.back()].reset();
+	_node_ks_order.pop_back();
+    }
+
 #ifdef TSC_PROF
     int my_rank, comm_size;
 
@@ -157,7 +636,11 @@ HearState::~HearState()
 
     PMPI_Allreduce(MPI_IN_PLACE, tsc_comm.data(), tsc_comm.size(), MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
     if (my_rank == 0) {
-	std::cout << "comm=" << get_tsc_avg(tsc_comm, comm_size) << std::endl;
+	const tsc_calibration_t &cal = tsc_calibration();
+
+	std::cout << "tsc_overhead=" << cal.overhead << " tsc_ghz=" << 1 / cal.ns_per_cycle
+		  << " tsc_invariant=" << cal.invariant << std::endl;
+	print_tsc_avg("comm", tsc_comm, comm_size);
     }
 #ifndef ALLREDUCE_BASELINE
     PMPI_Allreduce(MPI_IN_PLACE, tsc_mmalloc.data(), tsc_mmalloc.size(), MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
@@ -165,159 +648,920 @@ HearState::~HearState()
     PMPI_Allreduce(MPI_IN_PLACE, tsc_encrypt.data(), tsc_encrypt.size(), MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
     PMPI_Allreduce(MPI_IN_PLACE, tsc_decrypt.data(), tsc_decrypt.size(), MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
     if (my_rank == 0) {
-	std::cout << "mmalloc=" << get_tsc_avg(tsc_mmalloc, comm_size) << std::endl;
-	std::cout << "mfree=" << get_tsc_avg(tsc_mfree, comm_size) << std::endl;
-	std::cout << "encrypt=" << get_tsc_avg(tsc_encrypt, comm_size) << std::endl;
-	std::cout << "decrypt=" << get_tsc_avg(tsc_decrypt, comm_size) << std::endl;
+	print_tsc_avg("mmalloc", tsc_mmalloc, comm_size);
+	print_tsc_avg("mfree", tsc_mfree, comm_size);
+	print_tsc_avg("encrypt", tsc_encrypt, comm_size);
+	print_tsc_avg("decrypt", tsc_decrypt, comm_size);
     }
 #endif
 
 #endif
+
+#ifdef CALLSITE_PROF
+    int rank;
+    std::size_t max_entries = CALLSITE_REPORT_ENTRIES;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (const char* env = std::getenv("HEAR_CALLSITE_ENTRIES"))
+	max_entries = std::atoi(env);
+
+    if (const char* env = std::getenv("HEAR_CALLSITE_LOG")) {
+	std::ofstream log(std::string(env) + "." + std::to_string(rank) + ".log");
+	callsites.report(log, rank, max_entries);
+    } else if (rank == 0) {
+	callsites.report(std::cout, rank, max_entries);
+    }
+#endif
 }
 
 inline void HearState::update_k_n(MPI_Comm comm)
 {
-    unsigned int tmp = this->prng(_k_n_storage[_k_n_map[comm]]);
+    unsigned int tmp = _comm_policy_storage[_comm_policy_map[comm]].kernels.prng(_k_n_storage[_k_n_map[comm]]);
     _k_n_storage[_k_n_map[comm]] = tmp;
 }
 
-inline int HearState::insert_new_comm(MPI_Comm comm)
+/*
+ * First k_n of a staging buffer, steps comm's k_n like an Allreduce does and
+ * then branches off, so that later rounds of the buffer do not replay the
+ * counters of comm's next reductions.
+ */
+inline unsigned int HearState::stage_k_n(MPI_Comm comm)
 {
-    int comm_size;
-    int my_rank;
-    int ret;
-    bool ok;
-
-    MPI_Comm_size(comm, &comm_size);
-    MPI_Comm_rank(comm, &my_rank);
+    update_k_n(comm);
+    return next_stage_k_n(comm, ~_k_n_storage[_k_n_map[comm]]);
+}
 
-    _k_s_storage.push_back(std::vector<unsigned int>(comm_size, my_rank));
-    _k_s_storage.back()[my_rank] = static_cast<unsigned int>(encryption::encr_noise_generator());
-    ok = _k_s_map.insert({comm, _k_s_storage.size() - 1}).second;
-    assert(ok);
-    ret = PMPI_Allgather(MPI_IN_PLACE, 1, MPI_UNSIGNED, _k_s_storage[_k_s_map[comm]].data(), 1, MPI_UNSIGNED, comm);
-    if (ret != MPI_SUCCESS)
-        return ret;
+/*
+ * Returns the node-shared keystream starting at ctr, or nullptr when the
+ * caller should generate the noise itself. The decision depends only on
+ * values that agree across the ranks of comm, so they take the same branch.
+ */
+const unsigned int* HearState::shared_noise(MPI_Comm comm, unsigned int ctr, int count)
+{
+#ifdef AESNI
+    MPI_Comm node_comm;
+    int node_size;
+
+    if (!_node_keystream || static_cast<std::size_t>(count) < node_keystream_min_count ||
+	static_cast<std::size_t>(count) > node_keystream_max_count)
+	return nullptr;
+
+    auto it = _node_ks_map.find(comm);
+    if (it == _node_ks_map.end()) {
+	std::unique_ptr<keystream::NodeKeystream> node_ks;
+	std::size_t index;
+
+	PMPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	MPI_Comm_size(node_comm, &node_size);
+	if (node_size > 1)
+	    node_ks.reset(new keystream::NodeKeystream(node_comm, node_keystream_max_count));
+	else
+	    PMPI_Comm_free(&node_comm);
+
+	index = acquire_slot(_node_ks_storage, _node_ks_free, std::move(node_ks));
+	if (_node_ks_storage[index])
+	    _node_ks_order.push_back(index);
+	it = _node_ks_map.insert({comm, index}).first;
+    }
 
-    assert(ret == MPI_SUCCESS);
+    if (!_node_ks_storage[it->second])
+	return nullptr;
 
-    _k_n_storage.push_back(my_rank == root_rank ?
-				 static_cast<unsigned int>(encryption::encr_noise_generator()) : 42);
-    ok = _k_n_map.insert({comm, _k_n_storage.size() - 1}).second;
-    assert(ok);
+    return _node_ks_storage[it->second]->get(ctr, count, encryption::aesni128_keystream);
+#else
+    return nullptr;
+#endif
+}
 
-    ret = PMPI_Bcast(&_k_n_storage[_k_n_map[comm]], 1, MPI_UNSIGNED, root_rank, comm);
-    if (ret != MPI_SUCCESS)
-        return ret;
+bool HearState::select_int_sum_kernel(KernelSet &kernels, const std::string &name)
+{
+    kernels.int_sum_aes_layout = false;
+    kernels.int_sum_block = 4;
+
+    if (name == "naive") {
+	kernels.encrypt_int_sum = encryption::encrypt_int_sum_naive;
+	kernels.decrypt_int_sum = encryption::decrypt_int_sum_naive;
+	kernels.int_sum_block = 1;
+    } else if (name == "sha1sse2") {
+	kernels.encrypt_int_sum = encryption::encrypt_int_sum_sha1sse2;
+	kernels.decrypt_int_sum = encryption::decrypt_int_sum_sha1sse2;
+    } else if (name == "sha1avx2") {
+	kernels.encrypt_int_sum = encryption::encrypt_int_sum_sha1avx2;
+	kernels.decrypt_int_sum = encryption::decrypt_int_sum_sha1avx2;
+	kernels.int_sum_block = 8;
+#ifdef AESNI
+    } else if (name == "aesni") {
+	kernels.encrypt_int_sum = encryption::encrypt_int_sum_aesni128;
+	kernels.decrypt_int_sum = encryption::decrypt_int_sum_aesni128;
+	kernels.int_sum_aes_layout = true;
+    } else if (name == "aesni_unroll") {
+	kernels.encrypt_int_sum = encryption::encrypt_int_sum_aesni128_unroll;
+	kernels.decrypt_int_sum = encryption::decrypt_int_sum_aesni128_unroll;
+	kernels.int_sum_aes_layout = true;
+#endif
+#ifdef USE_JIT
+    } else if (name == "jit") {
+	if (!_jit_kernels && !_jit_failed) {
+	    _jit_kernels.reset(new jit::Kernels(jit_block_size, jit_unroll));
+	    if (!_jit_kernels->valid()) {
+		std::cerr << "HEAR jit: falling back to the aesni128 kernels" << std::endl;
+		_jit_kernels.reset();
+		_jit_failed = true;
+	    }
+	}
+	if (!_jit_kernels)
+	    return false;
+
+	jit::Kernels *jit_kernels = _jit_kernels.get();
+	kernels.encrypt_int_sum = [jit_kernels](unsigned int *encr_sbuf, const unsigned int *sbuf, int count,
+						int rank, std::vector<unsigned int> &k_s, unsigned int k_n,
+						bool is_edge) {
+	    jit_kernels->encrypt_int_sum(encr_sbuf, sbuf, count, rank, k_s, k_n, is_edge);
+	};
+	kernels.decrypt_int_sum = [jit_kernels](unsigned int *rbuf, int count,
+						std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    jit_kernels->decrypt_int_sum(rbuf, count, k_s, k_n);
+	};
+	kernels.int_sum_aes_layout = true;
+#endif
+    } else if (_plugin && name == _plugin->name() && _plugin->has_int_sum()) {
+	plugin::Backend *backend = _plugin.get();
+
+	/* all that hear_plugin.hpp promises */
+	kernels.int_sum_block = HEAR_STAGE_GRANULE;
+
+	kernels.encrypt_int_sum = [backend](unsigned int *encr_sbuf, const unsigned int *sbuf, int count,
+					    int rank, std::vector<unsigned int> &k_s, unsigned int k_n,
+					    bool is_edge) {
+	    backend->encrypt_int_sum(encr_sbuf, sbuf, count, rank, k_s, k_n, is_edge);
+	};
+	kernels.decrypt_int_sum = [backend](unsigned int *rbuf, int count,
+					    std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    backend->decrypt_int_sum(rbuf, count, k_s, k_n);
+	};
+    } else {
+	return false;
+    }
 
-    assert(ret == MPI_SUCCESS);
+    /* the products go with the sums, the backend's if it has them */
+    if (_plugin && name == _plugin->name() && _plugin->has_int_prod()) {
+	plugin::Backend *backend = _plugin.get();
+
+	kernels.encrypt_int_prod = [backend](unsigned int *encr_sbuf, const unsigned int *sbuf, int count,
+					     int rank, std::vector<unsigned int> &k_s, unsigned int k_n,
+					     bool is_edge) {
+	    backend->encrypt_int_prod(encr_sbuf, sbuf, count, rank, k_s, k_n, is_edge);
+	};
+	kernels.decrypt_int_prod = [backend](unsigned int *rbuf, int count,
+					     std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    backend->decrypt_int_prod(rbuf, count, k_s, k_n);
+	};
+    } else {
+	kernels.encrypt_int_prod = encryption::encrypt_int_prod_naive;
+	kernels.decrypt_int_prod = encryption::decrypt_int_prod_naive;
+    }
 
-    return MPI_SUCCESS;
+    kernels.int_sum_name = name;
+    return true;
 }
 
-inline void* HearState::encrypt_sendbuf(const void *sendbuf, void *recvbuf, int count,
-                                        MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+bool HearState::select_float_sum_kernel(KernelSet &kernels, const std::string &name)
 {
-    void *encr_sbuf = nullptr;
-    int type_size;
-    int sbuf_len;
-    int comm_size;
-    int my_rank;
-
-    MPI_Comm_size(comm, &comm_size);
-    MPI_Comm_rank(comm, &my_rank);
-    MPI_Type_size(datatype, &type_size);
-    sbuf_len = count * type_size;
+    kernels.float_sum_aes_layout = false;
+    kernels.float_sum_block = 4;
 
-#ifdef TSC_PROF
-    myInt64 t_mmalloc = start_tsc();
+    if (name == "naive") {
+	kernels.encrypt_float_sum = encryption::encrypt_float_sum_naive;
+	kernels.decrypt_float_sum = encryption::decrypt_float_sum_naive;
+	kernels.float_sum_block = 1;
+#ifdef AESNI
+    } else if (name == "aesni_unroll") {
+	kernels.encrypt_float_sum = encryption::encrypt_float_sum_aesni128_unroll;
+	kernels.decrypt_float_sum = encryption::decrypt_float_sum_aesni128_unroll;
+	kernels.float_sum_aes_layout = true;
+    } else if (name == "aesni_narrow") {
+	/* the shared stream holds full-width noise only */
+	kernels.encrypt_float_sum = encryption::encrypt_float_sum_aesni128_narrow;
+	kernels.decrypt_float_sum = encryption::decrypt_float_sum_aesni128_narrow;
+	kernels.float_sum_block = 8;
 #endif
+    } else if (_plugin && name == _plugin->name() && _plugin->has_float_sum()) {
+	plugin::Backend *backend = _plugin.get();
+
+	kernels.float_sum_block = HEAR_STAGE_GRANULE;
+
+	kernels.encrypt_float_sum = [backend](float *encr_sbuf, const float *sbuf, int count, int rank,
+					      std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    backend->encrypt_float_sum(encr_sbuf, sbuf, count, rank, k_s, k_n);
+	};
+	kernels.decrypt_float_sum = [backend](float *rbuf, int count, std::vector<unsigned int> &k_s,
+					      unsigned int k_n) {
+	    backend->decrypt_float_sum(rbuf, count, k_s, k_n);
+	};
+    } else {
+	return false;
+    }
 
-#ifndef USE_MPOOL
-    encr_sbuf = new char[sbuf_len];
-#else
-    encr_sbuf = _sbuf_mpool.acquire_buf();
-#endif
-    if (encr_sbuf == nullptr)
-        return nullptr;
+    kernels.float_sum_name = name;
+    return true;
+}
 
-#ifdef TSC_PROF
-    hear->tsc_mmalloc.push_back(stop_tsc(t_mmalloc));
+void HearState::select_prng(KernelSet &kernels, Family family)
+{
+    kernels.prng = encryption::prng_uint;
+    kernels.prng_family = FAMILY_SHA1;
+#ifdef AESNI
+    if (family == FAMILY_AES) {
+	kernels.prng = encryption::aesni128_prng;
+	kernels.prng_family = FAMILY_AES;
+    }
 #endif
+}
 
-#ifdef TSC_PROF
-    myInt64 t_encrypt = start_tsc();
-#endif
+void HearState::load_plugin(const char *path)
+{
+    _plugin = plugin::Backend::load(path, cpu_caps(), std::cerr);
+    if (!_plugin)
+	return;
+
+    if (builtin_kernel(int_sum_kernels, _plugin->name()) || builtin_kernel(float_sum_kernels, _plugin->name())) {
+	std::cerr << "HEAR plugin: " << _plugin->name() << " is a built-in kernel" << std::endl;
+	_plugin.reset();
+	return;
+    }
+    _caps |= CAP_PLUGIN;
 
-    /* 3ncrypt10n */
-    if (op == MPI_SUM) {
-	if (datatype == MPI_INT) {
-	    this->encrypt_block_int_sum(reinterpret_cast<unsigned int *>(encr_sbuf),
-					reinterpret_cast<const unsigned int *>(sendbuf), count, my_rank,
-					_k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]],
-					my_rank == (comm_size - 1) ? 1 : 0);
+    /* the default for what it has kernels for */
+    _builtin_int_sum = _kernels.int_sum_name;
+    _builtin_float_sum = _kernels.float_sum_name;
+    select_int_sum_kernel(_kernels, _plugin->name());
+    select_float_sum_kernel(_kernels, _plugin->name());
+}
 
-	} else if (datatype == MPI_FLOAT) {
-	    this->encrypt_block_float_sum(reinterpret_cast<float *>(encr_sbuf),
-					  reinterpret_cast<const float *>(sendbuf), count, my_rank,
-					  _k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]]);
-	} else {
-	    std::cerr << "Encryption for this MPI datatype is not supported!" << std::endl;
-	    goto fail_cleanup;
-	}
-    } else if (op == MPI_PROD) {
-	if (datatype == MPI_INT) {
-	    this->encrypt_block_int_prod(reinterpret_cast<unsigned int *>(encr_sbuf),
-					 reinterpret_cast<const unsigned int *>(sendbuf), count, my_rank,
-					 _k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]],
-					 my_rank == (comm_size - 1) ? 1 : 0);
-	} else {
-	    std::cerr << "Encryption for this MPI datatype is not supported!" << std::endl;
-	    goto fail_cleanup;
-	}
+/*
+ * The backend's key, see hear_plugin.hpp, before any kernel runs. Collective
+ * over MPI_COMM_WORLD without HEAR_LOCAL_KEYS, on the ranks without a
+ * backend too.
+ */
+int HearState::init_plugin()
+{
+    kdf::plugin_key_t key = {};
+    int my_rank;
+    int ret;
+
+    static_assert(KDF_PLUGIN_KEY_LEN == HEAR_PLUGIN_KEY_LEN && KDF_PLUGIN_KEY_LEN == KDF_SECRET_LEN,
+		  "the plugin key is a secret_t or derived from one");
+
+    if (_local_keys) {
+	key = _kdf.plugin_key();
     } else {
-	std::cerr << "Encryption for this MPI op is not supported!" << std::endl;
-	goto fail_cleanup;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	if (my_rank == root_rank)
+	    key = kdf::KeyDerivation::random_secret();
+	ret = PMPI_Bcast(key.data(), key.size(), MPI_BYTE, root_rank, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+	    return ret;
     }
 
-#ifdef TSC_PROF
-    hear->tsc_encrypt.push_back(stop_tsc(t_encrypt));
-#endif
+    if (!_plugin || _plugin->init(key.data(), key.size(), std::cerr))
+	return MPI_SUCCESS;
 
-    return encr_sbuf;
+    /* the communicators agree on a built-in family with the ranks that have the backend */
+    if (_kernels.int_sum_name == _plugin->name())
+	select_int_sum_kernel(_kernels, _builtin_int_sum);
+    if (_kernels.float_sum_name == _plugin->name())
+	select_float_sum_kernel(_kernels, _builtin_float_sum);
+    _caps &= ~CAP_PLUGIN;
+    _plugin.reset();
 
-fail_cleanup:
-#ifndef USE_MPOOL
-    delete[] reinterpret_cast<char *>(encr_sbuf);
-#else
-    _sbuf_mpool.release_buf(encr_sbuf);
-#endif
-    return nullptr;
+    return MPI_SUCCESS;
 }
 
-inline int HearState::decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype datatype,
-                                      MPI_Op op, MPI_Comm comm)
+Family HearState::int_sum_family(const KernelSet &kernels) const
 {
-#ifdef TSC_PROF
-    myInt64 t_decrypt = start_tsc();
-#endif
+    if (_plugin && kernels.int_sum_name == _plugin->name())
+	return FAMILY_PLUGIN;
+    return kernel_family(int_sum_kernels, kernels.int_sum_name);
+}
 
-    /* d3crypt10n */
-    if (op == MPI_SUM) {
-	if (datatype == MPI_INT) {
-	    this->decrypt_block_int_sum(reinterpret_cast<unsigned int *>(recvbuf), count,
-					_k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]]);
-	} else if (datatype == MPI_FLOAT) {
-	    this->decrypt_block_float_sum(reinterpret_cast<float *>(recvbuf), count,
-					  _k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]]);
-	} else {
-	    std::cerr << "Decryption for this MPI datatype is not supported!" << std::endl;
-	    return MPI_ERR_TYPE;
+Family HearState::float_sum_family(const KernelSet &kernels) const
+{
+    if (_plugin && kernels.float_sum_name == _plugin->name())
+	return FAMILY_PLUGIN;
+    return kernel_family(float_sum_kernels, kernels.float_sum_name);
+}
+
+/*
+ * The ranks of comm agree on the kernel families, which a mismatch of
+ * HEAR_ENABLE_AESNI or of the CPUs would otherwise break silently: they
+ * exchange their Capability bits and take the families of rank 0 where
+ * every rank can run them, the fastest ones that every rank can run
+ * otherwise. Each rank then keeps its own kernel if it is of the family, or
+ * runs its best one of the family. The HEAR_PLUGIN backend counts as a
+ * capability only where every rank has loaded the same one, by its
+ * plugin::Backend::id(). On MPI_COMM_WORLD the ranks also find out whether
+ * they all have the same capabilities, defaults and backend, in which case
+ * the same rules select the same kernels everywhere and the other
+ * communicators skip the exchange.
+ */
+int HearState::negotiate_kernels(MPI_Comm comm, KernelSet &kernels)
+{
+    unsigned int local[4], agreed[4];
+    Family int_family, float_family, prng_family;
+    int my_rank;
+    int ret;
+
+    if (comm != MPI_COMM_WORLD && _uniform_kernels)
+	return MPI_SUCCESS;
+
+    local[0] = _caps;
+    local[1] = int_sum_family(kernels) | float_sum_family(kernels) << 8 | kernels.prng_family << 16 |
+	_node_keystream << 24;
+    local[2] = _plugin ? _plugin->id() : 0;
+    local[3] = ~local[2];
+
+    if (comm == MPI_COMM_WORLD) {
+	/* the bitwise and of the complements is the complement of the bitwise or */
+	unsigned int both[6] = {local[0], local[1], local[2], ~local[0], ~local[1], ~local[2]};
+	unsigned int all[6];
+
+	ret = PMPI_Allreduce(both, all, 6, MPI_UNSIGNED, MPI_BAND, comm);
+	if (ret != MPI_SUCCESS)
+	    return ret;
+	_uniform_kernels = all[0] == ~all[3] && all[1] == ~all[4] && all[2] == ~all[5];
+	if (_uniform_kernels)
+	    return MPI_SUCCESS;
+	/* all ranks of a node have to ask for the shared stream together */
+	_node_keystream = false;
+    }
+
+    /* rank 0's families */
+    MPI_Comm_rank(comm, &my_rank);
+    if (my_rank != root_rank)
+	local[1] = ~0u;
+    ret = PMPI_Allreduce(local, agreed, 4, MPI_UNSIGNED, MPI_BAND, comm);
+    if (ret != MPI_SUCCESS)
+	return ret;
+    /* not the same backend everywhere */
+    if (agreed[2] != ~agreed[3])
+	agreed[0] &= ~CAP_PLUGIN;
+
+    int_family = common_family(static_cast<Family>(agreed[1] & 0xff), agreed[0]);
+    float_family = common_family(static_cast<Family>((agreed[1] >> 8) & 0xff), agreed[0]);
+    prng_family = common_family(static_cast<Family>((agreed[1] >> 16) & 0xff), agreed[0]);
+
+    if (int_sum_family(kernels) != int_family) {
+	std::cerr << "HEAR: int_kernel " << kernels.int_sum_name << " replaced by the "
+		  << family_name(int_family) << " family of the communicator" << std::endl;
+	if (int_family == FAMILY_PLUGIN)
+	    select_int_sum_kernel(kernels, _plugin->name());
+	for (const auto &kernel : int_sum_kernels) {
+	    if (kernel.family == int_family && !(kernel.caps & ~_caps) && select_int_sum_kernel(kernels, kernel.name))
+		break;
+	}
+    }
+    if (float_sum_family(kernels) != float_family) {
+	std::cerr << "HEAR: float_kernel " << kernels.float_sum_name << " replaced by the "
+		  << family_name(float_family) << " family of the communicator" << std::endl;
+	if (float_family == FAMILY_PLUGIN)
+	    select_float_sum_kernel(kernels, _plugin->name());
+	for (const auto &kernel : float_sum_kernels) {
+	    if (kernel.family == float_family && !(kernel.caps & ~_caps) && select_float_sum_kernel(kernels, kernel.name))
+		break;
+	}
+    }
+    select_prng(kernels, prng_family);
+
+    return MPI_SUCCESS;
+}
+
+std::string HearState::fastest_int_sum_kernel(MPI_Comm comm)
+{
+    /* naive is left out, the aesni128 prng replaces it whenever AES-NI is there */
+    static const char *candidates[] = {"sha1sse2", "sha1avx2", "aesni", "aesni_unroll"};
+    const int ncandidates = sizeof(candidates) / sizeof(candidates[0]);
+    const int count = 1 << 20;
+    const int reps = 3;
+    /* the kernels use aligned loads and stores */
+    std::unique_ptr<unsigned int, decltype(&std::free)> buf(
+        static_cast<unsigned int *>(std::aligned_alloc(64, count * sizeof(unsigned int))), std::free);
+    std::unique_ptr<unsigned int, decltype(&std::free)> encr_buf(
+        static_cast<unsigned int *>(std::aligned_alloc(64, count * sizeof(unsigned int))), std::free);
+    std::vector<double> times(ncandidates), max_times(ncandidates);
+    int rank, comm_size;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+    /* not an edge rank, which also reads k_s[rank + 1] */
+    std::vector<unsigned int> k_s(comm_size + 1, 1);
+    std::fill(buf.get(), buf.get() + count, 1);
+
+    for (int c = 0; c < ncandidates; c++) {
+	KernelSet kernels;
+
+	times[c] = std::numeric_limits<double>::max();
+	if (!select_int_sum_kernel(kernels, candidates[c]))
+	    continue;
+
+	for (int rep = 0; rep < reps; rep++) {
+	    double start = MPI_Wtime();
+
+	    kernels.encrypt_int_sum(encr_buf.get(), buf.get(), count, rank, k_s, 1, false);
+	    kernels.decrypt_int_sum(encr_buf.get(), count, k_s, 1);
+	    times[c] = std::min(times[c], MPI_Wtime() - start);
+	}
+    }
+
+    PMPI_Allreduce(times.data(), max_times.data(), ncandidates, MPI_DOUBLE, MPI_MAX, comm);
+    return candidates[std::min_element(max_times.begin(), max_times.end()) - max_times.begin()];
+}
+
+/*
+ * Evaluates the policy for a new communicator. Rank 0 of comm decides, so
+ * that all ranks take the same (plaintext or encrypted) path even if their
+ * rules differ.
+ */
+int HearState::apply_policy(MPI_Comm comm)
+{
+    policy::Topology topology;
+    CommPolicy comm_policy;
+    KernelSet kernels;
+    MPI_Comm node_comm;
+    double start = MPI_Wtime();
+    int node_size;
+    int ret;
+    bool ok;
+
+    MPI_Comm_size(comm, &topology.comm_size);
+    topology.world = comm == MPI_COMM_WORLD;
+    topology.node_local = false;
+
+    if (!_policy.empty()) {
+	if (_policy.needs_topology()) {
+	    ret = PMPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	    if (ret != MPI_SUCCESS)
+		return ret;
+	    MPI_Comm_size(node_comm, &node_size);
+	    PMPI_Comm_free(&node_comm);
+	    topology.node_local = node_size == topology.comm_size;
+	}
+
+	comm_policy.decision = _policy.decide(topology);
+	ret = PMPI_Bcast(&comm_policy.decision, sizeof(comm_policy.decision), MPI_BYTE, root_rank, comm);
+	if (ret != MPI_SUCCESS)
+	    return ret;
+    }
+
+    /* a kernel that is unknown or unavailable in this build keeps the default */
+    comm_policy.kernels = _kernels;
+    kernels = _kernels;
+    if (comm_policy.decision.int_kernel[0]) {
+	if (select_int_sum_kernel(kernels, comm_policy.decision.int_kernel))
+	    comm_policy.kernels = kernels;
+	else
+	    std::cerr << "HEAR policy: int_kernel " << comm_policy.decision.int_kernel << " is not available" << std::endl;
+    }
+    kernels = comm_policy.kernels;
+    if (comm_policy.decision.float_kernel[0]) {
+	if (select_float_sum_kernel(kernels, comm_policy.decision.float_kernel))
+	    comm_policy.kernels = kernels;
+	else
+	    std::cerr << "HEAR policy: float_kernel " << comm_policy.decision.float_kernel << " is not available" << std::endl;
+    }
+
+    ret = negotiate_kernels(comm, comm_policy.kernels);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+#ifdef DEBUG
+    std::cerr << "HEAR policy: comm of size " << topology.comm_size
+	      << (topology.node_local ? ", node-local: " : ": ");
+    policy::describe(std::cerr, comm_policy.decision);
+    std::cerr << std::endl;
+#endif
+
+    ok = _comm_policy_map.insert({comm, acquire_slot(_comm_policy_storage, _comm_policy_free, comm_policy)}).second;
+    assert(ok);
+    _comm_profile.policy += MPI_Wtime() - start;
+
+    return MPI_SUCCESS;
+}
+
+inline const policy::Decision& HearState::decision(MPI_Comm comm)
+{
+    return _comm_policy_storage[_comm_policy_map[comm]].decision;
+}
+
+inline void HearState::declare_linear_op(MPI_Op op, const LinearOp &linear)
+{
+    auto it = _linear_op_map.find(op);
+
+    if (it != _linear_op_map.end()) {
+	_linear_op_storage[it->second] = linear;
+    } else {
+	_linear_op_storage.push_back(linear);
+	_linear_op_map.insert({op, _linear_op_storage.size() - 1});
+    }
+}
+
+/* nullptr unless op was declared linear over datatype */
+inline const LinearOp* HearState::linear_op(MPI_Op op, MPI_Datatype datatype)
+{
+    auto it = _linear_op_map.find(op);
+
+    if (it == _linear_op_map.end() || _linear_op_storage[it->second].datatype != datatype)
+	return nullptr;
+    return &_linear_op_storage[it->second];
+}
+
+/*
+ * Called on every rank of parent after a communicator creation call, comm is
+ * MPI_COMM_NULL on ranks that are not part of the new communicator.
+ */
+inline int HearState::insert_new_comm(MPI_Comm comm, MPI_Comm parent)
+{
+    std::unordered_map<MPI_Comm, std::size_t>::iterator parent_id = _comm_id_map.end();
+    unsigned long long seq = 0;
+    CommIdentity identity;
+    bool derived = false;
+    double start;
+    int comm_size;
+    int my_rank;
+    int ret;
+    bool ok;
+
+    if (_local_keys && parent != MPI_COMM_NULL) {
+        parent_id = _comm_id_map.find(parent);
+        if (parent_id != _comm_id_map.end())
+            seq = _comm_id_storage[parent_id->second].nchildren++;
+    }
+
+    if (comm == MPI_COMM_NULL)
+        return MPI_SUCCESS;
+
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Comm_rank(comm, &my_rank);
+    _comm_profile.ncomms++;
+    start = MPI_Wtime();
+
+    if (_local_keys && comm == MPI_COMM_WORLD) {
+        /* the only collective: the job secret */
+        kdf::secret_t secret = {};
+
+        if (my_rank == root_rank)
+            secret = kdf::KeyDerivation::random_secret();
+        ret = PMPI_Bcast(secret.data(), secret.size(), MPI_BYTE, root_rank, comm);
+        if (ret != MPI_SUCCESS)
+            return ret;
+        _kdf.set_secret(secret);
+        _comm_profile.k_n_bcast += MPI_Wtime() - start;
+        start = MPI_Wtime();
+
+        identity.id = _kdf.world_id();
+        derived = true;
+    } else if (parent_id != _comm_id_map.end()) {
+        std::vector<int> ranks(comm_size);
+        std::vector<int> parent_ranks(comm_size);
+        MPI_Group group, parent_group;
+
+        std::iota(ranks.begin(), ranks.end(), 0);
+        MPI_Comm_group(comm, &group);
+        MPI_Comm_group(parent, &parent_group);
+        MPI_Group_translate_ranks(group, comm_size, ranks.data(), parent_group, parent_ranks.data());
+        MPI_Group_free(&group);
+        MPI_Group_free(&parent_group);
+
+        identity.id = _kdf.child_id(_comm_id_storage[parent_id->second].id, seq, parent_ranks);
+        derived = true;
+    }
+
+    if (derived) {
+        std::vector<unsigned int> k_s(comm_size);
+        unsigned int k_n;
+
+        /*
+         * Only what this rank's kernels read, an HMAC per rank would cost
+         * more than the Allgather it saves. MPI_Alltoall(v) has its pair keys.
+         */
+        k_s[0] = _kdf.k_s(identity.id, 0);
+        k_s[my_rank] = _kdf.k_s(identity.id, my_rank);
+        if (my_rank + 1 < comm_size)
+            k_s[my_rank + 1] = _kdf.k_s(identity.id, my_rank + 1);
+        k_n = _kdf.k_n(identity.id);
+        _comm_profile.key_exchange += MPI_Wtime() - start;
+        start = MPI_Wtime();
+
+        identity.nchildren = 0;
+        ok = _comm_id_map.insert({comm, acquire_slot(_comm_id_storage, _comm_id_free, identity)}).second;
+        assert(ok);
+
+        ok = _k_s_map.insert({comm, acquire_slot(_k_s_storage, _k_s_free, std::move(k_s))}).second;
+        assert(ok);
+
+        ok = _k_n_map.insert({comm, acquire_slot(_k_n_storage, _k_n_free, k_n)}).second;
+        assert(ok);
+        _comm_profile.insertion += MPI_Wtime() - start;
+
+        if (comm == MPI_COMM_WORLD && (ret = init_plugin()) != MPI_SUCCESS)
+            return ret;
+        return apply_policy(comm);
+    }
+
+    std::vector<unsigned int> k_s(comm_size, my_rank);
+    k_s[my_rank] = static_cast<unsigned int>(encryption::encr_noise_generator());
+    ok = _k_s_map.insert({comm, acquire_slot(_k_s_storage, _k_s_free, std::move(k_s))}).second;
+    assert(ok);
+    ok = _k_n_map.insert({comm, acquire_slot(_k_n_storage, _k_n_free,
+					     my_rank == root_rank ?
+					     static_cast<unsigned int>(encryption::encr_noise_generator()) : 42)}).second;
+    assert(ok);
+    _comm_profile.insertion += MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    ret = PMPI_Allgather(MPI_IN_PLACE, 1, MPI_UNSIGNED, _k_s_storage[_k_s_map[comm]].data(), 1, MPI_UNSIGNED, comm);
+    if (ret != MPI_SUCCESS)
+        return ret;
+    _comm_profile.key_exchange += MPI_Wtime() - start;
+
+    assert(ret == MPI_SUCCESS);
+
+    start = MPI_Wtime();
+    ret = PMPI_Bcast(&_k_n_storage[_k_n_map[comm]], 1, MPI_UNSIGNED, root_rank, comm);
+    if (ret != MPI_SUCCESS)
+        return ret;
+    _comm_profile.k_n_bcast += MPI_Wtime() - start;
+
+    assert(ret == MPI_SUCCESS);
+
+    if (comm == MPI_COMM_WORLD && (ret = init_plugin()) != MPI_SUCCESS)
+        return ret;
+    return apply_policy(comm);
+}
+
+/*
+ * MPI may hand out a freed communicator's handle again, so everything kept
+ * for comm goes with it. Its storage slots are emptied and go on the free
+ * lists, the other communicators keep their indices.
+ */
+void HearState::remove_comm(MPI_Comm comm)
+{
+    auto remove = [comm](std::unordered_map<MPI_Comm, std::size_t> &map, std::vector<std::size_t> &free_slots) {
+        auto it = map.find(comm);
+        std::size_t index = it == map.end() ? SIZE_MAX : it->second;
+
+        if (it != map.end()) {
+            map.erase(it);
+            free_slots.push_back(index);
+        }
+        return index;
+    };
+    std::size_t index;
+
+    if ((index = remove(_k_s_map, _k_s_free)) != SIZE_MAX)
+        std::vector<unsigned int>().swap(_k_s_storage[index]);
+    remove(_k_n_map, _k_n_free);
+    remove(_comm_id_map, _comm_id_free);
+    if ((index = remove(_comm_policy_map, _comm_policy_free)) != SIZE_MAX)
+        _comm_policy_storage[index] = CommPolicy();
+    /* MPI_Comm_free is collective, so is freeing the window */
+    if ((index = remove(_node_ks_map, _node_ks_free)) != SIZE_MAX && _node_ks_storage[index]) {
+        _node_ks_storage[index].reset();
+        _node_ks_order.erase(std::find(_node_ks_order.begin(), _node_ks_order.end(), index));
+    }
+    if ((index = remove(_exchange_map, _exchange_free)) != SIZE_MAX)
+        _exchange_storage[index].reset();
+    _scheduler.remove_comm(comm);
+}
+
+/* the vectors with their free slots, and the map entries */
+template <typename T>
+static std::size_t storage_bytes(const std::vector<T> &storage, const std::vector<std::size_t> &free_slots,
+                                 const std::unordered_map<MPI_Comm, std::size_t> &map)
+{
+    /* per map entry: the key, the index and about two pointers of bucket and node */
+    const std::size_t entry_bytes = sizeof(MPI_Comm) + sizeof(std::size_t) + 2 * sizeof(void *);
+
+    return storage.capacity() * sizeof(T) + free_slots.capacity() * sizeof(std::size_t) +
+        map.size() * entry_bytes;
+}
+
+std::size_t HearState::comm_bytes() const
+{
+    std::size_t bytes = 0;
+
+    bytes += storage_bytes(_k_s_storage, _k_s_free, _k_s_map);
+    for (const auto &k_s : _k_s_storage)
+        bytes += k_s.capacity() * sizeof(unsigned int);
+    bytes += storage_bytes(_k_n_storage, _k_n_free, _k_n_map);
+    bytes += storage_bytes(_comm_id_storage, _comm_id_free, _comm_id_map);
+    bytes += storage_bytes(_comm_policy_storage, _comm_policy_free, _comm_policy_map);
+    bytes += storage_bytes(_node_ks_storage, _node_ks_free, _node_ks_map) +
+        _node_ks_order.capacity() * sizeof(std::size_t);
+    for (const auto &node_ks : _node_ks_storage)
+        bytes += node_ks ? sizeof(keystream::NodeKeystream) : 0;
+    bytes += storage_bytes(_exchange_storage, _exchange_free, _exchange_map);
+    for (const auto &exchange : _exchange_storage)
+        bytes += exchange ? exchange->bytes() : 0;
+
+    return bytes;
+}
+
+/*
+ * fn(begin, n) over count elements, in grains of crypto_grain_bytes (half
+ * of L2, which holds a grain's input and output) on the crypto pool. Grains
+ * are whole HEAR_STAGE_GRANULEs, so each one starts on a counter block of
+ * every kernel and the result is that of one call over all of them.
+ */
+void HearState::crypto_for(int count, int dtype_size, const std::function<void(int, int)> &fn)
+{
+    static const long l2_bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    std::size_t grain_bytes = crypto_grain_bytes ? crypto_grain_bytes : l2_bytes > 0 ? l2_bytes / 2 : 262144;
+    std::size_t grain = grain_bytes / dtype_size / HEAR_STAGE_GRANULE * HEAR_STAGE_GRANULE;
+
+    if (!_pool || count <= 0) {
+	fn(0, count);
+	return;
+    }
+    _pool->parallel_for(count, std::max<std::size_t>(grain, HEAR_STAGE_GRANULE),
+			[&fn](std::size_t begin, std::size_t end) { fn(begin, end - begin); });
+}
+
+/*
+ * Encrypts count elements of src, which start at element offset of the
+ * reduced buffer, into dst. Element i is encrypted under counter k_n + i, so
+ * regions of one buffer can be encrypted separately as long as offset keeps
+ * the kernels' counter blocks, see HEAR_STAGE_GRANULE. node_shared allows the
+ * node keystream, which all ranks of the node have to ask for together.
+ */
+inline int HearState::encrypt_region(void *dst, const void *src, int offset, int count,
+                                     MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                                     unsigned int k_n, bool node_shared)
+{
+    KernelSet &kernels = _comm_policy_storage[_comm_policy_map[comm]].kernels;
+    std::vector<unsigned int> &k_s = _k_s_storage[_k_s_map[comm]];
+    int comm_size;
+    int my_rank;
+    bool is_edge;
+
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Comm_rank(comm, &my_rank);
+    is_edge = my_rank == comm_size - 1;
+
+    /* 3ncrypt10n */
+    if (op == MPI_SUM) {
+	if (datatype == MPI_INT) {
+	    crypto_for(count, sizeof(unsigned int), [&](int begin, int n) {
+		kernels.encrypt_int_sum(reinterpret_cast<unsigned int *>(dst) + begin,
+					reinterpret_cast<const unsigned int *>(src) + begin, n, my_rank,
+					k_s, k_n + offset + begin, is_edge);
+	    });
+
+	} else if (datatype == MPI_FLOAT) {
+	    const unsigned int *noise = !kernels.float_sum_aes_layout || !node_shared ? nullptr :
+		shared_noise(comm, k_n + offset + 1, count);
+
+	    if (noise)
+		encryption::encrypt_float_sum_noise(reinterpret_cast<float *>(dst),
+						    reinterpret_cast<const float *>(src), count, noise);
+	    else
+		crypto_for(count, sizeof(float), [&](int begin, int n) {
+		    kernels.encrypt_float_sum(reinterpret_cast<float *>(dst) + begin,
+					      reinterpret_cast<const float *>(src) + begin, n, my_rank,
+					      k_s, k_n + offset + begin);
+		});
+	} else {
+	    std::cerr << "Encryption for this MPI datatype is not supported!" << std::endl;
+	    return MPI_ERR_TYPE;
+	}
+    } else if (op == MPI_PROD) {
+	if (datatype == MPI_INT) {
+	    crypto_for(count, sizeof(unsigned int), [&](int begin, int n) {
+		kernels.encrypt_int_prod(reinterpret_cast<unsigned int *>(dst) + begin,
+					 reinterpret_cast<const unsigned int *>(src) + begin, n, my_rank,
+					 k_s, k_n + offset + begin, is_edge);
+	    });
+	} else {
+	    std::cerr << "Encryption for this MPI datatype is not supported!" << std::endl;
+	    return MPI_ERR_TYPE;
+	}
+    } else {
+	std::cerr << "Encryption for this MPI op is not supported!" << std::endl;
+	return MPI_ERR_TYPE;
+    }
+
+    return MPI_SUCCESS;
+}
+
+inline void* HearState::encrypt_sendbuf(const void *sendbuf, int count,
+                                        MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    return encrypt_sendbuf(sendbuf, 0, count, datatype, op, comm, _k_n_storage[_k_n_map[comm]], true);
+}
+
+inline void* HearState::encrypt_sendbuf(const void *sendbuf, int offset, int count, MPI_Datatype datatype,
+                                        MPI_Op op, MPI_Comm comm, unsigned int k_n, bool node_shared)
+{
+    void *encr_sbuf = nullptr;
+    int type_size;
+    int sbuf_len;
+
+    MPI_Type_size(datatype, &type_size);
+    sbuf_len = count * type_size;
+
+#ifdef TSC_PROF
+    myInt64 t_mmalloc = start_tsc();
+#endif
+
+#ifndef USE_MPOOL
+    encr_sbuf = new char[sbuf_len];
+#else
+    encr_sbuf = _sbuf_mpool.acquire_buf();
+#endif
+    if (encr_sbuf == nullptr)
+        return nullptr;
+
+#ifdef TSC_PROF
+    hear->tsc_mmalloc.push_back(stop_tsc(t_mmalloc));
+#endif
+
+#ifdef TSC_PROF
+    myInt64 t_encrypt = start_tsc();
+#endif
+#ifdef CALLSITE_PROF
+    myInt64 t_callsite = start_tsc();
+#endif
+
+    if (encrypt_region(encr_sbuf, sendbuf, offset, count, datatype, op, comm, k_n, node_shared) != MPI_SUCCESS)
+        goto fail_cleanup;
+
+#ifdef TSC_PROF
+    hear->tsc_encrypt.push_back(stop_tsc(t_encrypt));
+#endif
+#ifdef CALLSITE_PROF
+    callsites.add_crypto(stop_tsc(t_callsite));
+#endif
+
+    return encr_sbuf;
+
+fail_cleanup:
+#ifndef USE_MPOOL
+    delete[] reinterpret_cast<char *>(encr_sbuf);
+#else
+    _sbuf_mpool.release_buf(encr_sbuf);
+#endif
+    return nullptr;
+}
+
+inline int HearState::decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype datatype,
+                                      MPI_Op op, MPI_Comm comm)
+{
+    return decrypt_recvbuf(recvbuf, count, datatype, op, comm, _k_n_storage[_k_n_map[comm]], true);
+}
+
+inline int HearState::decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype datatype,
+                                      MPI_Op op, MPI_Comm comm, unsigned int k_n, bool node_shared)
+{
+    KernelSet &kernels = _comm_policy_storage[_comm_policy_map[comm]].kernels;
+    std::vector<unsigned int> &k_s = _k_s_storage[_k_s_map[comm]];
+
+#ifdef TSC_PROF
+    myInt64 t_decrypt = start_tsc();
+#endif
+#ifdef CALLSITE_PROF
+    myInt64 t_callsite = start_tsc();
+#endif
+
+    /* d3crypt10n */
+    if (op == MPI_SUM) {
+	if (datatype == MPI_INT) {
+	    const unsigned int *noise = !kernels.int_sum_aes_layout || !node_shared ? nullptr :
+		shared_noise(comm, k_n + k_s[0], count);
+
+	    if (noise)
+		encryption::decrypt_int_sum_noise(reinterpret_cast<unsigned int *>(recvbuf), count, noise);
+	    else
+		crypto_for(count, sizeof(unsigned int), [&](int begin, int n) {
+		    kernels.decrypt_int_sum(reinterpret_cast<unsigned int *>(recvbuf) + begin, n, k_s, k_n + begin);
+		});
+	} else if (datatype == MPI_FLOAT) {
+	    const unsigned int *noise = !kernels.float_sum_aes_layout || !node_shared ? nullptr :
+		shared_noise(comm, k_n + 1, count);
+
+	    if (noise)
+		encryption::decrypt_float_sum_noise(reinterpret_cast<float *>(recvbuf), count, noise);
+	    else
+		crypto_for(count, sizeof(float), [&](int begin, int n) {
+		    kernels.decrypt_float_sum(reinterpret_cast<float *>(recvbuf) + begin, n, k_s, k_n + begin);
+		});
+	} else {
+	    std::cerr << "Decryption for this MPI datatype is not supported!" << std::endl;
+	    return MPI_ERR_TYPE;
 	}
     } else if (op == MPI_PROD) {
 	if (datatype == MPI_INT) {
-	    this->decrypt_block_int_prod(reinterpret_cast<unsigned int *>(recvbuf), count,
-					 _k_s_storage[_k_s_map[comm]], _k_n_storage[_k_n_map[comm]]);
+	    crypto_for(count, sizeof(unsigned int), [&](int begin, int n) {
+		kernels.decrypt_int_prod(reinterpret_cast<unsigned int *>(recvbuf) + begin, n, k_s, k_n + begin);
+	    });
 	} else {
 	    std::cerr << "Decryption for this MPI datatype is not supported!" << std::endl;
 	    return MPI_ERR_TYPE;
@@ -327,41 +1571,318 @@ inline int HearState::decrypt_recvbuf(void *recvbuf, int count, MPI_Datatype dat
 	return MPI_ERR_TYPE;
     }
 
-#ifdef TSC_PROF
-    hear->tsc_decrypt.push_back(stop_tsc(t_decrypt));
-#endif
+#ifdef TSC_PROF
+    hear->tsc_decrypt.push_back(stop_tsc(t_decrypt));
+#endif
+#ifdef CALLSITE_PROF
+    callsites.add_crypto(stop_tsc(t_callsite));
+#endif
+
+    return MPI_SUCCESS;
+}
+
+/*
+ * HEAR_LAZY_DECRYPT: decrypts the partial pages at both ends of recvbuf now
+ * and leaves the whole pages in between protected for the lazy decryptor.
+ * Falls back to decrypt_recvbuf when a page would not start on a counter
+ * block of the kernels.
+ */
+inline int HearState::decrypt_lazily(void *recvbuf, int count, MPI_Datatype datatype,
+                                     MPI_Op op, MPI_Comm comm)
+{
+    KernelSet &kernels = _comm_policy_storage[_comm_policy_map[comm]].kernels;
+    std::vector<unsigned int> &k_s = _k_s_storage[_k_s_map[comm]];
+    unsigned int k_n = _k_n_storage[_k_n_map[comm]];
+    std::size_t page_size = _lazy->page_size();
+    std::size_t page_elems = page_size / sizeof(unsigned int);
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(recvbuf);
+    std::uintptr_t end = begin + static_cast<std::size_t>(count) * sizeof(unsigned int);
+    std::uintptr_t first = (begin + page_size - 1) & ~(page_size - 1);
+    std::uintptr_t last = end & ~(page_size - 1);
+    std::size_t head = (first - begin) / sizeof(unsigned int);
+    std::size_t tail = (last - begin) / sizeof(unsigned int);
+    std::size_t block = datatype == MPI_FLOAT ? kernels.float_sum_block : kernels.int_sum_block;
+    std::function<void(void *, std::size_t, std::size_t)> decrypt;
+
+    /* where recvbuf lies differs between the ranks, so not with the node keystream's barriers */
+    if (op != MPI_SUM || last <= first || begin % sizeof(unsigned int) || head % block)
+	return decrypt_recvbuf(recvbuf, count, datatype, op, comm, k_n, false);
+
+    /* element i of recvbuf under k_n + i, no node keystream outside the collective */
+    if (datatype == MPI_INT) {
+	auto kernel = kernels.decrypt_int_sum;
+	decrypt = [kernel, k_s, k_n](void *buf, std::size_t offset, std::size_t n) mutable {
+	    kernel(static_cast<unsigned int *>(buf), n, k_s, k_n + offset);
+	};
+    } else {
+	auto kernel = kernels.decrypt_float_sum;
+	decrypt = [kernel, k_s, k_n](void *buf, std::size_t offset, std::size_t n) mutable {
+	    kernel(static_cast<float *>(buf), n, k_s, k_n + offset);
+	};
+    }
+
+    if (head)
+	decrypt(recvbuf, 0, head);
+    if (tail < static_cast<std::size_t>(count))
+	decrypt(reinterpret_cast<void *>(last), tail, count - tail);
+
+    if (!_lazy->add(reinterpret_cast<void *>(first), (last - first) / page_size,
+		    [decrypt, head, page_elems](void *page, std::size_t p) {
+			decrypt(page, head + p * page_elems, page_elems);
+		    }))
+	decrypt(reinterpret_cast<void *>(first), head, tail - head);
+
+    return MPI_SUCCESS;
+}
+
+int HearState::insert_new_file(MPI_File fh, MPI_Comm comm, const char *filename)
+{
+    io::File file;
+    int ret;
+
+    if (!_io)
+	return MPI_SUCCESS;
+
+    ret = PMPI_Comm_dup(comm, &file.comm);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    ret = io::Cipher::file_nonce(filename, file.comm, file.nonce);
+    if (ret != MPI_SUCCESS) {
+	PMPI_Comm_free(&file.comm);
+	return ret;
+    }
+
+    _file_map[fh] = file;
+    return MPI_SUCCESS;
+}
+
+void HearState::remove_file(MPI_File fh)
+{
+    auto it = _file_map.find(fh);
+
+    if (it == _file_map.end())
+	return;
+
+    PMPI_Comm_free(&it->second.comm);
+    _file_map.erase(it);
+}
+
+io::File* HearState::file(MPI_File fh)
+{
+    auto it = _file_map.find(fh);
+
+    return it == _file_map.end() ? nullptr : &it->second;
+}
+
+int HearState::exchange(MPI_Comm comm, alltoall::Exchange **exchange)
+{
+    auto it = _exchange_map.find(comm);
+    int comm_size, my_rank;
+    MPI_Comm dup;
+    int ret;
+
+    if (it != _exchange_map.end()) {
+	*exchange = _exchange_storage[it->second].get();
+	return MPI_SUCCESS;
+    }
+
+    auto id = _comm_id_map.find(comm);
+    const std::vector<unsigned int> &k_s = _k_s_storage[_k_s_map[comm]];
+    unsigned int k_n = _k_n_storage[_k_n_map[comm]];
+
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Comm_rank(comm, &my_rank);
+
+    /* k_n has moved on the same way on every rank since the communicator was created */
+    std::vector<io::cipher_key_t> send_keys(comm_size), recv_keys(comm_size);
+    for (int rank = 0; rank < comm_size; rank++) {
+	if (id != _comm_id_map.end()) {
+	    send_keys[rank] = _kdf.pair_key(_comm_id_storage[id->second].id, my_rank, rank);
+	    recv_keys[rank] = _kdf.pair_key(_comm_id_storage[id->second].id, rank, my_rank);
+	} else {
+	    send_keys[rank] = alltoall::Exchange::pair_key(k_n, k_s, my_rank, rank);
+	    recv_keys[rank] = alltoall::Exchange::pair_key(k_n, k_s, rank, my_rank);
+	}
+    }
+
+    ret = PMPI_Comm_dup(comm, &dup);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    std::unique_ptr<alltoall::Exchange> created(new alltoall::Exchange(
+	dup, send_keys, recv_keys, alltoall_chunk_bytes,
+	[this](std::size_t len) { return acquire_memory(len); },
+	[this](void *buf, std::size_t len) { release_memory(buf, len); }));
+    *exchange = created.get();
+    _exchange_map.insert({comm, acquire_slot(_exchange_storage, _exchange_free, std::move(created))});
+
+    return MPI_SUCCESS;
+}
+
+inline void HearState::release_memory(void *buf)
+{
+#ifdef TSC_PROF
+    myInt64 t_free = start_tsc();
+#endif
+    assert(buf);
+#ifndef USE_MPOOL
+    delete[] static_cast<char *>(buf);
+#else
+    _sbuf_mpool.release_buf(buf);
+#endif
+#ifdef TSC_PROF
+    hear->tsc_mfree.push_back(stop_tsc(t_free));
+#endif
+}
+
+inline void* HearState::acquire_memory(std::size_t len)
+{
+#ifdef USE_MPOOL
+    if (len <= mpool_sbuf_len)
+	return _sbuf_mpool.acquire_buf();
+#endif
+    return _mm_malloc(len, 64);
+}
+
+inline void HearState::release_memory(void *buf, std::size_t len)
+{
+    assert(buf);
+#ifdef USE_MPOOL
+    if (len <= mpool_sbuf_len) {
+	_sbuf_mpool.release_buf(buf);
+	return;
+    }
+#endif
+    _mm_free(buf);
+}
+
+/*
+ * Reduction with a declared linear op, not pipelined: every field is gathered
+ * into a contiguous array, en-/decrypted like an MPI_SUM over its type under
+ * k_n + f * count, and scattered back. The user op reduces the masked
+ * elements, bytes outside the declared fields are sent as they are.
+ */
+
+/* the field array, the kernels work on whole, aligned 32-byte blocks */
+static std::size_t linear_field_len(int count)
+{
+    return ((static_cast<std::size_t>(count) * sizeof(unsigned int) + 63) & ~std::size_t(63)) + 64;
+}
+
+/* src with its fields encrypted into encr_sbuf */
+static int linear_encrypt(char *encr_sbuf, const char *src, char *field, int count, MPI_Comm comm,
+                          const LinearOp &linear, unsigned int k_n, bool node_shared)
+{
+    int ret;
+
+    std::memcpy(encr_sbuf, src, static_cast<std::size_t>(count) * linear.extent);
+    for (std::size_t f = 0; f < linear.field_types.size(); f++) {
+	const char *field_src = src + linear.field_displs[f];
+
+	for (int i = 0; i < count; i++)
+	    std::memcpy(field + i * sizeof(unsigned int), field_src + i * linear.extent, sizeof(unsigned int));
+	ret = hear->encrypt_region(field, field, 0, count, linear.field_types[f], MPI_SUM, comm,
+				   k_n + f * count, node_shared);
+	if (ret != MPI_SUCCESS)
+	    return ret;
+	for (int i = 0; i < count; i++)
+	    std::memcpy(encr_sbuf + i * linear.extent + linear.field_displs[f],
+			field + i * sizeof(unsigned int), sizeof(unsigned int));
+    }
+
+    return MPI_SUCCESS;
+}
+
+static int linear_decrypt(char *recvbuf, char *field, int count, MPI_Comm comm,
+                          const LinearOp &linear, unsigned int k_n, bool node_shared)
+{
+    int ret;
+
+    for (std::size_t f = 0; f < linear.field_types.size(); f++) {
+	char *dst = recvbuf + linear.field_displs[f];
+
+	for (int i = 0; i < count; i++)
+	    std::memcpy(field + i * sizeof(unsigned int), dst + i * linear.extent, sizeof(unsigned int));
+	ret = hear->decrypt_recvbuf(field, count, linear.field_types[f], MPI_SUM, comm, k_n + f * count, node_shared);
+	if (ret != MPI_SUCCESS)
+	    return ret;
+	for (int i = 0; i < count; i++)
+	    std::memcpy(dst + i * linear.extent, field + i * sizeof(unsigned int), sizeof(unsigned int));
+    }
 
     return MPI_SUCCESS;
 }
 
-inline void HearState::release_memory(void *buf)
+static int linear_allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+                            MPI_Op op, MPI_Comm comm, const LinearOp &linear,
+                            HEAR_Block_function *fn, void *extra_state)
 {
-#ifdef TSC_PROF
-    myInt64 t_free = start_tsc();
-#endif
-    assert(buf);
-#ifndef USE_MPOOL
-    delete[] static_cast<char *>(buf);
-#else
-    _sbuf_mpool.release_buf(buf);
-#endif
-#ifdef TSC_PROF
-    hear->tsc_mfree.push_back(stop_tsc(t_free));
-#endif
+    const char *src = static_cast<const char *>(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+    std::size_t len = static_cast<std::size_t>(count) * linear.extent;
+    std::size_t field_len = linear_field_len(count);
+    char *encr_sbuf = static_cast<char *>(hear->acquire_memory(len));
+    char *field = static_cast<char *>(hear->acquire_memory(field_len));
+    unsigned int k_n;
+    int ret = MPI_SUCCESS;
+
+    if (!encr_sbuf || !field) {
+	ret = MPI_ERR_BUFFER;
+	goto cleanup;
+    }
+
+    hear->update_k_n(comm);
+    k_n = hear->k_n(comm);
+
+    ret = linear_encrypt(encr_sbuf, src, field, count, comm, linear, k_n, true);
+    if (ret != MPI_SUCCESS)
+	goto cleanup;
+
+    ret = PMPI_Allreduce(encr_sbuf, recvbuf, count, datatype, op, comm);
+    if (ret != MPI_SUCCESS)
+	goto cleanup;
+
+    ret = linear_decrypt(static_cast<char *>(recvbuf), field, count, comm, linear, k_n, true);
+    if (ret != MPI_SUCCESS)
+	goto cleanup;
+
+    if (fn)
+	fn(recvbuf, 0, count, datatype, extra_state);
+
+cleanup:
+    if (encr_sbuf)
+	hear->release_memory(encr_sbuf, len);
+    if (field)
+	hear->release_memory(field, field_len);
+    return ret;
+}
+
+/* reductions that are not encrypted hand all of recvbuf to fn at once */
+static inline int plain_allreduce(const void *sendbuf, void *recvbuf, int count,
+                                  MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                                  HEAR_Block_function *fn, void *extra_state)
+{
+    int ret = PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+
+    if (ret == MPI_SUCCESS && fn)
+        fn(recvbuf, 0, count, datatype, extra_state);
+    return ret;
 }
 
 /*
- * PMPI_* wrappers
+ * MPI_Allreduce and HEAR_Allreduce_apply, caller is the return address
+ * attributed by CALLSITE_PROF.
  */
-
-int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
-                  MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+static int allreduce(const void *sendbuf, void *recvbuf, int count,
+                     MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                     [[maybe_unused]] void *caller, HEAR_Block_function *fn, void *extra_state)
 {
 #ifdef USE_PIPELINING
     MPI_Request req;
     MPI_Status status;
     int prev_offset, cur_offset, next_offset;
     int prev_count, cur_count, next_count, total_count;
+    int block_size;
     void *encr_sendbuf_next;
 #endif
     void *encr_sendbuf;
@@ -376,14 +1897,34 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
 #ifdef TSC_PROF
     hear->tsc_comm.push_back(stop_tsc(t_baseline));
 #endif
+    if (ret == MPI_SUCCESS && fn)
+        fn(recvbuf, 0, count, datatype, extra_state);
     return ret;
 #endif
 
-    if (((op != MPI_SUM) && (op != MPI_PROD)) || ((datatype != MPI_INT) && (datatype != MPI_FLOAT)))
-            return PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
-
     MPI_Type_size(datatype, &dtype_size);
 
+    /* MPI may access the buffers from the kernel, which does not fault pages in */
+    hear->lazy_wait(sendbuf, static_cast<std::size_t>(count) * dtype_size);
+    hear->lazy_wait(recvbuf, static_cast<std::size_t>(count) * dtype_size);
+
+    const LinearOp *linear = hear->linear_op(op, datatype);
+
+    if (!linear && (((op != MPI_SUM) && (op != MPI_PROD)) || ((datatype != MPI_INT) && (datatype != MPI_FLOAT))))
+            return plain_allreduce(sendbuf, recvbuf, count, datatype, op, comm, fn, extra_state);
+
+#ifdef CALLSITE_PROF
+    callsite::Scope callsite_scope(hear->callsites, caller, comm,
+				   static_cast<std::size_t>(count) * dtype_size);
+#endif
+
+    const policy::Decision &decision = hear->decision(comm);
+    if (!decision.encrypted(static_cast<std::size_t>(count) * dtype_size))
+        return plain_allreduce(sendbuf, recvbuf, count, datatype, op, comm, fn, extra_state);
+
+    if (linear)
+        return linear_allreduce(sendbuf, recvbuf, count, datatype, op, comm, *linear, fn, extra_state);
+
 #ifdef DCHECK
     void *valid_rbuf = new char[dtype_size * count];
     assert(valid_rbuf);
@@ -400,8 +1941,26 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
 
     hear->update_k_n(comm);
 
+    if (!fn && hear->lazy_decrypt(static_cast<std::size_t>(count) * dtype_size)) {
+        /* one reduction, not pipelined, recvbuf is decrypted as it is touched */
+        std::size_t len = (static_cast<std::size_t>(count) * dtype_size + 63) & ~std::size_t(63);
+
+        encr_sendbuf = std::aligned_alloc(64, len);
+        if (!encr_sendbuf)
+            return MPI_ERR_BUFFER;
+        ret = hear->encrypt_region(encr_sendbuf, sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf, 0, count,
+                                   datatype, op, comm, hear->k_n(comm), true);
+        if (ret == MPI_SUCCESS)
+            ret = PMPI_Allreduce(encr_sendbuf, recvbuf, count, datatype, op, comm);
+        std::free(encr_sendbuf);
+        if (ret != MPI_SUCCESS)
+            return ret;
+
+        return hear->decrypt_lazily(recvbuf, count, datatype, op, comm);
+    }
+
 #ifndef USE_PIPELINING
-    encr_sendbuf = hear->encrypt_sendbuf(sendbuf, recvbuf, count, datatype, op, comm);
+    encr_sendbuf = hear->encrypt_sendbuf(sendbuf, count, datatype, op, comm);
     if (encr_sendbuf == nullptr)
         return MPI_ERR_BUFFER;
 
@@ -418,6 +1977,8 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
     ret = hear->decrypt_recvbuf(recvbuf, count, datatype, op, comm);
     if (ret != MPI_SUCCESS)
         goto cleanup;
+    if (fn)
+        fn(recvbuf, 0, count, datatype, extra_state);
 
     hear->release_memory(encr_sendbuf);
 #else
@@ -425,11 +1986,21 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
      * Overlap communication of n'th block with decryption of
      * n-1'th block and encryption of n+1'th block
      */
+    if (decision.block_size < 0)
+        block_size = pipelining_block_size;
+    else
+        block_size = decision.block_size > 0 ? decision.block_size : count;
+#ifdef USE_MPOOL
+    /* a block has to fit in a pool buffer */
+    if (static_cast<std::size_t>(block_size) * dtype_size > mpool_sbuf_len)
+        block_size = mpool_sbuf_len / dtype_size;
+#endif
+
     total_count = count;
-    cur_count = total_count < pipelining_block_size ? total_count : pipelining_block_size;
+    cur_count = total_count < block_size ? total_count : block_size;
     prev_offset = cur_offset = next_offset = 0;
 
-    encr_sendbuf = hear->encrypt_sendbuf(sendbuf, recvbuf, cur_count, datatype, op, comm);
+    encr_sendbuf = hear->encrypt_sendbuf(sendbuf, cur_count, datatype, op, comm);
     if (!encr_sendbuf) {
         ret = MPI_ERR_BUFFER;
         goto cleanup;
@@ -450,15 +2021,17 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
             if (ret != MPI_SUCCESS) {
                 goto cleanup;
             }
+            if (fn)
+                fn(reinterpret_cast<char *>(recvbuf) + prev_offset, prev_offset / dtype_size,
+                   prev_count, datatype, extra_state);
         }
 
         total_count -= cur_count;
 
         if (total_count) {
             next_offset += cur_count * dtype_size;
-            next_count = total_count < pipelining_block_size ? total_count : pipelining_block_size;
+            next_count = total_count < block_size ? total_count : block_size;
             encr_sendbuf_next = hear->encrypt_sendbuf(reinterpret_cast<const char *>(sendbuf) + next_offset,
-                                                      reinterpret_cast<char *>(recvbuf) + next_offset,
                                                       next_count, datatype, op, comm);
             if (!encr_sendbuf_next) {
                 ret = MPI_ERR_BUFFER;
@@ -480,23 +2053,585 @@ int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
         encr_sendbuf = encr_sendbuf_next;
     }
 
-    ret = hear->decrypt_recvbuf(reinterpret_cast<char *>(recvbuf) + prev_offset, prev_count, datatype, op, comm);
-    if (ret != MPI_SUCCESS)
-        return ret;
+    ret = hear->decrypt_recvbuf(reinterpret_cast<char *>(recvbuf) + prev_offset, prev_count, datatype, op, comm);
+    if (ret != MPI_SUCCESS)
+        return ret;
+    if (fn)
+        fn(reinterpret_cast<char *>(recvbuf) + prev_offset, prev_offset / dtype_size,
+           prev_count, datatype, extra_state);
+#endif
+
+#ifdef DCHECK
+    /* fn may have changed recvbuf */
+    assert(fn || !std::memcmp(valid_rbuf, recvbuf, dtype_size * count));
+#endif
+
+    return MPI_SUCCESS;
+
+cleanup:
+#ifdef DCHECK
+    delete[] reinterpret_cast<char *>(valid_rbuf);
+#endif
+    hear->release_memory(encr_sendbuf);
+    return ret;
+}
+
+/*
+ * PMPI_* wrappers
+ */
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
+                  MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    /* outstanding HEAR_Iallreduce blocks move on whenever the application calls into MPI through us */
+    hear->scheduler().progress();
+
+    return allreduce(sendbuf, recvbuf, count, datatype, op, comm,
+                     __builtin_return_address(0), nullptr, nullptr);
+}
+
+int HEAR_Allreduce_apply(const void *sendbuf, void *recvbuf, int count,
+                         MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                         HEAR_Block_function *fn, void *extra_state)
+{
+    hear->scheduler().progress();
+
+    return allreduce(sendbuf, recvbuf, count, datatype, op, comm,
+                     __builtin_return_address(0), fn, extra_state);
+}
+
+int HEAR_Decrypt_wait(const void *buf, size_t len)
+{
+    hear->lazy_wait(buf, len);
+    return MPI_SUCCESS;
+}
+
+int HEAR_Op_declare_linear(MPI_Op op, MPI_Datatype datatype, int nfields,
+                           const MPI_Datatype field_types[], const MPI_Aint field_displs[])
+{
+    LinearOp linear;
+    MPI_Aint lb;
+
+    MPI_Type_get_extent(datatype, &lb, &linear.extent);
+    if (nfields <= 0)
+        return MPI_ERR_ARG;
+
+    linear.datatype = datatype;
+    for (int f = 0; f < nfields; f++) {
+        if (field_types[f] != MPI_INT && field_types[f] != MPI_FLOAT)
+            return MPI_ERR_TYPE;
+        if (field_displs[f] < 0 || field_displs[f] + static_cast<MPI_Aint>(sizeof(unsigned int)) > linear.extent)
+            return MPI_ERR_ARG;
+        linear.field_types.push_back(field_types[f]);
+        linear.field_displs.push_back(field_displs[f]);
+    }
+
+    hear->declare_linear_op(op, linear);
+    return MPI_SUCCESS;
+}
+
+/*
+ * Encrypt-on-produce staging
+ */
+
+struct HEAR_Stage_s
+{
+    MPI_Comm comm;
+    MPI_Datatype datatype;
+    MPI_Op op;
+    int count;
+    int dtype_size;
+    /* false for reductions that MPI_Allreduce would not encrypt either */
+    bool encrypted;
+    unsigned int k_n;
+    void *mem;
+    void *buf;
+    /* one flag per HEAR_STAGE_GRANULE elements */
+    std::vector<bool> ready;
+};
+
+/* the aligned kernels assume 32 bytes */
+const std::size_t stage_alignment = 64;
+
+int HEAR_Stage_create(int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                      HEAR_Stage *stage)
+{
+    HEAR_Stage s;
+    std::uintptr_t addr;
+    MPI_Aint len;
+    int ret;
+
+    if (count < 0)
+        return MPI_ERR_COUNT;
+
+    s = new HEAR_Stage_s;
+    s->comm = comm;
+    s->datatype = datatype;
+    s->op = op;
+    s->count = count;
+    MPI_Type_size(datatype, &s->dtype_size);
+
+#ifndef ALLREDUCE_BASELINE
+    s->encrypted = ((op == MPI_SUM) || (op == MPI_PROD)) && ((datatype == MPI_INT) || (datatype == MPI_FLOAT)) &&
+        hear->decision(comm).encrypted(static_cast<std::size_t>(count) * s->dtype_size);
+#else
+    s->encrypted = false;
+#endif
+    s->k_n = s->encrypted ? hear->stage_k_n(comm) : 0;
+    s->ready.assign((count + HEAR_STAGE_GRANULE - 1) / HEAR_STAGE_GRANULE, false);
+
+    /* whole granules, the kernels may write up to the end of the last one */
+    len = static_cast<MPI_Aint>(s->ready.size()) * HEAR_STAGE_GRANULE * s->dtype_size + stage_alignment;
+    ret = MPI_Alloc_mem(len, MPI_INFO_NULL, &s->mem);
+    if (ret != MPI_SUCCESS) {
+        delete s;
+        return ret;
+    }
+    addr = reinterpret_cast<std::uintptr_t>(s->mem);
+    s->buf = reinterpret_cast<void *>((addr + stage_alignment - 1) & ~(stage_alignment - 1));
+
+    *stage = s;
+    return MPI_SUCCESS;
+}
+
+void *HEAR_Stage_buffer(HEAR_Stage stage)
+{
+    return stage->buf;
+}
+
+static bool stage_region_valid(HEAR_Stage stage, int offset, int count)
+{
+    int end = offset + count;
+
+    if (offset < 0 || count < 0 || end > stage->count)
+        return false;
+
+    return !(offset % HEAR_STAGE_GRANULE) && (!(end % HEAR_STAGE_GRANULE) || end == stage->count);
+}
+
+int HEAR_Stage_ready(HEAR_Stage stage, int offset, int count)
+{
+    char *region = static_cast<char *>(stage->buf) + static_cast<std::size_t>(offset) * stage->dtype_size;
+    int first = offset / HEAR_STAGE_GRANULE;
+    int last = (offset + count + HEAR_STAGE_GRANULE - 1) / HEAR_STAGE_GRANULE;
+
+    if (!stage_region_valid(stage, offset, count))
+        return MPI_ERR_ARG;
+
+    /* encrypting a region twice would not decrypt */
+    for (int g = first; g < last; g++) {
+        if (stage->ready[g])
+            return MPI_ERR_ARG;
+    }
+    std::fill(stage->ready.begin() + first, stage->ready.begin() + last, true);
+
+    if (!stage->encrypted || !count)
+        return MPI_SUCCESS;
+
+    /* ranks mark their regions at different times, no node keystream */
+    return hear->encrypt_region(region, region, offset, count, stage->datatype, stage->op,
+                                stage->comm, stage->k_n, false);
+}
+
+int HEAR_Stage_produce(HEAR_Stage stage, int offset, int count,
+                       HEAR_Block_function *fn, void *extra_state)
+{
+    if (!stage_region_valid(stage, offset, count))
+        return MPI_ERR_ARG;
+
+    fn(static_cast<char *>(stage->buf) + static_cast<std::size_t>(offset) * stage->dtype_size,
+       offset, count, stage->datatype, extra_state);
+
+    return HEAR_Stage_ready(stage, offset, count);
+}
+
+int HEAR_Stage_allreduce(HEAR_Stage stage, void *recvbuf)
+{
+    char *buf = static_cast<char *>(stage->buf);
+    std::size_t ngranules = stage->ready.size();
+    int ret;
+
+    /* runs of granules that were never marked ready */
+    for (std::size_t g = 0; stage->encrypted && g < ngranules; g++) {
+        std::size_t end = g;
+        int offset, count;
+
+        if (stage->ready[g])
+            continue;
+        while (end < ngranules && !stage->ready[end])
+            end++;
+
+        offset = g * HEAR_STAGE_GRANULE;
+        count = std::min<std::size_t>(end * HEAR_STAGE_GRANULE, stage->count) - offset;
+        ret = hear->encrypt_region(buf + static_cast<std::size_t>(offset) * stage->dtype_size,
+                                   buf + static_cast<std::size_t>(offset) * stage->dtype_size,
+                                   offset, count, stage->datatype, stage->op, stage->comm,
+                                   stage->k_n, false);
+        if (ret != MPI_SUCCESS)
+            return ret;
+        g = end;
+    }
+    std::fill(stage->ready.begin(), stage->ready.end(), false);
+
+    ret = PMPI_Allreduce(stage->buf, recvbuf, stage->count, stage->datatype, stage->op, stage->comm);
+    if (ret != MPI_SUCCESS || !stage->encrypted)
+        return ret;
+
+    ret = hear->decrypt_recvbuf(recvbuf, stage->count, stage->datatype, stage->op, stage->comm, stage->k_n, true);
+    stage->k_n = hear->next_stage_k_n(stage->comm, stage->k_n);
+
+    return ret;
+}
+
+int HEAR_Stage_free(HEAR_Stage *stage)
+{
+    int ret = MPI_Free_mem((*stage)->mem);
+
+    delete *stage;
+    *stage = nullptr;
+
+    return ret;
+}
+
+/*
+ * Prioritized nonblocking reductions, see sched.hpp
+ */
+
+struct HEAR_Request_s
+{
+    std::shared_ptr<sched::Job> job;
+};
+
+/* elements per scheduled block, whole stage granules so that blocks keep the counter blocks */
+static int sched_block_size(const policy::Decision &decision, int count, int dtype_size)
+{
+    long block_size = count;
+
+#ifdef USE_PIPELINING
+    if (decision.block_size < 0)
+        block_size = pipelining_block_size;
+#endif
+    if (decision.block_size > 0)
+        block_size = decision.block_size;
+#ifdef USE_MPOOL
+    block_size = std::min<long>(block_size, mpool_sbuf_len / dtype_size);
+#endif
+    block_size -= block_size % HEAR_STAGE_GRANULE;
+
+    return std::max<long>(block_size, HEAR_STAGE_GRANULE);
+}
+
+/* a linear op's reduction, in one block */
+static void linear_job(sched::Job &job, const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+                       MPI_Op op, MPI_Comm comm, const LinearOp &linear)
+{
+    const char *src = static_cast<const char *>(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+    std::size_t len = static_cast<std::size_t>(count) * linear.extent;
+    std::size_t field_len = linear_field_len(count);
+    auto bufs = std::make_shared<std::pair<char *, char *>>(nullptr, nullptr);
+    unsigned int k_n;
+
+    /* here, so that the ranks agree on it */
+    hear->update_k_n(comm);
+    k_n = hear->k_n(comm);
+
+    job.nblocks = 1;
+    job.prepare = [=](int) {
+        bufs->first = static_cast<char *>(hear->acquire_memory(len));
+        bufs->second = static_cast<char *>(hear->acquire_memory(field_len));
+        if (!bufs->first || !bufs->second)
+            return MPI_ERR_BUFFER;
+        return linear_encrypt(bufs->first, src, bufs->second, count, comm, linear, k_n, false);
+    };
+    job.start = [=](int, MPI_Comm channel, MPI_Request *req) {
+        return PMPI_Iallreduce(bufs->first, recvbuf, count, datatype, op, channel, req);
+    };
+    job.finish = [=](int) {
+        int ret = linear_decrypt(static_cast<char *>(recvbuf), bufs->second, count, comm, linear, k_n, false);
+
+        hear->release_memory(bufs->first, len);
+        hear->release_memory(bufs->second, field_len);
+        *bufs = {nullptr, nullptr};
+        return ret;
+    };
+}
+
+int HEAR_Iallreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype,
+                    MPI_Op op, MPI_Comm comm, int priority, HEAR_Request *request)
+{
+    auto job = std::make_shared<sched::Job>();
+    const char *src = static_cast<const char *>(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf);
+    char *dst = static_cast<char *>(recvbuf);
+    bool in_place = sendbuf == MPI_IN_PLACE;
+    const LinearOp *linear;
+    bool encrypted;
+    unsigned int k_n;
+    int block_size;
+    int dtype_size;
+
+    if (count < 0)
+        return MPI_ERR_COUNT;
+
+    MPI_Type_size(datatype, &dtype_size);
+    hear->lazy_wait(src, static_cast<std::size_t>(count) * dtype_size);
+    hear->lazy_wait(recvbuf, static_cast<std::size_t>(count) * dtype_size);
+
+    job->comm = comm;
+    job->priority = priority;
+    job->nblocks = 0;
+    *request = new HEAR_Request_s{job};
+
+#ifndef ALLREDUCE_BASELINE
+    linear = hear->linear_op(op, datatype);
+    encrypted = (linear || (((op == MPI_SUM) || (op == MPI_PROD)) &&
+                            ((datatype == MPI_INT) || (datatype == MPI_FLOAT)))) &&
+        hear->decision(comm).encrypted(static_cast<std::size_t>(count) * dtype_size);
+#else
+    linear = nullptr;
+    encrypted = false;
+#endif
+
+    /* not split into blocks */
+    if (encrypted && linear) {
+        if (count)
+            linear_job(*job, sendbuf, recvbuf, count, datatype, op, comm, *linear);
+        return hear->scheduler().post(job);
+    }
+    k_n = encrypted ? hear->stage_k_n(comm) : 0;
+    block_size = sched_block_size(hear->decision(comm), count, dtype_size);
+    job->nblocks = (count + block_size - 1) / block_size;
+
+    /*
+     * One buffer per block in flight. Blocks are en-/decrypted at times that
+     * differ between the ranks, so not with the node keystream, whose barrier
+     * the ranks of a node have to reach in the same order.
+     */
+    auto encr_blocks = std::make_shared<std::vector<void *>>(job->nblocks, nullptr);
+    auto block_count = [count, block_size](int b) { return std::min(block_size, count - b * block_size); };
+
+    job->prepare = [=](int b) {
+        if (!encrypted)
+            return MPI_SUCCESS;
+        (*encr_blocks)[b] = hear->encrypt_sendbuf(src + static_cast<std::size_t>(b) * block_size * dtype_size,
+                                                  b * block_size, block_count(b), datatype, op, comm, k_n, false);
+        return (*encr_blocks)[b] ? MPI_SUCCESS : MPI_ERR_BUFFER;
+    };
+    job->start = [=](int b, MPI_Comm channel, MPI_Request *req) {
+        std::size_t offset = static_cast<std::size_t>(b) * block_size * dtype_size;
+        const void *block = encrypted ? (*encr_blocks)[b] : in_place ? MPI_IN_PLACE : src + offset;
+
+        return PMPI_Iallreduce(block, dst + offset, block_count(b), datatype, op, channel, req);
+    };
+    job->finish = [=](int b) {
+        if (!encrypted)
+            return MPI_SUCCESS;
+        hear->release_memory((*encr_blocks)[b]);
+        (*encr_blocks)[b] = nullptr;
+        return hear->decrypt_recvbuf(dst + static_cast<std::size_t>(b) * block_size * dtype_size,
+                                     block_count(b), datatype, op, comm, k_n + b * block_size, false);
+    };
+
+    return hear->scheduler().post(job);
+}
+
+int HEAR_Test(HEAR_Request *request, int *flag)
+{
+    int ret;
+
+    hear->scheduler().progress();
+    /* as for MPI_REQUEST_NULL */
+    if (!*request) {
+        *flag = 1;
+        return MPI_SUCCESS;
+    }
+    *flag = (*request)->job->complete();
+    if (!*flag)
+        return MPI_SUCCESS;
+
+    ret = (*request)->job->error;
+    delete *request;
+    *request = nullptr;
+
+    return ret;
+}
+
+int HEAR_Wait(HEAR_Request *request)
+{
+    int ret;
+
+    /* completed by HEAR_Test */
+    if (!*request)
+        return MPI_SUCCESS;
+    ret = hear->scheduler().wait((*request)->job);
+
+    delete *request;
+    *request = nullptr;
+
+    return ret;
+}
+
+int HEAR_Waitall(int count, HEAR_Request requests[])
+{
+    int ret = MPI_SUCCESS;
+
+    for (int i = 0; i < count; i++) {
+        int req_ret = HEAR_Wait(&requests[i]);
+
+        if (ret == MPI_SUCCESS)
+            ret = req_ret;
+    }
+
+    return ret;
+}
+
+/*
+ * HEAR_TUNE_CACHE / HEAR_TUNE, see tune.hpp. The kernel is applied before
+ * MPI_COMM_WORLD is set up, so that its policy picks it up, the block size
+ * is calibrated after, with encrypted reductions on it.
+ */
+RANK_LOCAL std::string tune_key;
+RANK_LOCAL tune::Values tuned;
+RANK_LOCAL bool tune_calibrated = false;
+/* the cached block size is invalid, it is calibrated without HEAR_TUNE too */
+RANK_LOCAL bool tune_block_size = false;
+
+/* false where the cache has no valid value, the same on all ranks */
+static bool tuned_integer(const char *name, long long min, long long max, long long &value)
+{
+    if (!tuned.count(name))
+        return false;
+    if (tune::parse_integer(tuned[name], min, max, value))
+        return true;
+
+    std::cerr << "HEAR tune: ignoring " << name << "=" << tuned[name] << " from the cache, expected "
+              << min << " to " << max << std::endl;
+    return false;
+}
+
+static int load_tuning()
+{
+    const char *path = std::getenv("HEAR_TUNE_CACHE");
+    bool calibrate = std::getenv("HEAR_TUNE") != nullptr;
+    std::string text;
+    long long value;
+    long len;
+    int rank;
+    int ret;
+
+    if (!path && !calibrate)
+        return MPI_SUCCESS;
+
+    tune_key = tune::machine_key(MPI_COMM_WORLD);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (path && rank == root_rank) {
+        tune::Cache cache(path);
+        tune::Values values;
+
+        if (cache.load() && cache.lookup(tune_key, values))
+            text = tune::Cache::serialize(values);
+    }
+
+    len = text.size();
+    ret = PMPI_Bcast(&len, 1, MPI_LONG, root_rank, MPI_COMM_WORLD);
+    if (ret != MPI_SUCCESS)
+        return ret;
+    text.resize(len);
+    if (len && (ret = PMPI_Bcast(&text[0], len, MPI_CHAR, root_rank, MPI_COMM_WORLD)) != MPI_SUCCESS)
+        return ret;
+    tuned = tune::Cache::parse(text);
+
+    /* HEAR_ENABLE_JIT asks for a kernel explicitly */
+    if (!std::getenv("HEAR_ENABLE_JIT")) {
+        if (calibrate && !tuned.count("int_kernel")) {
+            tuned["int_kernel"] = hear->fastest_int_sum_kernel(MPI_COMM_WORLD);
+            tune_calibrated = true;
+        }
+        if (tuned.count("int_kernel") && !hear->set_int_sum_kernel(tuned["int_kernel"]))
+            std::cerr << "HEAR tune: int_kernel " << tuned["int_kernel"] << " is not available" << std::endl;
+    }
+
+#ifdef USE_PIPELINING
+    if (!std::getenv("HEAR_PIPELINING_BLOCK_SIZE")) {
+        if (tuned_integer("block_size", 1, std::numeric_limits<int>::max(), value))
+            pipelining_block_size = value;
+        else if (tuned.count("block_size"))
+            tune_block_size = true;
+    }
+#endif
+    if (!std::getenv("HEAR_NODE_KEYSTREAM_MIN_COUNT") &&
+        tuned_integer("node_keystream_min_count", 0, std::numeric_limits<int>::max(), value))
+        node_keystream_min_count = value;
+    if (!std::getenv("HEAR_LAZY_DECRYPT_MIN_BYTES") &&
+        tuned_integer("lazy_decrypt_min_bytes", 0, std::numeric_limits<long long>::max(), value))
+        lazy_decrypt_min_bytes = value;
+
+    return MPI_SUCCESS;
+}
+
+#ifdef USE_PIPELINING
+/* by the slowest rank, over a message large enough to pipeline with all candidates */
+static int fastest_block_size()
+{
+    static const int candidates[] = {16384, 65536, 262144, 1048576};
+    const int ncandidates = sizeof(candidates) / sizeof(candidates[0]);
+    const int count = 1 << 22;
+    const int reps = 3;
+    std::vector<int> sendbuf(count, 1), recvbuf(count);
+    std::vector<double> times(ncandidates), max_times(ncandidates);
+    int ret;
+
+    for (int c = 0; c < ncandidates; c++) {
+        pipelining_block_size = candidates[c];
+        times[c] = std::numeric_limits<double>::max();
+
+        for (int rep = 0; rep < reps; rep++) {
+            double start;
+
+            PMPI_Barrier(MPI_COMM_WORLD);
+            start = MPI_Wtime();
+            ret = allreduce(sendbuf.data(), recvbuf.data(), count, MPI_INT, MPI_SUM, MPI_COMM_WORLD,
+                            reinterpret_cast<void *>(fastest_block_size), nullptr, nullptr);
+            if (ret != MPI_SUCCESS)
+                return -1;
+            times[c] = std::min(times[c], MPI_Wtime() - start);
+        }
+    }
+
+    PMPI_Allreduce(times.data(), max_times.data(), ncandidates, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return candidates[std::min_element(max_times.begin(), max_times.end()) - max_times.begin()];
+}
 #endif
 
-#ifdef DCHECK
-    assert(!std::memcmp(valid_rbuf, recvbuf, dtype_size * count));
+static int finish_tuning()
+{
+    const char *path = std::getenv("HEAR_TUNE_CACHE");
+    int rank;
+
+#ifdef USE_PIPELINING
+    if (((std::getenv("HEAR_TUNE") && !tuned.count("block_size")) || tune_block_size) &&
+        !std::getenv("HEAR_PIPELINING_BLOCK_SIZE")) {
+        int block_size = fastest_block_size();
+
+        if (block_size < 0)
+            return MPI_ERR_OTHER;
+        pipelining_block_size = block_size;
+        tuned["block_size"] = std::to_string(block_size);
+        tune_calibrated = true;
+    }
 #endif
 
-    return MPI_SUCCESS;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (!tune_calibrated || !path || rank != root_rank)
+        return MPI_SUCCESS;
 
-cleanup:
-#ifdef DCHECK
-    delete[] reinterpret_cast<char *>(valid_rbuf);
-#endif
-    hear->release_memory(encr_sendbuf);
-    return ret;
+    /* other jobs may have added entries since load_tuning() */
+    tune::Cache cache(path);
+    cache.load();
+    cache.store(tune_key, tuned);
+    if (!cache.save())
+        std::cerr << "HEAR tune: could not write " << path << std::endl;
+
+    return MPI_SUCCESS;
 }
 
 static void alloc_state()
@@ -507,6 +2642,55 @@ static void alloc_state()
         pipelining_block_size = std::atoi(env);
 #endif
 
+#ifdef USE_JIT
+#ifdef USE_PIPELINING
+    jit_block_size = pipelining_block_size;
+#endif
+    if (const char* env = std::getenv("HEAR_JIT_UNROLL"))
+        jit_unroll = std::atoi(env);
+#endif
+
+    if (const char* env = std::getenv("HEAR_NODE_KEYSTREAM_MIN_COUNT"))
+        node_keystream_min_count = std::atoi(env);
+
+    if (const char* env = std::getenv("HEAR_NODE_KEYSTREAM_MAX_COUNT"))
+        node_keystream_max_count = std::atoi(env);
+
+    if (const char* env = std::getenv("HEAR_LAZY_DECRYPT_MIN_BYTES"))
+        lazy_decrypt_min_bytes = std::atoll(env);
+
+    if (const char* env = std::getenv("HEAR_IO_CHUNK_BYTES"))
+        io_chunk_bytes = std::atoll(env);
+
+    if (const char* env = std::getenv("HEAR_IO_THREADS"))
+        io_threads = std::atoi(env);
+
+    if (const char* env = std::getenv("HEAR_CRYPTO_THREADS"))
+        crypto_threads = std::atoi(env);
+
+    if (const char* env = std::getenv("HEAR_CRYPTO_GRAIN_BYTES"))
+        crypto_grain_bytes = std::atoll(env);
+
+    if (const char* env = std::getenv("HEAR_ALLTOALL_CHUNK_BYTES"))
+        alltoall_chunk_bytes = std::atoll(env);
+
+    if (const char* env = std::getenv("HEAR_SCHED_CHANNELS"))
+        sched_channels = std::atoi(env);
+
+#ifdef AESNI
+    /* before HearState, whose kernel selection checks the JIT kernels against this key schedule */
+    char encr_key[sizeof(prng_key)];
+
+    std::memcpy(encr_key, prng_key, sizeof(prng_key));
+#ifdef HEAR_SIMMPI
+    /* the key schedule is not rank-local, the simulated ranks load it once */
+    static std::once_flag key_loaded;
+    std::call_once(key_loaded, encryption::aesni128_load_key, encr_key);
+#else
+    encryption::aesni128_load_key(encr_key);
+#endif
+#endif
+
 #ifdef USE_MPOOL
     if (const char* env = std::getenv("HEAR_MPOOL_SIZE"))
         mpool_size = std::atoi(env);
@@ -520,11 +2704,6 @@ static void alloc_state()
     hear = new HearState();
     assert(hear);
 #endif
-
-#ifdef AESNI
-    char encr_key[] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
-    encryption::aesni128_load_key(encr_key);
-#endif
 }
 
 int MPI_Init(int *argc, char ***argv)
@@ -538,8 +2717,12 @@ int MPI_Init(int *argc, char ***argv)
 
     alloc_state();
 
+    if (ret == MPI_SUCCESS)
+        ret = load_tuning();
     if (ret == MPI_SUCCESS)
         ret = hear->insert_new_comm(MPI_COMM_WORLD);
+    if (ret == MPI_SUCCESS)
+        ret = finish_tuning();
 
     return ret;
 }
@@ -555,8 +2738,12 @@ int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
 
     alloc_state();
 
+    if (ret == MPI_SUCCESS)
+        ret = load_tuning();
     if (ret == MPI_SUCCESS)
         ret = hear->insert_new_comm(MPI_COMM_WORLD);
+    if (ret == MPI_SUCCESS)
+        ret = finish_tuning();
 
     return ret;
 }
@@ -570,7 +2757,7 @@ int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm)
 #endif
     ret = PMPI_Comm_create(comm, group, newcomm);
     if (ret == MPI_SUCCESS)
-        ret = hear->insert_new_comm(*newcomm);
+        ret = hear->insert_new_comm(*newcomm, comm);
 
     return ret;
 }
@@ -584,7 +2771,21 @@ int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm)
 #endif
     ret = PMPI_Comm_split(comm, color, key, newcomm);
     if (ret == MPI_SUCCESS)
-        ret = hear->insert_new_comm(*newcomm);
+        ret = hear->insert_new_comm(*newcomm, comm);
+
+    return ret;
+}
+
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm *newcomm)
+{
+    int ret;
+
+#ifdef DEBUG
+    std::cerr << "MPI_Comm_split_type() call interception" << std::endl;
+#endif
+    ret = PMPI_Comm_split_type(comm, split_type, key, info, newcomm);
+    if (ret == MPI_SUCCESS)
+        ret = hear->insert_new_comm(*newcomm, comm);
 
     return ret;
 }
@@ -598,11 +2799,495 @@ int MPI_Comm_dup(MPI_Comm comm, MPI_Comm * newcomm)
 #endif
     ret = PMPI_Comm_dup(comm, newcomm);
     if (ret == MPI_SUCCESS)
-        ret = hear->insert_new_comm(*newcomm);
+        ret = hear->insert_new_comm(*newcomm, comm);
+
+    return ret;
+}
+
+int MPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh)
+{
+    int ret;
+
+#ifdef DEBUG
+    std::cerr << "MPI_File_open() call interception" << std::endl;
+#endif
+    ret = PMPI_File_open(comm, filename, amode, info, fh);
+    if (ret == MPI_SUCCESS)
+        ret = hear->insert_new_file(*fh, comm, filename);
 
     return ret;
 }
 
+int MPI_File_close(MPI_File *fh)
+{
+#ifdef DEBUG
+    std::cerr << "MPI_File_close() call interception" << std::endl;
+#endif
+    hear->remove_file(*fh);
+
+    return PMPI_File_close(fh);
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                          MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_at_all(fh, offset, buf, count, datatype, status);
+    return hear->io_cipher().write_at(*file, fh, offset, buf, count, datatype, status, true);
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                         MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_at_all(fh, offset, buf, count, datatype, status);
+    return hear->io_cipher().read_at(*file, fh, offset, buf, count, datatype, status, true);
+}
+
+int MPI_File_write_all(MPI_File fh, const void *buf, int count,
+                       MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_all(fh, buf, count, datatype, status);
+    return hear->io_cipher().write(*file, fh, buf, count, datatype, status, true);
+}
+
+int MPI_File_read_all(MPI_File fh, void *buf, int count,
+                      MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_all(fh, buf, count, datatype, status);
+    return hear->io_cipher().read(*file, fh, buf, count, datatype, status, true);
+}
+
+/* independent access to the same files, so that it sees the same bytes */
+int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                      MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_at(fh, offset, buf, count, datatype, status);
+    return hear->io_cipher().write_at(*file, fh, offset, buf, count, datatype, status, false);
+}
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                     MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_at(fh, offset, buf, count, datatype, status);
+    return hear->io_cipher().read_at(*file, fh, offset, buf, count, datatype, status, false);
+}
+
+int MPI_File_write(MPI_File fh, const void *buf, int count,
+                   MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write(fh, buf, count, datatype, status);
+    return hear->io_cipher().write(*file, fh, buf, count, datatype, status, false);
+}
+
+int MPI_File_read(MPI_File fh, void *buf, int count,
+                  MPI_Datatype datatype, MPI_Status *status)
+{
+    const io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read(fh, buf, count, datatype, status);
+    return hear->io_cipher().read(*file, fh, buf, count, datatype, status, false);
+}
+
+/* the split collectives do everything in *_begin, which MPI allows */
+int MPI_File_write_at_all_begin(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                                MPI_Datatype datatype)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_at_all_begin(fh, offset, buf, count, datatype);
+    return hear->io_cipher().write_at(*file, fh, offset, buf, count, datatype, &file->split_status, true);
+}
+
+int MPI_File_write_at_all_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_at_all_end(fh, buf, status);
+    if (status != MPI_STATUS_IGNORE)
+        *status = file->split_status;
+    return MPI_SUCCESS;
+}
+
+int MPI_File_read_at_all_begin(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                               MPI_Datatype datatype)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_at_all_begin(fh, offset, buf, count, datatype);
+    return hear->io_cipher().read_at(*file, fh, offset, buf, count, datatype, &file->split_status, true);
+}
+
+int MPI_File_read_at_all_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_at_all_end(fh, buf, status);
+    if (status != MPI_STATUS_IGNORE)
+        *status = file->split_status;
+    return MPI_SUCCESS;
+}
+
+int MPI_File_write_all_begin(MPI_File fh, const void *buf, int count, MPI_Datatype datatype)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_all_begin(fh, buf, count, datatype);
+    return hear->io_cipher().write(*file, fh, buf, count, datatype, &file->split_status, true);
+}
+
+int MPI_File_write_all_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_write_all_end(fh, buf, status);
+    if (status != MPI_STATUS_IGNORE)
+        *status = file->split_status;
+    return MPI_SUCCESS;
+}
+
+int MPI_File_read_all_begin(MPI_File fh, void *buf, int count, MPI_Datatype datatype)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_all_begin(fh, buf, count, datatype);
+    return hear->io_cipher().read(*file, fh, buf, count, datatype, &file->split_status, true);
+}
+
+int MPI_File_read_all_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    io::File *file = hear->file(fh);
+
+    if (!file)
+        return PMPI_File_read_all_end(fh, buf, status);
+    if (status != MPI_STATUS_IGNORE)
+        *status = file->split_status;
+    return MPI_SUCCESS;
+}
+
+/*
+ * Encrypted files have no nonblocking, shared file pointer or ordered
+ * access. Passing these on would put plaintext into the file.
+ */
+static int unsupported_on_encrypted(const char *call)
+{
+    std::cerr << "HEAR io: " << call << " is not supported on encrypted files" << std::endl;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int MPI_File_iwrite_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                       MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iwrite_at(fh, offset, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iwrite_at");
+}
+
+int MPI_File_iread_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                      MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iread_at(fh, offset, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iread_at");
+}
+
+int MPI_File_iwrite_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                           MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iwrite_at_all(fh, offset, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iwrite_at_all");
+}
+
+int MPI_File_iread_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                          MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iread_at_all(fh, offset, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iread_at_all");
+}
+
+int MPI_File_iwrite(MPI_File fh, const void *buf, int count,
+                    MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iwrite(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iwrite");
+}
+
+int MPI_File_iread(MPI_File fh, void *buf, int count,
+                   MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iread(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iread");
+}
+
+int MPI_File_iwrite_all(MPI_File fh, const void *buf, int count,
+                        MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iwrite_all(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iwrite_all");
+}
+
+int MPI_File_iread_all(MPI_File fh, void *buf, int count,
+                       MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iread_all(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iread_all");
+}
+
+int MPI_File_write_shared(MPI_File fh, const void *buf, int count,
+                          MPI_Datatype datatype, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_write_shared(fh, buf, count, datatype, status);
+    return unsupported_on_encrypted("MPI_File_write_shared");
+}
+
+int MPI_File_read_shared(MPI_File fh, void *buf, int count,
+                         MPI_Datatype datatype, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_read_shared(fh, buf, count, datatype, status);
+    return unsupported_on_encrypted("MPI_File_read_shared");
+}
+
+int MPI_File_iwrite_shared(MPI_File fh, const void *buf, int count,
+                           MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iwrite_shared(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iwrite_shared");
+}
+
+int MPI_File_iread_shared(MPI_File fh, void *buf, int count,
+                          MPI_Datatype datatype, MPI_Request *request)
+{
+    if (!hear->file(fh))
+        return PMPI_File_iread_shared(fh, buf, count, datatype, request);
+    *request = MPI_REQUEST_NULL;
+    return unsupported_on_encrypted("MPI_File_iread_shared");
+}
+
+int MPI_File_write_ordered(MPI_File fh, const void *buf, int count,
+                           MPI_Datatype datatype, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_write_ordered(fh, buf, count, datatype, status);
+    return unsupported_on_encrypted("MPI_File_write_ordered");
+}
+
+int MPI_File_read_ordered(MPI_File fh, void *buf, int count,
+                          MPI_Datatype datatype, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_read_ordered(fh, buf, count, datatype, status);
+    return unsupported_on_encrypted("MPI_File_read_ordered");
+}
+
+int MPI_File_write_ordered_begin(MPI_File fh, const void *buf, int count, MPI_Datatype datatype)
+{
+    if (!hear->file(fh))
+        return PMPI_File_write_ordered_begin(fh, buf, count, datatype);
+    return unsupported_on_encrypted("MPI_File_write_ordered_begin");
+}
+
+int MPI_File_write_ordered_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_write_ordered_end(fh, buf, status);
+    return unsupported_on_encrypted("MPI_File_write_ordered_end");
+}
+
+int MPI_File_read_ordered_begin(MPI_File fh, void *buf, int count, MPI_Datatype datatype)
+{
+    if (!hear->file(fh))
+        return PMPI_File_read_ordered_begin(fh, buf, count, datatype);
+    return unsupported_on_encrypted("MPI_File_read_ordered_begin");
+}
+
+int MPI_File_read_ordered_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    if (!hear->file(fh))
+        return PMPI_File_read_ordered_end(fh, buf, status);
+    return unsupported_on_encrypted("MPI_File_read_ordered_end");
+}
+
+/*
+ * MPI_Alltoall(v), see alltoall.hpp. Communicators with a plaintext policy
+ * and derived datatypes with gaps are left to MPI. The datatypes may differ
+ * between ranks as long as their signatures match, so the ranks agree on
+ * the path, or some would post the exchange's point-to-point messages while
+ * others wait in PMPI_Alltoall.
+ */
+static bool encrypted_exchange(const void *sendbuf, MPI_Datatype sendtype, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    int contiguous, all_contiguous;
+
+    if (!hear->decision(comm).encrypt)
+        return false;
+
+    contiguous = io::is_contiguous(recvtype) && (sendbuf == MPI_IN_PLACE || io::is_contiguous(sendtype));
+    PMPI_Allreduce(&contiguous, &all_contiguous, 1, MPI_INT, MPI_MIN, comm);
+
+    return all_contiguous;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    alltoall::Exchange *exchange;
+    int send_size, recv_size;
+    int comm_size;
+    int ret;
+
+#ifdef DEBUG
+    std::cerr << "MPI_Alltoall() call interception" << std::endl;
+#endif
+    hear->scheduler().progress();
+    if (!encrypted_exchange(sendbuf, sendtype, recvtype, comm))
+        return PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+
+    ret = hear->exchange(comm, &exchange);
+    if (ret != MPI_SUCCESS)
+        return ret;
+
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Type_size(recvtype, &recv_size);
+    if (sendbuf == MPI_IN_PLACE) {
+        sendcount = recvcount;
+        send_size = recv_size;
+    } else {
+        MPI_Type_size(sendtype, &send_size);
+    }
+
+    std::vector<std::size_t> sendbytes(comm_size, static_cast<std::size_t>(sendcount) * send_size);
+    std::vector<std::size_t> recvbytes(comm_size, static_cast<std::size_t>(recvcount) * recv_size);
+    std::vector<std::size_t> sdispls(comm_size), rdispls(comm_size);
+
+    for (int rank = 0; rank < comm_size; rank++) {
+        sdispls[rank] = rank * sendbytes[rank];
+        rdispls[rank] = rank * recvbytes[rank];
+    }
+
+    if (sendbuf != MPI_IN_PLACE)
+        hear->lazy_wait(sendbuf, comm_size * sendbytes[0]);
+    hear->lazy_wait(recvbuf, comm_size * recvbytes[0]);
+
+    return exchange->alltoallv(sendbuf, sendbytes.data(), sdispls.data(),
+                               recvbuf, recvbytes.data(), rdispls.data(), hear->decision(comm));
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype,
+                  void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype,
+                  MPI_Comm comm)
+{
+    alltoall::Exchange *exchange;
+    std::size_t send_end = 0, recv_end = 0;
+    int send_size, recv_size;
+    int comm_size;
+    int ret;
+
+#ifdef DEBUG
+    std::cerr << "MPI_Alltoallv() call interception" << std::endl;
+#endif
+    hear->scheduler().progress();
+    if (!encrypted_exchange(sendbuf, sendtype, recvtype, comm))
+        return PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype,
+                              recvbuf, recvcounts, rdispls, recvtype, comm);
+
+    ret = hear->exchange(comm, &exchange);
+    if (ret != MPI_SUCCESS)
+        return ret;
+
+    MPI_Comm_size(comm, &comm_size);
+    MPI_Type_size(recvtype, &recv_size);
+    if (sendbuf == MPI_IN_PLACE) {
+        sendcounts = recvcounts;
+        sdispls = rdispls;
+        send_size = recv_size;
+    } else {
+        MPI_Type_size(sendtype, &send_size);
+    }
+
+    /* contiguous, the extents are the sizes */
+    std::vector<std::size_t> sendbytes(comm_size), recvbytes(comm_size);
+    std::vector<std::size_t> send_displs(comm_size), recv_displs(comm_size);
+
+    for (int rank = 0; rank < comm_size; rank++) {
+        sendbytes[rank] = static_cast<std::size_t>(sendcounts[rank]) * send_size;
+        send_displs[rank] = static_cast<std::size_t>(sdispls[rank]) * send_size;
+        recvbytes[rank] = static_cast<std::size_t>(recvcounts[rank]) * recv_size;
+        recv_displs[rank] = static_cast<std::size_t>(rdispls[rank]) * recv_size;
+        send_end = std::max(send_end, send_displs[rank] + sendbytes[rank]);
+        recv_end = std::max(recv_end, recv_displs[rank] + recvbytes[rank]);
+    }
+
+    if (sendbuf != MPI_IN_PLACE)
+        hear->lazy_wait(sendbuf, send_end);
+    hear->lazy_wait(recvbuf, recv_end);
+
+    return exchange->alltoallv(sendbuf, sendbytes.data(), send_displs.data(),
+                               recvbuf, recvbytes.data(), recv_displs.data(), hear->decision(comm));
+}
+
+int MPI_Comm_free(MPI_Comm *comm)
+{
+#ifdef DEBUG
+    std::cerr << "MPI_Comm_free() call interception" << std::endl;
+#endif
+    hear->remove_comm(*comm);
+
+    return PMPI_Comm_free(comm);
+}
+
+int HEAR_Get_comm_profile(HEAR_Comm_profile *profile)
+{
+    *profile = hear->comm_profile();
+    profile->bytes = hear->comm_bytes();
+
+    return MPI_SUCCESS;
+}
+
 int MPI_Finalize()
 {
 #ifdef DEBUG
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <climits>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "io.hpp"
+
+namespace io {
+
+#define IO_BLOCK_LEN 16
+
+/* below this per thread, starting the thread costs more than it saves */
+#define IO_MIN_THREAD_BYTES 65536
+
+/* MPI_File_get_view hands out copies of derived datatypes */
+static bool is_named(MPI_Datatype datatype)
+{
+    int nints, naddrs, ntypes, combiner;
+
+    PMPI_Type_get_envelope(datatype, &nints, &naddrs, &ntypes, &combiner);
+    return combiner == MPI_COMBINER_NAMED;
+}
+
+bool is_contiguous(MPI_Datatype datatype)
+{
+    int size;
+    MPI_Aint lb, extent, true_lb, true_extent;
+
+    PMPI_Type_size(datatype, &size);
+    PMPI_Type_get_extent(datatype, &lb, &extent);
+    PMPI_Type_get_true_extent(datatype, &true_lb, &true_extent);
+    return lb == 0 && true_lb == 0 && extent == size && true_extent == size;
+}
+
+struct Layout
+{
+    /* file position of the transfer's first byte */
+    MPI_Offset pos;
+    int etype_size;
+    int size;
+};
+
+static int get_layout(MPI_File fh, MPI_Offset offset, MPI_Datatype datatype, Layout &layout)
+{
+    MPI_Offset disp;
+    MPI_Datatype etype, filetype;
+    char datarep[MPI_MAX_DATAREP_STRING];
+    bool supported;
+
+    PMPI_File_get_view(fh, &disp, &etype, &filetype, datarep);
+    supported = !std::strcmp(datarep, "native") && is_contiguous(filetype) && is_contiguous(datatype);
+
+    PMPI_Type_size(etype, &layout.etype_size);
+    PMPI_Type_size(datatype, &layout.size);
+    layout.pos = disp + offset * layout.etype_size;
+
+    if (!is_named(etype))
+	PMPI_Type_free(&etype);
+    if (!is_named(filetype))
+	PMPI_Type_free(&filetype);
+
+    return supported && layout.size > 0 ? MPI_SUCCESS : MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+/*
+ * Ranks may need different numbers of chunks, the collective calls have to
+ * match. Where get_layout() failed on some ranks only, layout_ret, all of
+ * them return rather than the others waiting in the collective.
+ */
+static int get_nchunks(const File &file, int nlocal, int layout_ret, bool collective, int &nchunks)
+{
+    int local[2] = {nlocal, layout_ret != MPI_SUCCESS};
+    int agreed[2];
+    int ret;
+
+    nchunks = nlocal;
+    if (!collective)
+	return layout_ret;
+
+    ret = PMPI_Allreduce(local, agreed, 2, MPI_INT, MPI_MAX, file.comm);
+    if (ret != MPI_SUCCESS)
+	return ret;
+    nchunks = agreed[0];
+    if (layout_ret != MPI_SUCCESS)
+	return layout_ret;
+    return agreed[1] ? MPI_ERR_UNSUPPORTED_OPERATION : MPI_SUCCESS;
+}
+
+Cipher::Cipher(const cipher_key_t &key, int nthreads, std::size_t chunk_bytes)
+    : _key(key), _nthreads(std::max(nthreads, 1)), _chunk_bytes(chunk_bytes)
+{
+}
+
+bool Cipher::parse_key(const char *hex, cipher_key_t &key)
+{
+    if (std::strlen(hex) != 2 * IO_KEY_LEN)
+	return false;
+
+    for (int i = 0; i < 2 * IO_KEY_LEN; i++) {
+	char c = hex[i];
+	int nibble;
+
+	if (c >= '0' && c <= '9')
+	    nibble = c - '0';
+	else if (c >= 'a' && c <= 'f')
+	    nibble = c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+	    nibble = c - 'A' + 10;
+	else
+	    return false;
+
+	if (i % 2)
+	    key[i / 2] |= nibble;
+	else
+	    key[i / 2] = nibble << 4;
+    }
+
+    return true;
+}
+
+/* the name as given where the file cannot be resolved, e.g., because only rank 0 sees it yet */
+static std::string canonical_path(const char *filename)
+{
+    char resolved[PATH_MAX];
+    char cwd[PATH_MAX];
+
+    if (realpath(filename, resolved))
+	return resolved;
+    if (filename[0] == '/' || !getcwd(cwd, sizeof(cwd)))
+	return filename;
+    return std::string(cwd) + "/" + filename;
+}
+
+int Cipher::file_nonce(const char *filename, MPI_Comm comm, std::uint64_t &nonce)
+{
+    int rank;
+
+    PMPI_Comm_rank(comm, &rank);
+    if (!rank) {
+	std::string path = canonical_path(filename);
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	SHA256(reinterpret_cast<const unsigned char *>(path.data()), path.size(), digest);
+	std::memcpy(&nonce, digest, sizeof(nonce));
+    }
+
+    /* the ranks may see the file under different mount points */
+    return PMPI_Bcast(&nonce, sizeof(nonce), MPI_BYTE, 0, comm);
+}
+
+void Cipher::apply_range(unsigned char *dst, const unsigned char *src, std::size_t len,
+			 std::uint64_t nonce, std::uint64_t pos) const
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    unsigned char iv[IO_BLOCK_LEN];
+    unsigned char skip[IO_BLOCK_LEN] = {};
+    std::uint64_t block = pos / IO_BLOCK_LEN;
+    int out_len;
+
+    /* big-endian, OpenSSL increments the IV as one 128-bit number */
+    for (int i = 0; i < 8; i++) {
+	iv[7 - i] = nonce >> (8 * i);
+	iv[15 - i] = block >> (8 * i);
+    }
+
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, _key.data(), iv);
+    if (pos % IO_BLOCK_LEN)
+	EVP_EncryptUpdate(ctx, skip, &out_len, skip, pos % IO_BLOCK_LEN);
+
+    while (len) {
+	int n = std::min<std::size_t>(len, 1 << 30);
+
+	EVP_EncryptUpdate(ctx, dst, &out_len, src, n);
+	dst += n;
+	src += n;
+	len -= n;
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+void Cipher::apply(void *dst, const void *src, std::size_t len, std::uint64_t nonce, std::uint64_t pos) const
+{
+    unsigned char *d = static_cast<unsigned char *>(dst);
+    const unsigned char *s = static_cast<const unsigned char *>(src);
+    std::vector<std::thread> threads;
+    std::size_t share = (len / _nthreads + IO_BLOCK_LEN - 1) / IO_BLOCK_LEN * IO_BLOCK_LEN;
+
+    if (!len)
+	return;
+
+    share = std::max<std::size_t>(share, IO_MIN_THREAD_BYTES);
+    for (std::size_t begin = share; begin < len; begin += share)
+	threads.emplace_back(&Cipher::apply_range, this, d + begin, s + begin,
+			     std::min(share, len - begin), nonce, pos + begin);
+    apply_range(d, s, std::min(share, len), nonce, pos);
+
+    for (auto &thread : threads)
+	thread.join();
+}
+
+/* chunks start at whole etypes, the offsets of the explicit-offset calls count etypes */
+static int chunk_elems(const Layout &layout, std::size_t chunk_bytes)
+{
+    int align = layout.etype_size / std::gcd(layout.size, layout.etype_size);
+    std::size_t elems = chunk_bytes / layout.size / align * align;
+
+    return std::min<std::size_t>(std::max<std::size_t>(elems, align), INT_MAX / align * align);
+}
+
+/* chunk i of a transfer, zero elements past the end of this rank's part */
+static int chunk_count(int i, int elems, int count)
+{
+    return std::max(0, std::min(elems, count - i * elems));
+}
+
+int Cipher::write_at(const File &file, MPI_File fh, MPI_Offset offset, const void *buf, int count,
+		     MPI_Datatype datatype, MPI_Status *status, bool collective) const
+{
+    const unsigned char *src = static_cast<const unsigned char *>(buf);
+    std::unique_ptr<unsigned char[]> scratch;
+    std::future<void> encrypted;
+    Layout layout;
+    MPI_Count written = 0;
+    int elems, nlocal, nchunks;
+    std::size_t chunk_len;
+    int ret;
+
+    ret = get_layout(fh, offset, datatype, layout);
+    if (ret == MPI_SUCCESS) {
+	elems = chunk_elems(layout, _chunk_bytes);
+	nlocal = count / elems + (count % elems != 0);
+    } else {
+	elems = nlocal = 0;
+    }
+    ret = get_nchunks(file, nlocal, ret, collective, nchunks);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    /* double-buffered, chunk i + 1 is encrypted while chunk i is written */
+    chunk_len = static_cast<std::size_t>(std::min(count, elems)) * layout.size;
+    scratch.reset(new unsigned char[2 * chunk_len]);
+    if (nlocal)
+	apply(scratch.get(), src, chunk_len, file.nonce, layout.pos);
+
+    for (int i = 0; i < nchunks; i++) {
+	std::size_t begin = static_cast<std::size_t>(i) * elems * layout.size;
+	std::size_t next = begin + static_cast<std::size_t>(elems) * layout.size;
+	MPI_Offset at = offset + static_cast<MPI_Offset>(begin / layout.etype_size);
+	MPI_Status chunk_status;
+	int done;
+
+	if (i + 1 < nlocal)
+	    encrypted = std::async(std::launch::async, &Cipher::apply, this,
+				   scratch.get() + ((i + 1) % 2) * chunk_len, src + next,
+				   chunk_count(i + 1, elems, count) * static_cast<std::size_t>(layout.size),
+				   file.nonce, layout.pos + next);
+
+	if (collective)
+	    ret = PMPI_File_write_at_all(fh, at, scratch.get() + (i % 2) * chunk_len,
+					 chunk_count(i, elems, count), datatype, &chunk_status);
+	else
+	    ret = PMPI_File_write_at(fh, at, scratch.get() + (i % 2) * chunk_len,
+				     chunk_count(i, elems, count), datatype, &chunk_status);
+
+	if (encrypted.valid())
+	    encrypted.get();
+	if (ret != MPI_SUCCESS)
+	    return ret;
+
+	PMPI_Get_count(&chunk_status, datatype, &done);
+	if (done != MPI_UNDEFINED)
+	    written += static_cast<MPI_Count>(done) * layout.size;
+    }
+
+    if (status != MPI_STATUS_IGNORE)
+	PMPI_Status_set_elements_x(status, MPI_BYTE, written);
+
+    return MPI_SUCCESS;
+}
+
+int Cipher::read_at(const File &file, MPI_File fh, MPI_Offset offset, void *buf, int count,
+		    MPI_Datatype datatype, MPI_Status *status, bool collective) const
+{
+    unsigned char *dst = static_cast<unsigned char *>(buf);
+    std::future<void> decrypted;
+    Layout layout;
+    MPI_Count read = 0;
+    int elems, nlocal, nchunks;
+    int ret;
+
+    ret = get_layout(fh, offset, datatype, layout);
+    if (ret == MPI_SUCCESS) {
+	elems = chunk_elems(layout, _chunk_bytes);
+	nlocal = count / elems + (count % elems != 0);
+    } else {
+	elems = nlocal = 0;
+    }
+    ret = get_nchunks(file, nlocal, ret, collective, nchunks);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    /* chunk i - 1 is decrypted in place while chunk i is read */
+    for (int i = 0; i < nchunks; i++) {
+	std::size_t begin = static_cast<std::size_t>(i) * elems * layout.size;
+	int n = chunk_count(i, elems, count);
+	MPI_Offset at = offset + static_cast<MPI_Offset>(begin / layout.etype_size);
+	MPI_Status chunk_status;
+	int done;
+
+	if (collective)
+	    ret = PMPI_File_read_at_all(fh, at, n ? dst + begin : dst, n, datatype, &chunk_status);
+	else
+	    ret = PMPI_File_read_at(fh, at, n ? dst + begin : dst, n, datatype, &chunk_status);
+
+	if (decrypted.valid())
+	    decrypted.get();
+	if (ret != MPI_SUCCESS)
+	    return ret;
+
+	/* short at the end of the file */
+	PMPI_Get_count(&chunk_status, datatype, &done);
+	if (done == MPI_UNDEFINED || done <= 0)
+	    continue;
+	decrypted = std::async(std::launch::async, &Cipher::apply, this, dst + begin, dst + begin,
+			       static_cast<std::size_t>(done) * layout.size, file.nonce, layout.pos + begin);
+	read += static_cast<MPI_Count>(done) * layout.size;
+    }
+
+    if (decrypted.valid())
+	decrypted.get();
+
+    if (status != MPI_STATUS_IGNORE)
+	PMPI_Status_set_elements_x(status, MPI_BYTE, read);
+
+    return MPI_SUCCESS;
+}
+
+/* by what was transferred, which is short where a read reaches the end of the file */
+static int advance(MPI_File fh, MPI_Offset offset, MPI_Datatype datatype, const MPI_Status &transferred)
+{
+    Layout layout;
+    int done;
+
+    get_layout(fh, offset, datatype, layout);
+    PMPI_Get_count(&transferred, datatype, &done);
+    if (done == MPI_UNDEFINED || done <= 0)
+	return MPI_SUCCESS;
+    return PMPI_File_seek(fh, static_cast<MPI_Offset>(done) * layout.size / layout.etype_size, MPI_SEEK_CUR);
+}
+
+int Cipher::write(const File &file, MPI_File fh, const void *buf, int count,
+		  MPI_Datatype datatype, MPI_Status *status, bool collective) const
+{
+    MPI_Status transferred;
+    MPI_Offset offset;
+    int ret;
+
+    PMPI_File_get_position(fh, &offset);
+    ret = write_at(file, fh, offset, buf, count, datatype, &transferred, collective);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    if (status != MPI_STATUS_IGNORE)
+	*status = transferred;
+    return advance(fh, offset, datatype, transferred);
+}
+
+int Cipher::read(const File &file, MPI_File fh, void *buf, int count,
+		 MPI_Datatype datatype, MPI_Status *status, bool collective) const
+{
+    MPI_Status transferred;
+    MPI_Offset offset;
+    int ret;
+
+    PMPI_File_get_position(fh, &offset);
+    ret = read_at(file, fh, offset, buf, count, datatype, &transferred, collective);
+    if (ret != MPI_SUCCESS)
+	return ret;
+
+    if (status != MPI_STATUS_IGNORE)
+	*status = transferred;
+    return advance(fh, offset, datatype, transferred);
+}
+
+}
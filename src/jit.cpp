@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "encrypt.hpp"
+#include "jit.hpp"
+
+#ifdef AESNI
+
+namespace jit {
+
+#define JIT_KEY_ROUNDS 11
+#define JIT_NUM_VREGS 16
+#define JIT_MAX_UNROLL 8
+#define JIT_CODE_SIZE 16384
+#define JIT_VALIDATION_ITERS 3
+
+/* general purpose registers, System V argument order: rdi, rsi, rdx, rcx, r8, r9 */
+enum { RCX = 1, RDX = 2, RSP = 4, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10 };
+
+/* VEX opcode maps and implied prefixes */
+enum { MAP_0F = 1, MAP_0F38 = 2 };
+enum { PP_NONE = 0, PP_66 = 1, PP_F3 = 2 };
+
+class Assembler
+{
+
+private:
+
+    std::vector<unsigned char> _code;
+
+    void vex(int map, int pp, int L, int reg, int vvvv, int rm)
+    {
+	byte(0xC4);
+	byte((((~reg >> 3) & 1) << 7) | (1 << 6) | (((~rm >> 3) & 1) << 5) | map);
+	byte((((~vvvv) & 0xF) << 3) | (L << 2) | pp);
+    }
+
+    void mem(int reg, int base, int disp)
+    {
+	byte(0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == RSP)
+	    byte(0x24);
+	dword(disp);
+    }
+
+public:
+
+    void byte(unsigned char b) { _code.push_back(b); }
+    void dword(std::uint32_t v) { for (int i = 0; i < 4; i++) byte(v >> (8 * i)); }
+    void qword(std::uint64_t v) { for (int i = 0; i < 8; i++) byte(v >> (8 * i)); }
+
+    std::size_t size() const { return _code.size(); }
+    const unsigned char* data() const { return _code.data(); }
+
+    void patch_rel32(std::size_t at, std::size_t target)
+    {
+	std::uint32_t rel = static_cast<std::uint32_t>(target - (at + 4));
+	std::memcpy(&_code[at], &rel, sizeof(rel));
+    }
+
+    /* op dst, src1, src2 */
+    void vrrr(int map, int pp, int L, int op, int dst, int src1, int src2)
+    {
+	vex(map, pp, L, dst, src1, src2);
+	byte(op);
+	byte(0xC0 | ((dst & 7) << 3) | (src2 & 7));
+    }
+
+    /* op dst, src1, [base + disp], also stores with dst as the source */
+    void vrrm(int map, int pp, int L, int op, int dst, int src1, int base, int disp)
+    {
+	vex(map, pp, L, dst, src1, base);
+	byte(op);
+	mem(dst, base, disp);
+    }
+
+    void mov_imm64(int reg, std::uint64_t imm) { byte(0x48 | (reg >> 3)); byte(0xB8 | (reg & 7)); qword(imm); }
+    void add_imm32(int reg, std::uint32_t imm) { byte(0x48 | (reg >> 3)); byte(0x81); byte(0xC0 | (reg & 7)); dword(imm); }
+    void dec(int reg) { byte(0x48 | (reg >> 3)); byte(0xFF); byte(0xC8 | (reg & 7)); }
+    void test(int reg) { byte(0x48 | (reg >> 3) | (reg >> 3) << 2); byte(0x85); byte(0xC0 | (reg & 7) << 3 | (reg & 7)); }
+    std::size_t jz() { byte(0x0F); byte(0x84); dword(0); return size() - 4; }
+    std::size_t jnz() { byte(0x0F); byte(0x85); dword(0); return size() - 4; }
+    void frame_enter(std::uint32_t bytes, std::int8_t align)
+    {
+	byte(0x55);                                      /* push rbp */
+	byte(0x48); byte(0x89); byte(0xE5);              /* mov rbp, rsp */
+	byte(0x48); byte(0x81); byte(0xEC); dword(bytes); /* sub rsp, bytes */
+	byte(0x48); byte(0x83); byte(0xE4); byte(align);  /* and rsp, align */
+    }
+    void frame_leave() { byte(0xC9); }
+    void sfence() { byte(0x0F); byte(0xAE); byte(0xF8); }
+    void vzeroupper() { byte(0xC5); byte(0xF8); byte(0x77); }
+    void ret() { byte(0xC3); }
+
+};
+
+/* vector instructions, L selects ymm */
+#define VPXOR(a, L, d, s1, s2)	      (a).vrrr(MAP_0F, PP_66, L, 0xEF, d, s1, s2)
+#define VPXOR_M(a, L, d, s1, b, o)    (a).vrrm(MAP_0F, PP_66, L, 0xEF, d, s1, b, o)
+#define VPADDD_M(a, L, d, s1, b, o)   (a).vrrm(MAP_0F, PP_66, L, 0xFE, d, s1, b, o)
+#define VPSUBD(a, L, d, s1, s2)	      (a).vrrr(MAP_0F, PP_66, L, 0xFA, d, s1, s2)
+#define VAESENC(a, L, d, s1, s2, last)	(a).vrrr(MAP_0F38, PP_66, L, (last) ? 0xDD : 0xDC, d, s1, s2)
+#define VAESENC_M(a, L, d, s1, b, o, last) (a).vrrm(MAP_0F38, PP_66, L, (last) ? 0xDD : 0xDC, d, s1, b, o)
+#define VMOVDQU_LOAD(a, L, d, b, o)   (a).vrrm(MAP_0F, PP_F3, L, 0x6F, d, 0, b, o)
+#define VMOVDQA_LOAD(a, L, d, b, o)   (a).vrrm(MAP_0F, PP_66, L, 0x6F, d, 0, b, o)
+#define VMOVDQU_STORE(a, L, s, b, o)  (a).vrrm(MAP_0F, PP_F3, L, 0x7F, s, 0, b, o)
+#define VMOVDQA_STORE(a, L, s, b, o)  (a).vrrm(MAP_0F, PP_66, L, 0x7F, s, 0, b, o)
+#define VMOVNTDQ_STORE(a, L, s, b, o) (a).vrrm(MAP_0F, PP_66, L, 0xE7, s, 0, b, o)
+#define VMOVD_FROM_GPR(a, d, r)	      (a).vrrr(MAP_0F, PP_66, 0, 0x6E, d, 0, r)
+#define VPBROADCASTD(a, L, d, s)      (a).vrrr(MAP_0F38, PP_66, L, 0x58, d, 0, s)
+#define VBROADCASTI128(a, d, b, o)    (a).vrrm(MAP_0F38, PP_66, 1, 0x5A, d, 0, b, o)
+
+static int nstreams(Kind kind)
+{
+    return kind == ENCRYPT ? 2 : 1;
+}
+
+/* counters, one scratch register and one register per stream and unrolled vector */
+static bool key_fits_in_regs(Kind kind, int unroll)
+{
+    return nstreams(kind) * (unroll + 1) + 1 + JIT_KEY_ROUNDS <= JIT_NUM_VREGS;
+}
+
+static int max_unroll(Kind kind)
+{
+    return std::min(JIT_MAX_UNROLL, (JIT_NUM_VREGS - 1) / nstreams(kind) - 1);
+}
+
+/*
+ * Layout of the generated region: constants first (lane offsets, per
+ * unrolled vector offsets, loop increment, 32 bytes each), code after.
+ */
+static std::size_t emit_kernel(Assembler &as, const Spec &spec, std::uint64_t consts)
+{
+    const int L = spec.width == 8;
+    const int ns = nstreams(spec.kind);
+    const int step_bytes = spec.width * spec.unroll * sizeof(unsigned int);
+    const int vec_bytes = spec.width * sizeof(unsigned int);
+    const int scratch = ns;
+    const bool frame = !spec.key_in_regs && L;
+    auto tmp = [&](int s, int u) { return ns + 1 + s * spec.unroll + u; };
+    auto key_reg = [&](int r) { return JIT_NUM_VREGS - JIT_KEY_ROUNDS + r; };
+
+    as.mov_imm64(R10, consts);
+
+    /* round keys: registers, the caller's schedule, or a broadcast copy on the stack */
+    int key_base = R9, key_stride = 16;
+    if (spec.key_in_regs) {
+	for (int r = 0; r < JIT_KEY_ROUNDS; r++) {
+	    if (L)
+		VBROADCASTI128(as, key_reg(r), R9, 16 * r);
+	    else
+		VMOVDQU_LOAD(as, 0, key_reg(r), R9, 16 * r);
+	}
+    } else if (frame) {
+	as.frame_enter(32 * JIT_KEY_ROUNDS, -32);
+	for (int r = 0; r < JIT_KEY_ROUNDS; r++) {
+	    VBROADCASTI128(as, scratch, R9, 16 * r);
+	    VMOVDQA_STORE(as, 1, scratch, RSP, 32 * r);
+	}
+	key_base = RSP;
+	key_stride = 32;
+    }
+
+    auto aes_round = [&](int dst, int r) {
+	if (spec.key_in_regs)
+	    VAESENC(as, L, dst, dst, key_reg(r), r == JIT_KEY_ROUNDS - 1);
+	else
+	    VAESENC_M(as, L, dst, dst, key_base, key_stride * r, r == JIT_KEY_ROUNDS - 1);
+    };
+    auto whitening = [&](int dst, int src) {
+	if (spec.key_in_regs)
+	    VPXOR(as, L, dst, src, key_reg(0));
+	else
+	    VPXOR_M(as, L, dst, src, key_base, 0);
+    };
+
+    /* counters: ctr + lane */
+    VMOVD_FROM_GPR(as, 0, RCX);
+    VPBROADCASTD(as, L, 0, 0);
+    VPADDD_M(as, L, 0, 0, R10, 0);
+    if (ns == 2) {
+	VMOVD_FROM_GPR(as, 1, R8);
+	VPBROADCASTD(as, L, 1, 1);
+	VPADDD_M(as, L, 1, 1, R10, 0);
+    }
+
+    as.test(RDX);
+    std::size_t to_done = as.jz();
+    std::size_t loop = as.size();
+
+    for (int s = 0; s < ns; s++) {
+	for (int u = 0; u < spec.unroll; u++) {
+	    if (u == 0) {
+		whitening(tmp(s, u), s);
+	    } else {
+		VPADDD_M(as, L, tmp(s, u), s, R10, 32 * (1 + u));
+		whitening(tmp(s, u), tmp(s, u));
+	    }
+	}
+    }
+    /* round by round over all blocks in flight */
+    for (int r = 1; r < JIT_KEY_ROUNDS; r++)
+	for (int s = 0; s < ns; s++)
+	    for (int u = 0; u < spec.unroll; u++)
+		aes_round(tmp(s, u), r);
+
+    for (int u = 0; u < spec.unroll; u++) {
+	int res = tmp(0, u);
+
+	if (spec.kind == DECRYPT) {
+	    if (spec.variant == UNALIGNED)
+		VMOVDQU_LOAD(as, L, scratch, RSI, u * vec_bytes);
+	    else
+		VMOVDQA_LOAD(as, L, scratch, RSI, u * vec_bytes);
+	    VPSUBD(as, L, scratch, scratch, tmp(0, u));
+	    res = scratch;
+	} else {
+	    VPADDD_M(as, L, res, res, RSI, u * vec_bytes);
+	    if (spec.kind == ENCRYPT)
+		VPSUBD(as, L, res, res, tmp(1, u));
+	}
+
+	if (spec.variant == UNALIGNED)
+	    VMOVDQU_STORE(as, L, res, RDI, u * vec_bytes);
+	else if (spec.variant == ALIGNED)
+	    VMOVDQA_STORE(as, L, res, RDI, u * vec_bytes);
+	else
+	    VMOVNTDQ_STORE(as, L, res, RDI, u * vec_bytes);
+    }
+
+    for (int s = 0; s < ns; s++)
+	VPADDD_M(as, L, s, s, R10, 32 * (1 + spec.unroll));
+    as.add_imm32(RDI, step_bytes);
+    as.add_imm32(RSI, step_bytes);
+    as.dec(RDX);
+    as.patch_rel32(as.jnz(), loop);
+
+    as.patch_rel32(to_done, as.size());
+    if (spec.variant == ALIGNED_NT)
+	as.sfence();
+    as.vzeroupper();
+    if (frame)
+	as.frame_leave();
+    as.ret();
+
+    return as.size();
+}
+
+Kernels::Kernels(std::size_t block_size, int unroll, int width)
+    : _width(4), _unroll{}, _nt_threshold(0), _valid(false), _fns{}
+{
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("aes") || !__builtin_cpu_supports("avx2"))
+	return;
+    if (__builtin_cpu_supports("vaes") && width != 4)
+	_width = 8;
+
+    /* stores that would not stay in cache anyway bypass it */
+    long cache_size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (cache_size <= 0)
+	cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (cache_size > 0)
+	_nt_threshold = cache_size;
+
+    for (int k = 0; k < NKINDS; k++) {
+	Kind kind = static_cast<Kind>(k);
+
+	if (unroll > 0) {
+	    _unroll[k] = std::min(unroll, max_unroll(kind));
+	} else {
+	    /*
+	     * Largest unroll keeping the round keys in registers (reloading
+	     * them costs more than the extra blocks in flight gain) whose step
+	     * divides the pipelining block, so that pipelined blocks never
+	     * take the tail path.
+	     */
+	    _unroll[k] = 1;
+	    for (int u = max_unroll(kind); u > 1; u--) {
+		if (key_fits_in_regs(kind, u) && !(block_size % (u * _width))) {
+		    _unroll[k] = u;
+		    break;
+		}
+	    }
+	}
+
+	for (int v = 0; v < NVARIANTS; v++) {
+	    Spec spec = {kind, _width, _unroll[k], key_fits_in_regs(kind, _unroll[k]), static_cast<Variant>(v)};
+	    kernel_fn_t fn = generate(spec);
+
+	    if (!fn || !validate(spec, fn))
+		return;
+	    _fns[k][v] = fn;
+	}
+    }
+
+    _valid = true;
+}
+
+Kernels::~Kernels()
+{
+    for (auto &region : _regions)
+	munmap(region.first, region.second);
+}
+
+kernel_fn_t Kernels::generate(const Spec &spec)
+{
+    auto cached = _cache.find(spec);
+    if (cached != _cache.end())
+	return cached->second;
+
+    void *region = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+	return nullptr;
+    _regions.emplace_back(region, JIT_CODE_SIZE);
+
+    /* constants: lanes, vector offsets for each unrolled vector, loop step */
+    std::uint32_t *consts = reinterpret_cast<std::uint32_t *>(region);
+    std::size_t consts_size = 32 * (2 + spec.unroll);
+    for (int i = 0; i < 8; i++) {
+	consts[i] = i;
+	for (int u = 1; u < spec.unroll; u++)
+	    consts[8 * (1 + u) + i] = u * spec.width;
+	consts[8 * (1 + spec.unroll) + i] = spec.unroll * spec.width;
+    }
+
+    Assembler as;
+    std::size_t code_offset = (consts_size + 63) & ~std::size_t(63);
+    emit_kernel(as, spec, reinterpret_cast<std::uint64_t>(region));
+    if (code_offset + as.size() > JIT_CODE_SIZE)
+	return nullptr;
+    std::memcpy(static_cast<char *>(region) + code_offset, as.data(), as.size());
+
+    if (mprotect(region, JIT_CODE_SIZE, PROT_READ | PROT_EXEC))
+	return nullptr;
+
+    kernel_fn_t fn = reinterpret_cast<kernel_fn_t>(static_cast<char *>(region) + code_offset);
+    _cache[spec] = fn;
+    return fn;
+}
+
+/* bit-exact with the reference kernels, including counters wrapping around */
+bool Kernels::validate(const Spec &spec, kernel_fn_t fn)
+{
+    std::mt19937 gen(spec.kind * NVARIANTS + spec.variant);
+    std::size_t step = spec.width * spec.unroll;
+    std::size_t count = JIT_VALIDATION_ITERS * step;
+    std::size_t offset = spec.variant == UNALIGNED ? 1 : 0;
+    std::vector<unsigned int> k_s = {gen(), 0xfffffffc - static_cast<unsigned int>(step)};
+
+    std::size_t bufsize = (count + 64) * sizeof(unsigned int);
+    unsigned int *src = static_cast<unsigned int *>(_mm_malloc(bufsize, 64));
+    unsigned int *dst = static_cast<unsigned int *>(_mm_malloc(bufsize, 64));
+    unsigned int *ref = static_cast<unsigned int *>(_mm_malloc(bufsize, 64));
+
+    for (std::size_t i = 0; i < count + offset; i++)
+	src[i] = gen();
+
+    const void *key_schedule = encryption::aesni128_key_schedule();
+    if (spec.kind == DECRYPT) {
+	std::copy(src + offset, src + offset + count, ref);
+	encryption::decrypt_int_sum_aesni128(ref, count, k_s, 0);
+	fn(dst + offset, src + offset, JIT_VALIDATION_ITERS, k_s[0], 0, key_schedule);
+    } else {
+	std::copy(src + offset, src + offset + count, dst);
+	encryption::encrypt_int_sum_aesni128(ref, dst, count, 0, k_s, 0, spec.kind == ENCRYPT_EDGE);
+	fn(dst + offset, src + offset, JIT_VALIDATION_ITERS, k_s[0], k_s[1], key_schedule);
+    }
+
+    bool ok = !std::memcmp(dst + offset, ref, count * sizeof(unsigned int));
+
+    _mm_free(src);
+    _mm_free(dst);
+    _mm_free(ref);
+    return ok;
+}
+
+void Kernels::run(Kind kind, unsigned int *dst, const unsigned int *src, int count,
+		  unsigned int ctr1, unsigned int ctr2)
+{
+    std::size_t niters = count / (_width * _unroll[kind]);
+    std::uintptr_t addrs = reinterpret_cast<std::uintptr_t>(dst) | reinterpret_cast<std::uintptr_t>(src);
+    Variant variant = UNALIGNED;
+
+    if (!niters)
+	return;
+    if (!(addrs % (_width * sizeof(unsigned int))))
+	variant = count * sizeof(unsigned int) >= _nt_threshold && _nt_threshold ? ALIGNED_NT : ALIGNED;
+
+    _fns[kind][variant](dst, src, niters, ctr1, ctr2, encryption::aesni128_key_schedule());
+}
+
+/* the tail goes through the reference kernels on a copy, they round count up to 4 */
+void Kernels::encrypt_int_sum(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge)
+{
+    Kind kind = is_edge ? ENCRYPT_EDGE : ENCRYPT;
+    int done = count - count % (_width * _unroll[kind]);
+    alignas(32) unsigned int in[JIT_MAX_UNROLL * 8 + 4], out[JIT_MAX_UNROLL * 8 + 4];
+
+    run(kind, encr_sbuf, sbuf, count, k_n + k_s[rank], is_edge ? 0 : k_n + k_s[rank + 1]);
+
+    if (done < count) {
+	std::copy(sbuf + done, sbuf + count, in);
+	encryption::encrypt_int_sum_aesni128(out, in, count - done, rank, k_s, k_n + done, is_edge);
+	std::copy(out, out + (count - done), encr_sbuf + done);
+    }
+}
+
+void Kernels::decrypt_int_sum(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n)
+{
+    int done = count - count % (_width * _unroll[DECRYPT]);
+    alignas(32) unsigned int buf[JIT_MAX_UNROLL * 8 + 4];
+
+    run(DECRYPT, rbuf, rbuf, count, k_n + k_s[0], 0);
+
+    if (done < count) {
+	std::copy(rbuf + done, rbuf + count, buf);
+	encryption::decrypt_int_sum_aesni128(buf, count - done, k_s, k_n + done);
+	std::copy(buf, buf + (count - done), rbuf + done);
+    }
+}
+
+void Kernels::describe(std::ostream &os) const
+{
+    static const char *kinds[] = {"encrypt", "encrypt_edge", "decrypt"};
+
+    os << "jit: " << (_valid ? "enabled" : "disabled") << ", " << (_width == 8 ? "vaes ymm" : "aesni xmm");
+    for (int k = 0; k < NKINDS; k++)
+	os << ", " << kinds[k] << " unroll " << _unroll[k]
+	   << (key_fits_in_regs(static_cast<Kind>(k), _unroll[k]) ? " (keys in regs)" : "");
+    os << ", nt stores from " << _nt_threshold << " bytes";
+}
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include <cstring>
+#include <random>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "kdf.hpp"
+
+namespace kdf {
+
+/* domain separation between identifiers and keys */
+enum Label : unsigned char { WORLD_ID = 1, CHILD_ID, K_N, K_S, PAIR_KEY, PLUGIN_KEY };
+
+void KeyDerivation::hmac(const unsigned char *data, std::size_t len, unsigned char *out) const
+{
+    unsigned int out_len = KDF_ID_LEN;
+
+    HMAC(EVP_sha256(), _secret.data(), _secret.size(), data, len, out, &out_len);
+}
+
+secret_t KeyDerivation::random_secret()
+{
+    std::random_device device;
+    secret_t secret;
+
+    for (std::size_t i = 0; i < secret.size(); i += sizeof(unsigned int)) {
+	unsigned int word = device();
+	std::memcpy(&secret[i], &word, sizeof(word));
+    }
+
+    return secret;
+}
+
+comm_id_t KeyDerivation::world_id() const
+{
+    unsigned char label = WORLD_ID;
+    comm_id_t id;
+
+    hmac(&label, sizeof(label), id.data());
+    return id;
+}
+
+comm_id_t KeyDerivation::child_id(const comm_id_t &parent, unsigned long long seq,
+				  const std::vector<int> &parent_ranks) const
+{
+    std::vector<unsigned char> data(1 + KDF_ID_LEN + sizeof(seq) + parent_ranks.size() * sizeof(int));
+    unsigned char *p = data.data();
+    comm_id_t id;
+
+    *p++ = CHILD_ID;
+    std::memcpy(p, parent.data(), KDF_ID_LEN);
+    p += KDF_ID_LEN;
+    std::memcpy(p, &seq, sizeof(seq));
+    p += sizeof(seq);
+    std::memcpy(p, parent_ranks.data(), parent_ranks.size() * sizeof(int));
+
+    hmac(data.data(), data.size(), id.data());
+    return id;
+}
+
+unsigned int KeyDerivation::k_n(const comm_id_t &id) const
+{
+    unsigned char data[1 + KDF_ID_LEN];
+    unsigned char out[KDF_ID_LEN];
+    unsigned int key;
+
+    data[0] = K_N;
+    std::memcpy(data + 1, id.data(), KDF_ID_LEN);
+    hmac(data, sizeof(data), out);
+    std::memcpy(&key, out, sizeof(key));
+    return key;
+}
+
+unsigned int KeyDerivation::k_s(const comm_id_t &id, int rank) const
+{
+    unsigned char data[1 + KDF_ID_LEN + sizeof(int)];
+    unsigned char out[KDF_ID_LEN];
+    unsigned int key;
+
+    data[0] = K_S;
+    std::memcpy(data + 1, id.data(), KDF_ID_LEN);
+    std::memcpy(data + 1 + KDF_ID_LEN, &rank, sizeof(rank));
+    hmac(data, sizeof(data), out);
+    std::memcpy(&key, out, sizeof(key));
+    return key;
+}
+
+pair_key_t KeyDerivation::pair_key(const comm_id_t &id, int src, int dst) const
+{
+    unsigned char data[1 + KDF_ID_LEN + 2 * sizeof(int)];
+    unsigned char out[KDF_ID_LEN];
+    pair_key_t key;
+
+    data[0] = PAIR_KEY;
+    std::memcpy(data + 1, id.data(), KDF_ID_LEN);
+    std::memcpy(data + 1 + KDF_ID_LEN, &src, sizeof(src));
+    std::memcpy(data + 1 + KDF_ID_LEN + sizeof(src), &dst, sizeof(dst));
+    hmac(data, sizeof(data), out);
+    std::memcpy(key.data(), out, key.size());
+    return key;
+}
+
+plugin_key_t KeyDerivation::plugin_key() const
+{
+    unsigned char label = PLUGIN_KEY;
+    plugin_key_t key;
+
+    hmac(&label, sizeof(label), key.data());
+    return key;
+}
+
+}
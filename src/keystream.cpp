@@ -0,0 +1,66 @@
+#include <cassert>
+
+#include "keystream.hpp"
+
+namespace keystream {
+
+NodeKeystream::NodeKeystream(MPI_Comm node_comm, std::size_t capacity)
+    : _node_comm(node_comm), _generation(-1), _ctr(0), _count(0)
+{
+    MPI_Aint win_size;
+    int disp_unit;
+    void *base;
+
+    MPI_Comm_rank(_node_comm, &_node_rank);
+    MPI_Comm_size(_node_comm, &_node_size);
+
+    /* kernels work on blocks of 4 elements */
+    _capacity = (capacity + 3) & ~static_cast<std::size_t>(3);
+    win_size = _node_rank == 0 ? 2 * _capacity * sizeof(unsigned int) : 0;
+
+    MPI_Win_allocate_shared(win_size, sizeof(unsigned int), MPI_INFO_NULL,
+			    _node_comm, &base, &_win);
+    MPI_Win_shared_query(_win, 0, &win_size, &disp_unit, &base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, _win);
+
+    _bufs[0] = static_cast<unsigned int *>(base);
+    _bufs[1] = _bufs[0] + _capacity;
+}
+
+NodeKeystream::~NodeKeystream()
+{
+    MPI_Win_unlock_all(_win);
+    MPI_Win_free(&_win);
+    PMPI_Comm_free(&_node_comm);
+}
+
+const unsigned int* NodeKeystream::get(unsigned int ctr, int count, const fill_fn_t &fill)
+{
+    std::size_t nblocks, lo, hi;
+    unsigned int *buf;
+
+    assert(static_cast<std::size_t>(count) <= _capacity);
+
+    /* all node ranks issue the same sequence of calls, so hits agree */
+    if (_generation >= 0 && ctr == _ctr && count <= _count)
+	return _bufs[_generation % 2];
+
+    _generation++;
+    _ctr = ctr;
+    _count = count;
+    buf = _bufs[_generation % 2];
+
+    nblocks = (static_cast<std::size_t>(count) + 3) / 4;
+    lo = nblocks * _node_rank / _node_size;
+    hi = nblocks * (_node_rank + 1) / _node_size;
+    if (hi > lo)
+	fill(buf + 4 * lo, static_cast<int>(4 * (hi - lo)), ctr + static_cast<unsigned int>(4 * lo));
+
+    MPI_Win_sync(_win);
+    PMPI_Barrier(_node_comm);
+    MPI_Win_sync(_win);
+
+    return buf;
+}
+
+}
@@ -0,0 +1,361 @@
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <linux/userfaultfd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lazy.hpp"
+
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4
+#endif
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+#define LAZY_FAULT_BATCH 16
+
+namespace lazy {
+
+static int open_userfaultfd()
+{
+    struct uffdio_api api;
+    int fd;
+
+    /* user mode only where the kernel faults need a privilege we do not have */
+    fd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+	fd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (fd < 0)
+	return -1;
+
+    std::memset(&api, 0, sizeof(api));
+    api.api = UFFD_API;
+    if (ioctl(fd, UFFDIO_API, &api) < 0) {
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+Decryptor::Decryptor()
+    : _page_size(sysconf(_SC_PAGESIZE)), _next_seq(0), _stop(false)
+{
+    for (auto &region : _regions) {
+	region.state.store(FREE);
+	region.users.store(0);
+	region.pages = nullptr;
+    }
+
+    _uffd = open_userfaultfd();
+    _stop_fd = _uffd < 0 ? -1 : eventfd(0, EFD_CLOEXEC);
+    if (_stop_fd < 0 && _uffd >= 0) {
+	close(_uffd);
+	_uffd = -1;
+    }
+    if (_uffd < 0)
+	return;
+
+    _worker = std::thread(&Decryptor::work, this);
+    _fault_thread = std::thread(&Decryptor::serve_faults, this);
+}
+
+Decryptor::~Decryptor()
+{
+    std::uint64_t one = 1;
+
+    if (_uffd < 0)
+	return;
+
+    wait_all();
+
+    {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stop = true;
+    }
+    _cv.notify_all();
+    _worker.join();
+
+    if (write(_stop_fd, &one, sizeof(one)) != sizeof(one))
+	std::cerr << "HEAR lazy: cannot stop the fault thread: " << std::strerror(errno) << std::endl;
+    else
+	_fault_thread.join();
+
+    close(_stop_fd);
+    close(_uffd);
+}
+
+/* maps a page that is not (or no longer) ours to decrypt as zeros, or wakes whoever waits for it */
+static void fill_page(int uffd, char *addr, std::size_t page_size)
+{
+    struct uffdio_zeropage zero;
+    struct uffdio_range range;
+
+    zero.range.start = reinterpret_cast<std::uintptr_t>(addr);
+    zero.range.len = page_size;
+    zero.mode = 0;
+    if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) == 0 || errno != EEXIST)
+	return;
+
+    range = zero.range;
+    ioctl(uffd, UFFDIO_WAKE, &range);
+}
+
+bool Decryptor::decrypt_page(Region &region, std::size_t page)
+{
+    unsigned char expected = ENCRYPTED;
+    char *cipher = region.cipher + page * _page_size;
+    struct uffdio_copy copy;
+
+    if (!region.pages[page].compare_exchange_strong(expected, BUSY, std::memory_order_acq_rel))
+	return false;
+
+    region.decrypt(cipher, page);
+
+    copy.dst = reinterpret_cast<std::uintptr_t>(region.base + page * _page_size);
+    copy.src = reinterpret_cast<std::uintptr_t>(cipher);
+    copy.len = _page_size;
+    copy.mode = 0;
+    copy.copy = 0;
+    while (ioctl(_uffd, UFFDIO_COPY, &copy) < 0) {
+	if (errno == EAGAIN) {
+	    copy.copy = 0;
+	    continue;
+	}
+	/* unmapped, or mapped anew by the application: the buffer is gone */
+	if (errno == ENOENT || errno == ESRCH)
+	    break;
+	if (errno == EEXIST) {
+	    fill_page(_uffd, region.base + page * _page_size, _page_size);
+	    break;
+	}
+	std::cerr << "HEAR lazy: cannot map a decrypted page: " << std::strerror(errno)
+		  << ", it reads as zeros" << std::endl;
+	fill_page(_uffd, region.base + page * _page_size, _page_size);
+	break;
+    }
+
+    region.pages[page].store(DONE, std::memory_order_release);
+    region.remaining.fetch_sub(1, std::memory_order_acq_rel);
+
+    return true;
+}
+
+void Decryptor::resolve_fault(char *addr)
+{
+    char *page_addr = reinterpret_cast<char *>(reinterpret_cast<std::uintptr_t>(addr) & ~(_page_size - 1));
+
+    for (auto &region : _regions) {
+	if (region.state.load(std::memory_order_acquire) != ACTIVE)
+	    continue;
+
+	/* the slot cannot be retired while users > 0 */
+	region.users.fetch_add(1, std::memory_order_acq_rel);
+	if (region.state.load(std::memory_order_acquire) == ACTIVE &&
+	    page_addr >= region.base && page_addr < region.base + region.npages * _page_size) {
+	    std::size_t page = (page_addr - region.base) / _page_size;
+
+	    /*
+	     * UFFDIO_COPY wakes the waiters of a page, so a busy one is left
+	     * to whoever decrypts it. One that is done already was given back
+	     * with madvise since, or raced with the copy.
+	     */
+	    if (!decrypt_page(region, page) && region.pages[page].load(std::memory_order_acquire) == DONE)
+		fill_page(_uffd, page_addr, _page_size);
+	    region.users.fetch_sub(1, std::memory_order_acq_rel);
+	    return;
+	}
+	region.users.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    /* a region that is being added or was just retired, the access is retried */
+    fill_page(_uffd, page_addr, _page_size);
+}
+
+void Decryptor::serve_faults()
+{
+    struct pollfd fds[2] = {{_uffd, POLLIN, 0}, {_stop_fd, POLLIN, 0}};
+    struct uffd_msg msgs[LAZY_FAULT_BATCH];
+
+    while (true) {
+	ssize_t len;
+
+	if (poll(fds, 2, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    std::cerr << "HEAR lazy: poll on the userfaultfd failed: " << std::strerror(errno) << std::endl;
+	    return;
+	}
+	if (fds[1].revents)
+	    return;
+
+	len = read(_uffd, msgs, sizeof(msgs));
+	if (len < 0) {
+	    if (errno == EAGAIN || errno == EINTR)
+		continue;
+	    std::cerr << "HEAR lazy: reading the userfaultfd failed: " << std::strerror(errno) << std::endl;
+	    return;
+	}
+
+	for (std::size_t i = 0; i < len / sizeof(msgs[0]); i++) {
+	    if (msgs[i].event == UFFD_EVENT_PAGEFAULT)
+		resolve_fault(reinterpret_cast<char *>(msgs[i].arg.pagefault.address));
+	}
+    }
+}
+
+bool Decryptor::overlaps(Region &region, const char *begin, const char *end) const
+{
+    return region.state.load(std::memory_order_acquire) != FREE &&
+	begin < region.base + region.npages * _page_size && end > region.base;
+}
+
+/* with _mutex held, once every page of region is decrypted */
+void Decryptor::retire(Region &region)
+{
+    struct uffdio_range range;
+
+    region.state.store(RETIRING, std::memory_order_release);
+    while (region.users.load(std::memory_order_acquire))
+	;
+
+    /* fails where the application has unmapped the range meanwhile, which unregistered it */
+    range.start = reinterpret_cast<std::uintptr_t>(region.base);
+    range.len = region.npages * _page_size;
+    ioctl(_uffd, UFFDIO_UNREGISTER, &range);
+
+    munmap(region.cipher, region.npages * _page_size);
+    delete[] region.pages;
+    region.pages = nullptr;
+    region.decrypt = nullptr;
+    region.state.store(FREE, std::memory_order_release);
+}
+
+bool Decryptor::add(void *base, std::size_t npages, decrypt_fn_t decrypt)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::size_t len = npages * _page_size;
+    struct uffdio_register reg;
+    void *cipher;
+
+    assert(!(reinterpret_cast<std::uintptr_t>(base) % _page_size));
+
+    if (_uffd < 0)
+	return false;
+
+    for (auto &region : _regions) {
+	if (region.state.load(std::memory_order_acquire) != FREE)
+	    continue;
+
+	/* the pages are still there, nothing faults until they are moved out */
+	reg.range.start = reinterpret_cast<std::uintptr_t>(base);
+	reg.range.len = len;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(_uffd, UFFDIO_REGISTER, &reg) < 0)
+	    return false;
+
+	cipher = mremap(base, len, len, MREMAP_MAYMOVE | MREMAP_DONTUNMAP);
+	if (cipher == MAP_FAILED) {
+	    ioctl(_uffd, UFFDIO_UNREGISTER, &reg.range);
+	    return false;
+	}
+
+	region.base = static_cast<char *>(base);
+	region.cipher = static_cast<char *>(cipher);
+	region.npages = npages;
+	region.remaining.store(npages);
+	region.pages = new std::atomic<unsigned char>[npages];
+	for (std::size_t page = 0; page < npages; page++)
+	    region.pages[page].store(ENCRYPTED, std::memory_order_relaxed);
+	region.decrypt = std::move(decrypt);
+	region.seq = _next_seq++;
+
+	region.state.store(ACTIVE, std::memory_order_release);
+	_cv.notify_all();
+	return true;
+    }
+
+    return false;
+}
+
+void Decryptor::wait(const void *buf, std::size_t len)
+{
+    const char *begin = static_cast<const char *>(buf);
+    const char *end = begin + len;
+
+    for (auto &region : _regions) {
+	if (!overlaps(region, begin, end))
+	    continue;
+
+	/* faster than waiting for the worker to get here */
+	region.users.fetch_add(1, std::memory_order_acq_rel);
+	if (region.state.load(std::memory_order_acquire) == ACTIVE) {
+	    for (std::size_t page = 0; page < region.npages; page++)
+		decrypt_page(region, page);
+	}
+	region.users.fetch_sub(1, std::memory_order_acq_rel);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cv.wait(lock, [&] { return !overlaps(region, begin, end); });
+    }
+}
+
+void Decryptor::wait_all()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _cv.wait(lock, [&] {
+	for (auto &region : _regions) {
+	    if (region.state.load(std::memory_order_acquire) != FREE)
+		return false;
+	}
+	return true;
+    });
+}
+
+void Decryptor::work()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+	Region *next = nullptr;
+
+	/* oldest region first, the consumer most likely reads it next */
+	for (auto &region : _regions) {
+	    if (region.state.load(std::memory_order_acquire) == ACTIVE && (!next || region.seq < next->seq))
+		next = &region;
+	}
+
+	if (!next) {
+	    if (_stop)
+		return;
+	    _cv.wait(lock);
+	    continue;
+	}
+
+	/* pages are decrypted without the lock, add() may run meanwhile */
+	lock.unlock();
+	for (std::size_t page = 0; page < next->npages; page++)
+	    decrypt_page(*next, page);
+	/* pages claimed by the fault thread or a waiter */
+	while (next->remaining.load(std::memory_order_acquire))
+	    std::this_thread::yield();
+	lock.lock();
+
+	retire(*next);
+	_cv.notify_all();
+    }
+}
+
+}
@@ -31,21 +31,22 @@ SbufMpool::~SbufMpool()
 
 void SbufMpool::cleanup()
 {
-    void *ptr;
-
-    while ((ptr = acquire_buf()) != nullptr) {
-        _mm_free(ptr);
+    while (!_mpool.empty()) {
+        _mm_free(_mpool.back());
+        _mpool.pop_back();
     }
 }
 
+/* one more buffer when all are taken, e.g., by nonblocking reductions in flight */
 void* SbufMpool::acquire_buf()
 {
     void *t = nullptr;
 
-    if (!_mpool.empty()) {
-         t = _mpool.back();
-         _mpool.pop_back();
-    }
+    if (_mpool.empty())
+        return _mm_malloc(_buf_len, getpagesize());
+
+    t = _mpool.back();
+    _mpool.pop_back();
 
     return t;
 }
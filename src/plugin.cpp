@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstring>
+
+#include <dlfcn.h>
+
+#include "encrypt.hpp"
+#include "plugin.hpp"
+
+namespace plugin {
+
+/* keystream for this many elements at a time, on the stack */
+#define PLUGIN_CHUNK 1024
+
+/* NULL for the fields appended after the version the plugin was built with */
+#define PLUGIN_FIELD(abi, field) \
+    (offsetof(HEAR_Plugin, field) + sizeof((abi)->field) <= (abi)->size ? (abi)->field : nullptr)
+
+/* FNV-1a */
+static unsigned int hash(unsigned int h, const void *data, std::size_t len)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+    for (std::size_t i = 0; i < len; i++)
+	h = (h ^ bytes[i]) * 16777619u;
+    return h;
+}
+
+Backend::~Backend()
+{
+    if (_initialised && _finalize)
+	_finalize();
+    if (_handle)
+	dlclose(_handle);
+}
+
+std::unique_ptr<Backend> Backend::load(const char *path, unsigned int caps, std::ostream &err)
+{
+    std::unique_ptr<Backend> backend(new Backend());
+    HEAR_Plugin_entry entry;
+    const HEAR_Plugin *abi;
+    unsigned int needed = 0;
+
+    backend->_initialised = false;
+    backend->_handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!backend->_handle) {
+	err << "HEAR plugin: " << dlerror() << std::endl;
+	return nullptr;
+    }
+
+    entry = reinterpret_cast<HEAR_Plugin_entry>(dlsym(backend->_handle, HEAR_PLUGIN_ENTRY));
+    if (!entry) {
+	err << "HEAR plugin: " << path << " has no " << HEAR_PLUGIN_ENTRY << std::endl;
+	return nullptr;
+    }
+    abi = entry(HEAR_PLUGIN_ABI_VERSION);
+    /* the fields after name may be missing */
+    if (!abi || abi->abi_version != HEAR_PLUGIN_ABI_VERSION ||
+	abi->size < offsetof(HEAR_Plugin, name) + sizeof(abi->name)) {
+	err << "HEAR plugin: " << path << " does not serve ABI version " << HEAR_PLUGIN_ABI_VERSION << std::endl;
+	return nullptr;
+    }
+    if (!abi->name || !abi->name[0] || std::strlen(abi->name) >= 16) {
+	err << "HEAR plugin: " << path << " needs a name of 1 to 15 characters" << std::endl;
+	return nullptr;
+    }
+    backend->_name = abi->name;
+    /* never 0, which stands for no backend */
+    backend->_id = hash(2166136261u, abi->name, backend->_name.size());
+    backend->_id = hash(backend->_id, &abi->abi_version, sizeof(abi->abi_version));
+    backend->_id = hash(backend->_id, &abi->size, sizeof(abi->size)) | 1;
+
+    backend->_init = PLUGIN_FIELD(abi, init);
+    backend->_keystream = PLUGIN_FIELD(abi, keystream);
+    backend->_encrypt_int_sum = PLUGIN_FIELD(abi, encrypt_int_sum);
+    backend->_decrypt_int_sum = PLUGIN_FIELD(abi, decrypt_int_sum);
+    backend->_encrypt_int_prod = PLUGIN_FIELD(abi, encrypt_int_prod);
+    backend->_decrypt_int_prod = PLUGIN_FIELD(abi, decrypt_int_prod);
+    backend->_encrypt_float_sum = PLUGIN_FIELD(abi, encrypt_float_sum);
+    backend->_decrypt_float_sum = PLUGIN_FIELD(abi, decrypt_float_sum);
+
+    if (!backend->_encrypt_int_sum != !backend->_decrypt_int_sum ||
+	!backend->_encrypt_int_prod != !backend->_decrypt_int_prod ||
+	!backend->_encrypt_float_sum != !backend->_decrypt_float_sum) {
+	err << "HEAR plugin: " << backend->_name << " has an encryption kernel without its decryption one" << std::endl;
+	return nullptr;
+    }
+    if (!backend->has_int_sum() && !backend->has_int_prod() && !backend->has_float_sum()) {
+	err << "HEAR plugin: " << backend->_name << " has no kernels" << std::endl;
+	return nullptr;
+    }
+
+    if (auto capabilities = PLUGIN_FIELD(abi, capabilities))
+	needed = capabilities();
+    if (needed & ~caps) {
+	err << "HEAR plugin: " << backend->_name << " needs CPU features 0x" << std::hex << (needed & ~caps)
+	    << std::dec << " that are not there" << std::endl;
+	return nullptr;
+    }
+    backend->_finalize = PLUGIN_FIELD(abi, finalize);
+
+    return backend;
+}
+
+bool Backend::init(const unsigned char *key, std::size_t key_len, std::ostream &err)
+{
+    if (_init && _init(key, key_len) != 0) {
+	err << "HEAR plugin: " << _name << " failed to initialise" << std::endl;
+	return false;
+    }
+    _initialised = true;
+
+    return true;
+}
+
+/* the keystream kernels follow encryption::encrypt_int_sum_naive() and friends */
+void Backend::encrypt_int_sum(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			      std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge) const
+{
+    unsigned int noise1[PLUGIN_CHUNK], noise2[PLUGIN_CHUNK];
+
+    if (_encrypt_int_sum) {
+	_encrypt_int_sum(encr_sbuf, sbuf, count, rank, k_s.data(), k_n, is_edge);
+	return;
+    }
+
+    for (int begin = 0; begin < count; begin += PLUGIN_CHUNK) {
+	int n = std::min(count - begin, PLUGIN_CHUNK);
+
+	_keystream(noise1, n, k_n + k_s[rank] + begin);
+	if (!is_edge)
+	    _keystream(noise2, n, k_n + k_s[rank + 1] + begin);
+	for (int i = 0; i < n; i++)
+	    encr_sbuf[begin + i] = sbuf[begin + i] + noise1[i] - (is_edge ? 0 : noise2[i]);
+    }
+}
+
+void Backend::decrypt_int_sum(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const
+{
+    unsigned int noise[PLUGIN_CHUNK];
+
+    if (_decrypt_int_sum) {
+	_decrypt_int_sum(rbuf, count, k_s.data(), k_n);
+	return;
+    }
+
+    for (int begin = 0; begin < count; begin += PLUGIN_CHUNK) {
+	int n = std::min(count - begin, PLUGIN_CHUNK);
+
+	_keystream(noise, n, k_n + k_s[0] + begin);
+	encryption::decrypt_int_sum_noise(rbuf + begin, n, noise);
+    }
+}
+
+void Backend::encrypt_int_prod(unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+			       std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge) const
+{
+    _encrypt_int_prod(encr_sbuf, sbuf, count, rank, k_s.data(), k_n, is_edge);
+}
+
+void Backend::decrypt_int_prod(unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const
+{
+    _decrypt_int_prod(rbuf, count, k_s.data(), k_n);
+}
+
+/* the float noise kernels go four elements at a time, the keystream is asked for whole fours */
+void Backend::encrypt_float_sum(float *encr_sbuf, const float *sbuf, int count, int rank,
+				std::vector<unsigned int> &k_s, unsigned int k_n) const
+{
+    unsigned int noise[PLUGIN_CHUNK];
+
+    if (_encrypt_float_sum) {
+	_encrypt_float_sum(encr_sbuf, sbuf, count, rank, k_s.data(), k_n);
+	return;
+    }
+
+    for (int begin = 0; begin < count; begin += PLUGIN_CHUNK) {
+	int n = std::min(count - begin, PLUGIN_CHUNK);
+
+	_keystream(noise, (n + 3) / 4 * 4, k_n + begin);
+	encryption::encrypt_float_sum_noise(encr_sbuf + begin, sbuf + begin, n, noise);
+    }
+}
+
+void Backend::decrypt_float_sum(float *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) const
+{
+    unsigned int noise[PLUGIN_CHUNK];
+
+    if (_decrypt_float_sum) {
+	_decrypt_float_sum(rbuf, count, k_s.data(), k_n);
+	return;
+    }
+
+    for (int begin = 0; begin < count; begin += PLUGIN_CHUNK) {
+	int n = std::min(count - begin, PLUGIN_CHUNK);
+
+	_keystream(noise, (n + 3) / 4 * 4, k_n + begin);
+	encryption::decrypt_float_sum_noise(rbuf + begin, n, noise);
+    }
+}
+
+}
@@ -0,0 +1,184 @@
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "policy.hpp"
+
+namespace policy {
+
+Decision::Decision()
+    : encrypt(true), plaintext_below(0), block_size(-1), int_kernel(), float_kernel()
+{
+}
+
+Rule::Rule()
+    : world(false), node_local(false), inter_node(false), min_size(0), max_size(INT_MAX)
+{
+}
+
+bool Rule::matches(const Topology &topology) const
+{
+    if (world && !topology.world)
+	return false;
+    if (node_local && !topology.node_local)
+	return false;
+    if (inter_node && topology.node_local)
+	return false;
+
+    return topology.comm_size >= min_size && topology.comm_size <= max_size;
+}
+
+static bool parse_number(const std::string &text, long &value)
+{
+    char *end;
+
+    if (text.empty())
+	return false;
+    value = std::strtol(text.c_str(), &end, 10);
+    return *end == '\0' && value >= 0;
+}
+
+static bool copy_name(char *dst, const std::string &name)
+{
+    if (name.empty() || name.size() >= POLICY_KERNEL_NAME_LEN)
+	return false;
+    std::strcpy(dst, name.c_str());
+    return true;
+}
+
+bool Engine::parse_rule(const std::string &text, std::ostream &err)
+{
+    std::istringstream tokens(text);
+    std::string token;
+    bool has_action = false;
+    bool has_selector = false;
+    Rule rule;
+    long value;
+
+    while (tokens >> token) {
+	std::size_t eq = token.find('=');
+	bool ok = true;
+
+	if (!has_action) {
+	    if (token == "encrypt" || token == "plaintext") {
+		rule.decision.encrypt = token == "encrypt";
+		has_action = true;
+		continue;
+	    }
+	    has_selector = true;
+	    if (token == "all")
+		;
+	    else if (token == "world")
+		rule.world = true;
+	    else if (token == "node_local")
+		rule.node_local = true;
+	    else if (token == "inter_node")
+		rule.inter_node = true;
+	    else if (!token.compare(0, 6, "size<=") && (ok = parse_number(token.substr(6), value)))
+		rule.max_size = value;
+	    else if (!token.compare(0, 6, "size>=") && (ok = parse_number(token.substr(6), value)))
+		rule.min_size = value;
+	    else
+		ok = false;
+	} else if (eq == std::string::npos) {
+	    ok = false;
+	} else {
+	    std::string key = token.substr(0, eq);
+	    std::string val = token.substr(eq + 1);
+
+	    if (key == "plaintext_below" && (ok = parse_number(val, value)))
+		rule.decision.plaintext_below = value;
+	    else if (key == "block_size" && (ok = parse_number(val, value)))
+		rule.decision.block_size = value;
+	    else if (key == "int_kernel")
+		ok = copy_name(rule.decision.int_kernel, val);
+	    else if (key == "float_kernel")
+		ok = copy_name(rule.decision.float_kernel, val);
+	    else
+		ok = false;
+	}
+
+	if (!ok) {
+	    err << "HEAR policy: ignoring rule \"" << text << "\", bad token \"" << token << "\"" << std::endl;
+	    return false;
+	}
+    }
+
+    if (!has_action || !has_selector) {
+	if (has_action || has_selector)
+	    err << "HEAR policy: ignoring rule \"" << text << "\", it needs a selector and an action" << std::endl;
+	return !has_action && !has_selector;
+    }
+
+    _rules.push_back(rule);
+    return true;
+}
+
+bool Engine::parse(const std::string &text, char sep, std::ostream &err)
+{
+    std::istringstream lines(text);
+    std::string line;
+    bool ok = true;
+
+    while (std::getline(lines, line, sep)) {
+	std::size_t comment = line.find('#');
+	if (comment != std::string::npos)
+	    line.erase(comment);
+	ok &= parse_rule(line, err);
+    }
+
+    return ok;
+}
+
+void Engine::load_env(std::ostream &err)
+{
+    if (const char* env = std::getenv("HEAR_POLICY"))
+	parse(env, ';', err);
+
+    if (const char* env = std::getenv("HEAR_POLICY_FILE")) {
+	std::ifstream file(env);
+	std::stringstream text;
+
+	if (!file) {
+	    err << "HEAR policy: cannot open " << env << std::endl;
+	    return;
+	}
+	text << file.rdbuf();
+	parse(text.str(), '\n', err);
+    }
+}
+
+bool Engine::needs_topology() const
+{
+    for (auto &rule : _rules) {
+	if (rule.node_local || rule.inter_node)
+	    return true;
+    }
+    return false;
+}
+
+Decision Engine::decide(const Topology &topology) const
+{
+    for (auto &rule : _rules) {
+	if (rule.matches(topology))
+	    return rule.decision;
+    }
+    return Decision();
+}
+
+void describe(std::ostream &os, const Decision &decision)
+{
+    os << (decision.encrypt ? "encrypt" : "plaintext");
+    if (decision.plaintext_below)
+	os << " plaintext_below=" << decision.plaintext_below;
+    if (decision.block_size >= 0)
+	os << " block_size=" << decision.block_size;
+    if (decision.int_kernel[0])
+	os << " int_kernel=" << decision.int_kernel;
+    if (decision.float_kernel[0])
+	os << " float_kernel=" << decision.float_kernel;
+}
+
+}
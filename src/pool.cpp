@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pool.hpp"
+
+namespace pool {
+
+#define SYSFS_CPU "/sys/devices/system/cpu/cpu"
+
+/* from sysfs, 0 where it does not say */
+static int cpu_node(int cpu)
+{
+    std::string path = SYSFS_CPU + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    int node = 0;
+
+    if (!dir)
+	return 0;
+    while (struct dirent *entry = readdir(dir)) {
+	if (!std::string(entry->d_name).compare(0, 4, "node")) {
+	    node = std::atoi(entry->d_name + 4);
+	    break;
+	}
+    }
+    closedir(dir);
+
+    return node;
+}
+
+/* whether cpu is the first hyperthread of its core */
+static bool first_sibling(int cpu)
+{
+    std::ifstream siblings(SYSFS_CPU + std::to_string(cpu) + "/topology/thread_siblings_list");
+    int first;
+
+    return !(siblings >> first) || first == cpu;
+}
+
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+	    if (CPU_ISSET(cpu, &allowed))
+		cpus.push_back(cpu);
+	}
+    }
+
+    return cpus;
+}
+
+Pool::Pool(int nthreads, int first_cpu)
+    : _queued(0), _stop(false)
+{
+    std::vector<int> cpus = allowed_cpus();
+
+    for (int cpu = 0; cpus.size() && cpu <= cpus.back(); cpu++)
+	_cpu_nodes.push_back(cpu_node(cpu));
+    /* whole cores first, then their siblings */
+    std::stable_partition(cpus.begin(), cpus.end(), first_sibling);
+
+    for (int i = 0; i < nthreads; i++) {
+	_workers.emplace_back(new Worker);
+	_workers.back()->cpu = cpus.empty() ? -1 : cpus[(first_cpu + i) % cpus.size()];
+	_workers.back()->node = cpus.empty() ? 0 : _cpu_nodes[_workers.back()->cpu];
+    }
+    for (int i = 0; i < nthreads; i++)
+	_workers[i]->victims = victims_of(_workers[i]->node, i);
+
+    for (auto &worker : _workers) {
+	worker->thread = std::thread(&Pool::work, this, std::ref(*worker));
+	if (worker->cpu >= 0) {
+	    cpu_set_t cpu;
+
+	    CPU_ZERO(&cpu);
+	    CPU_SET(worker->cpu, &cpu);
+	    pthread_setaffinity_np(worker->thread.native_handle(), sizeof(cpu), &cpu);
+	}
+    }
+}
+
+Pool::~Pool()
+{
+    {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stop = true;
+    }
+    _cv.notify_all();
+    for (auto &worker : _workers)
+	worker->thread.join();
+}
+
+std::vector<int> Pool::victims_of(int node, int self) const
+{
+    std::vector<int> victims;
+
+    for (int pass = 0; pass < 2; pass++) {
+	for (int i = 0; i < static_cast<int>(_workers.size()); i++) {
+	    if (i != self && (_workers[i]->node == node) == !pass)
+		victims.push_back(i);
+	}
+    }
+
+    return victims;
+}
+
+bool Pool::pop(Worker &worker, Task &task)
+{
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (worker.tasks.empty())
+	return false;
+    task = worker.tasks.front();
+    worker.tasks.pop_front();
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool Pool::steal(const std::vector<int> &victims, Task &task)
+{
+    for (int victim : victims) {
+	Worker &worker = *_workers[victim];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+
+	if (worker.tasks.empty())
+	    continue;
+	task = worker.tasks.back();
+	worker.tasks.pop_back();
+	_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+    }
+
+    return false;
+}
+
+void Pool::run(const Task &task)
+{
+    (*task.job->fn)(task.begin, task.end);
+    task.job->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void Pool::work(Worker &worker)
+{
+    Task task;
+
+    for (;;) {
+	if (pop(worker, task) || steal(worker.victims, task)) {
+	    run(task);
+	    continue;
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cv.wait(lock, [this] { return _stop || _queued.load(std::memory_order_relaxed); });
+	if (_stop)
+	    return;
+    }
+}
+
+void Pool::parallel_for(std::size_t count, std::size_t grain, const range_fn_t &fn)
+{
+    std::size_t ngrains = grain ? (count + grain - 1) / grain : 1;
+    std::size_t nworkers = _workers.size();
+    std::vector<int> victims;
+    Job job;
+    Task task;
+    int cpu;
+
+    if (ngrains <= 1 || !nworkers) {
+	if (count)
+	    fn(0, count);
+	return;
+    }
+
+    job.fn = &fn;
+    job.remaining.store(ngrains, std::memory_order_relaxed);
+    /* before they can be taken, which counts them down */
+    _queued.fetch_add(ngrains, std::memory_order_relaxed);
+
+    /* contiguous runs, so that a worker walks through memory in order */
+    for (std::size_t w = 0; w < nworkers; w++) {
+	std::size_t first = ngrains * w / nworkers;
+	std::size_t last = ngrains * (w + 1) / nworkers;
+	std::lock_guard<std::mutex> lock(_workers[w]->mutex);
+
+	for (std::size_t g = first; g < last; g++)
+	    _workers[w]->tasks.push_back({&job, g * grain, std::min(count, (g + 1) * grain)});
+    }
+    /* a worker checks _queued under _mutex before it sleeps */
+    {
+	std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _cv.notify_all();
+
+    /* the caller helps, from the workers on its node first */
+    cpu = sched_getcpu();
+    victims = victims_of(cpu >= 0 && cpu < static_cast<int>(_cpu_nodes.size()) ? _cpu_nodes[cpu] : 0, -1);
+    while (job.remaining.load(std::memory_order_acquire)) {
+	if (steal(victims, task))
+	    run(task);
+	else
+	    std::this_thread::yield();
+    }
+}
+
+}
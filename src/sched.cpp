@@ -0,0 +1,237 @@
+#include <algorithm>
+
+#include "sched.hpp"
+
+namespace sched {
+
+/* higher priority first, then earlier posted */
+static bool before(const Job &a, const Job &b)
+{
+    return a.priority > b.priority || (a.priority == b.priority && a.seq < b.seq);
+}
+
+Scheduler::~Scheduler()
+{
+    for (auto &entry : _channels) {
+	for (auto &channel : entry.second) {
+	    if (channel.comm != MPI_COMM_NULL)
+		PMPI_Comm_free(&channel.comm);
+	}
+    }
+}
+
+int Scheduler::channel(const Job &job, Channel **channel)
+{
+    auto it = _channels.find(job.comm);
+    int index = std::min(std::max(job.priority, 0), _nchannels - 1);
+    int ret;
+
+    if (it == _channels.end())
+	it = _channels.insert({job.comm, std::vector<Channel>(_nchannels, Channel{MPI_COMM_NULL, {}, {}})}).first;
+
+    *channel = &it->second[index];
+    if ((*channel)->comm != MPI_COMM_NULL)
+	return MPI_SUCCESS;
+
+    ret = PMPI_Comm_dup(job.comm, &(*channel)->comm);
+    if (ret != MPI_SUCCESS)
+	(*channel)->comm = MPI_COMM_NULL;
+    return ret;
+}
+
+int Scheduler::post(const std::shared_ptr<Job> &job)
+{
+    Channel *ch;
+    int ret;
+
+    job->seq = _next_seq++;
+    job->next = 0;
+    job->ndone = 0;
+    job->inflight = 0;
+    job->error = MPI_SUCCESS;
+
+    if (job->nblocks <= 0)
+	return MPI_SUCCESS;
+
+    ret = channel(*job, &ch);
+    if (ret != MPI_SUCCESS) {
+	job->error = ret;
+	return ret;
+    }
+
+    ch->jobs.push_back(job);
+    progress();
+
+    return MPI_SUCCESS;
+}
+
+/*
+ * An error leaves the rest of the job unissued, so, as with a failed
+ * MPI_Allreduce, the other ranks may be left waiting for it.
+ */
+void Scheduler::fail(Job &job, int error)
+{
+    if (job.error == MPI_SUCCESS)
+	job.error = error;
+
+    for (auto &entry : _channels) {
+	for (auto &channel : entry.second)
+	    channel.jobs.erase(std::remove_if(channel.jobs.begin(), channel.jobs.end(),
+					      [&job](const std::shared_ptr<Job> &j) { return j.get() == &job; }),
+			       channel.jobs.end());
+    }
+}
+
+/* with block, waits for one block if none has arrived */
+bool Scheduler::test(bool block)
+{
+    std::vector<MPI_Request> reqs;
+    std::vector<std::pair<Channel *, std::size_t>> where;
+    bool arrived = false;
+    int flag;
+    int which;
+
+    for (auto &entry : _channels) {
+	for (auto &channel : entry.second) {
+	    for (std::size_t i = 0; i < channel.inflight.size();) {
+		PMPI_Test(&channel.inflight[i].req, &flag, MPI_STATUS_IGNORE);
+		if (!flag) {
+		    i++;
+		    continue;
+		}
+		_received.push_back(channel.inflight[i]);
+		channel.inflight.erase(channel.inflight.begin() + i);
+		arrived = true;
+	    }
+	}
+    }
+
+    if (arrived || !block)
+	return arrived;
+
+    for (auto &entry : _channels) {
+	for (auto &channel : entry.second) {
+	    for (std::size_t i = 0; i < channel.inflight.size(); i++) {
+		reqs.push_back(channel.inflight[i].req);
+		where.push_back({&channel, i});
+	    }
+	}
+    }
+    if (reqs.empty())
+	return false;
+
+    PMPI_Waitany(reqs.size(), reqs.data(), &which, MPI_STATUS_IGNORE);
+    if (which == MPI_UNDEFINED)
+	return false;
+
+    Channel &channel = *where[which].first;
+    channel.inflight[where[which].second].req = MPI_REQUEST_NULL;
+    _received.push_back(channel.inflight[where[which].second]);
+    channel.inflight.erase(channel.inflight.begin() + where[which].second);
+
+    return true;
+}
+
+bool Scheduler::issue()
+{
+    bool issued = false;
+
+    while (true) {
+	Channel *next = nullptr;
+	std::shared_ptr<Job> job;
+	Block block;
+	int ret;
+
+	for (auto &entry : _channels) {
+	    for (auto &channel : entry.second) {
+		if (channel.jobs.empty() || channel.inflight.size() >= SCHED_WINDOW)
+		    continue;
+		if (!next || before(*channel.jobs.front(), *next->jobs.front()))
+		    next = &channel;
+	    }
+	}
+	if (!next)
+	    return issued;
+
+	job = next->jobs.front();
+	block = Block{job, job->next++, MPI_REQUEST_NULL};
+	if (job->next == job->nblocks)
+	    next->jobs.pop_front();
+	issued = true;
+
+	if ((ret = job->prepare(block.index)) != MPI_SUCCESS) {
+	    fail(*job, ret);
+	    continue;
+	}
+	if ((ret = job->start(block.index, next->comm, &block.req)) != MPI_SUCCESS) {
+	    /* prepared, finish() gives back what prepare() took */
+	    job->finish(block.index);
+	    fail(*job, ret);
+	    continue;
+	}
+
+	job->inflight++;
+	next->inflight.push_back(block);
+    }
+}
+
+bool Scheduler::finish()
+{
+    std::vector<Block> received;
+    int ret;
+
+    if (_received.empty())
+	return false;
+
+    received.swap(_received);
+    std::stable_sort(received.begin(), received.end(),
+		     [](const Block &a, const Block &b) { return before(*a.job, *b.job); });
+
+    for (auto &block : received) {
+	if ((ret = block.job->finish(block.index)) != MPI_SUCCESS)
+	    fail(*block.job, ret);
+	else
+	    block.job->ndone++;
+	block.job->inflight--;
+    }
+
+    return true;
+}
+
+bool Scheduler::progress()
+{
+    bool progressed = false;
+
+    progressed |= test(false);
+    /* the network first, the arrived blocks are decrypted while the new ones are in flight */
+    progressed |= issue();
+    progressed |= finish();
+
+    return progressed;
+}
+
+int Scheduler::wait(const std::shared_ptr<Job> &job)
+{
+    while (!job->complete()) {
+	if (!progress() && test(true))
+	    finish();
+    }
+
+    return job->error;
+}
+
+void Scheduler::remove_comm(MPI_Comm comm)
+{
+    auto it = _channels.find(comm);
+
+    if (it == _channels.end())
+	return;
+
+    for (auto &channel : it->second) {
+	if (channel.comm != MPI_COMM_NULL)
+	    PMPI_Comm_free(&channel.comm);
+    }
+    _channels.erase(it);
+}
+
+}
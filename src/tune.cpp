@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "tune.hpp"
+
+namespace tune {
+
+/* keys are section headers, values lines */
+static std::string sanitize(std::string text)
+{
+    for (auto &c : text) {
+	if (c == '\n' || c == '\r' || c == '[' || c == ']' || c == ';')
+	    c = ' ';
+    }
+    return text;
+}
+
+static std::string cpu_model()
+{
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+
+    while (std::getline(cpuinfo, line)) {
+	if (line.compare(0, 10, "model name"))
+	    continue;
+	std::size_t begin = line.find_first_not_of(" \t", line.find(':') + 1);
+	if (begin != std::string::npos)
+	    return line.substr(begin);
+    }
+
+    return "unknown";
+}
+
+std::string machine_key(MPI_Comm comm)
+{
+    char library[MPI_MAX_LIBRARY_VERSION_STRING];
+    std::string cpu = cpu_model();
+    std::string mpi;
+    std::ostringstream key;
+    MPI_Comm node_comm;
+    int comm_size, node_size, len;
+    int local_max, max_node_size;
+
+    PMPI_Comm_size(comm, &comm_size);
+    PMPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    PMPI_Comm_size(node_comm, &node_size);
+    PMPI_Comm_free(&node_comm);
+    /* nodes may be unevenly filled, the fullest one counts */
+    local_max = node_size;
+    PMPI_Allreduce(&local_max, &max_node_size, 1, MPI_INT, MPI_MAX, comm);
+
+    PMPI_Get_library_version(library, &len);
+    mpi = library;
+    mpi = mpi.substr(0, mpi.find_first_of(",\n"));
+
+    key << "cpu=" << sanitize(cpu) << ";ranks=" << comm_size << ";ranks_per_node=" << max_node_size
+	<< ";mpi=" << sanitize(mpi);
+    return key.str();
+}
+
+bool parse_integer(const std::string &text, long long min, long long max, long long &value)
+{
+    char *end;
+    long long parsed;
+
+    errno = 0;
+    parsed = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end || errno || parsed < min || parsed > max)
+	return false;
+
+    value = parsed;
+    return true;
+}
+
+bool Cache::load()
+{
+    std::ifstream file(_path);
+    std::string line;
+    std::string key;
+    std::ostringstream section;
+
+    if (!file)
+	return false;
+
+    _entries.clear();
+    while (std::getline(file, line)) {
+	if (line.empty() || line[0] == '#')
+	    continue;
+	if (line[0] == '[' && line.back() == ']') {
+	    if (!key.empty())
+		_entries[key] = parse(section.str());
+	    key = line.substr(1, line.size() - 2);
+	    section.str("");
+	    continue;
+	}
+	section << line << '\n';
+    }
+    if (!key.empty())
+	_entries[key] = parse(section.str());
+
+    return true;
+}
+
+bool Cache::save() const
+{
+    std::string tmp_path = _path + ".tmp." + std::to_string(getpid());
+    std::ofstream file(tmp_path);
+
+    if (!file)
+	return false;
+
+    file << "# libhear tuning cache, see tune.hpp" << std::endl;
+    for (const auto &entry : _entries)
+	file << '[' << entry.first << ']' << std::endl << serialize(entry.second);
+    file.close();
+
+    if (!file || std::rename(tmp_path.c_str(), _path.c_str())) {
+	std::remove(tmp_path.c_str());
+	return false;
+    }
+
+    return true;
+}
+
+bool Cache::lookup(const std::string &key, Values &values) const
+{
+    auto it = _entries.find(key);
+
+    if (it == _entries.end())
+	return false;
+    values = it->second;
+    return true;
+}
+
+void Cache::store(const std::string &key, const Values &values)
+{
+    for (const auto &value : values)
+	_entries[key][value.first] = value.second;
+}
+
+std::string Cache::serialize(const Values &values)
+{
+    std::ostringstream text;
+
+    for (const auto &value : values)
+	text << value.first << '=' << sanitize(value.second) << '\n';
+    return text.str();
+}
+
+Values Cache::parse(const std::string &text)
+{
+    std::istringstream lines(text);
+    std::string line;
+    Values values;
+
+    while (std::getline(lines, line)) {
+	std::size_t eq = line.find('=');
+	if (eq != std::string::npos && eq > 0)
+	    values[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+
+    return values;
+}
+
+}
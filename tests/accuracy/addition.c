@@ -58,7 +58,10 @@ int main (int argc, char *argv[]) {
   double mu = 0;
   double sigma = 1e5;
   char name[100] = {'\0'};
-  while ((opt = getopt(argc, argv, "gus:t:l:h:m:o:n:")) != -1) {
+  // Noise width in bits, e.g., -w 11 -e 6 for HEAR_FLOAT_NARROW_NOISE
+  int noise_mantissa = 0;
+  int noise_exponent = 10;
+  while ((opt = getopt(argc, argv, "gus:t:l:h:m:o:n:w:e:")) != -1) {
     switch (opt) {
     case 'g': mode = GAUSSIAN; break;
     case 'u': mode = UNIFORM; break;
@@ -69,6 +72,8 @@ int main (int argc, char *argv[]) {
     case 'm': mu = atof(optarg); break;
     case 'o': sigma = atof(optarg); break;
     case 'n': strcpy(name, optarg); break;
+    case 'w': noise_mantissa = atoi(optarg); break;
+    case 'e': noise_exponent = atoi(optarg); break;
     default:
         fprintf(stderr, "Usage: %s [-gustlhmon] [file...]\n", argv[0]);
         exit(EXIT_FAILURE);
@@ -87,10 +92,10 @@ int main (int argc, char *argv[]) {
     // Initialize relevant variables
     int precision = precisions[index];
     mpfr_t original_sum, HEAR_sum0, HEAR_sum1, HEAR_sum2, true_sum, random_number, encrypted_error0, encrypted_error1, encrypted_error2, original_error, noise, random_encrypted0, random_encrypted1, random_encrypted2;
-    mpfr_init2(noise, precision);
+    mpfr_init2(noise, noise_mantissa ? noise_mantissa : precision);
     mpfr_set_ui(noise, 0.0, ROUNDING);
     while (!mpfr_cmp_d(noise, 0.0))
-      true_random(&noise, random_state, 10);
+      true_random(&noise, random_state, noise_exponent);
     mpfr_inits2(PRECISE_PRECISION, true_sum, encrypted_error0, encrypted_error1, encrypted_error2, original_error, NULL);
     mpfr_inits2(precision, original_sum, random_number, NULL);
     mpfr_inits2(precision, random_encrypted0, HEAR_sum0, NULL);
@@ -69,7 +69,10 @@ int main (int argc, char *argv[]) {
   double mu = 0;
   double sigma = 1e5;
   char name[100] = {'\0'};
-  while ((opt = getopt(argc, argv, "gus:t:l:h:m:o:n:")) != -1) {
+  // Noise width in bits, e.g., -w 11 -e 6 for HEAR_FLOAT_NARROW_NOISE
+  int noise_mantissa = 0;
+  int noise_exponent = 10;
+  while ((opt = getopt(argc, argv, "gus:t:l:h:m:o:n:w:e:")) != -1) {
     switch (opt) {
     case 'g': mode = GAUSSIAN; break;
     case 'u': mode = UNIFORM; break;
@@ -80,6 +83,8 @@ int main (int argc, char *argv[]) {
     case 'm': mu = atof(optarg); break;
     case 'o': sigma = atof(optarg); break;
     case 'n': strcpy(name, optarg); break;
+    case 'w': noise_mantissa = atoi(optarg); break;
+    case 'e': noise_exponent = atoi(optarg); break;
     default:
         fprintf(stderr, "Usage: %s [-gustlhmon] [file...]\n", argv[0]);
         exit(EXIT_FAILURE);
@@ -104,10 +109,10 @@ int main (int argc, char *argv[]) {
 
     // Generate noises
     for (int step = test_step_size - 1; step >= 0; step--) {
-      mpfr_init2(noises[step], precision);
+      mpfr_init2(noises[step], noise_mantissa ? noise_mantissa : precision);
       mpfr_set_ui(noises[step], 0.0, ROUNDING);
       while (!mpfr_cmp_d(noises[step], 0.0))
-        true_random(noises + step, random_state, 10);
+        true_random(noises + step, random_state, noise_exponent);
     }
     mpfr_init_set(decryption_noise, noises[0], ROUNDING);
 
@@ -0,0 +1,85 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "encrypt.hpp"
+#include "jit.hpp"
+
+#define TEST_NRANKS 4
+#define TEST_MAX_COUNT 4099
+#define TEST_LARGE_COUNT 1000003
+
+/*
+ * The generated kernels must be bit-exact with the aesni128 kernels for
+ * every count (tail path) and alignment (variant dispatch), for every
+ * width and unroll factor the generator can pick.
+ */
+
+static void check(jit::Kernels &kernels, std::mt19937 &gen, int count, int offset)
+{
+  std::vector<unsigned int> k_s(TEST_NRANKS);
+  unsigned int k_n = gen();
+  std::size_t bufsize = (count + 8) * sizeof(unsigned int);
+  unsigned int *sbuf = reinterpret_cast<unsigned int *>(_mm_malloc(bufsize, 32));
+  unsigned int *ref = reinterpret_cast<unsigned int *>(_mm_malloc(bufsize, 32));
+  unsigned int *res = reinterpret_cast<unsigned int *>(_mm_malloc(bufsize, 32));
+
+  for (auto &k : k_s) {
+    k = gen();
+  }
+  for (int j = 0; j < count + offset; j++) {
+    sbuf[j] = gen();
+  }
+
+  for (int rank = 0; rank < TEST_NRANKS; rank++) {
+    bool is_edge = rank == TEST_NRANKS - 1;
+
+    /* the reference kernels need 16 byte aligned buffers */
+    std::memcpy(res, sbuf + offset, count * sizeof(unsigned int));
+    encryption::encrypt_int_sum_aesni128(ref, res, count, rank, k_s, k_n, is_edge);
+    kernels.encrypt_int_sum(res + offset, sbuf + offset, count, rank, k_s, k_n, is_edge);
+    assert(!std::memcmp(ref, res + offset, count * sizeof(unsigned int)));
+
+    encryption::decrypt_int_sum_aesni128(ref, count, k_s, k_n);
+    kernels.decrypt_int_sum(res + offset, count, k_s, k_n);
+    assert(!std::memcmp(ref, res + offset, count * sizeof(unsigned int)));
+  }
+
+  _mm_free(sbuf);
+  _mm_free(ref);
+  _mm_free(res);
+}
+
+int main() {
+  std::mt19937 gen(42);
+  char encr_key[] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+
+  encryption::aesni128_load_key(encr_key);
+
+  for (int width : {4, 0}) {
+    for (int unroll : {0, 1, 3, 7}) {
+      jit::Kernels kernels(65536, unroll, width);
+
+      kernels.describe(std::cout);
+      std::cout << std::endl;
+      if (!kernels.valid()) {
+	std::cout << "jit kernels are not available, skipping" << std::endl;
+	return 0;
+      }
+
+      for (int count = 0; count < TEST_MAX_COUNT; count += 1 + count / 64) {
+	check(kernels, gen, count, 0);
+	check(kernels, gen, count, 1);
+      }
+      check(kernels, gen, TEST_LARGE_COUNT, 0);
+    }
+  }
+
+  std::cout << "jit kernels match" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "encrypt.hpp"
+
+#define TEST_SIZE 10
+#define TEST_STEP_SIZE 100000
+#define TEST_NRANKS 4
+
+/*
+ * The *_noise kernels applied to aesni128_keystream() must be bit-exact with
+ * the aesni128 kernels, otherwise ranks sharing a node keystream would
+ * disagree with ranks generating it locally.
+ */
+
+int main() {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> fdist(-1, 1);
+  char encr_key[] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+  std::size_t bufsize = TEST_STEP_SIZE * sizeof(float);
+
+  encryption::aesni128_load_key(encr_key);
+
+  float *sbuf = reinterpret_cast<float *>(_mm_malloc(bufsize, 32));
+  float *ref = reinterpret_cast<float *>(_mm_malloc(bufsize, 32));
+  float *res = reinterpret_cast<float *>(_mm_malloc(bufsize, 32));
+  unsigned int *noise = reinterpret_cast<unsigned int *>(_mm_malloc(bufsize, 32));
+
+  for (int i = 0; i < TEST_SIZE; i++) {
+    std::vector<unsigned int> k_s(TEST_NRANKS);
+    unsigned int k_n = gen();
+    for (auto &k : k_s) {
+      k = gen();
+    }
+    for (int j = 0; j < TEST_STEP_SIZE; j++) {
+      sbuf[j] = fdist(gen);
+    }
+
+    /* MPI_FLOAT + MPI_SUM: the keystream starts at k_n + 1 */
+    encryption::aesni128_keystream(noise, TEST_STEP_SIZE, k_n + 1);
+    encryption::encrypt_float_sum_aesni128_unroll(ref, sbuf, TEST_STEP_SIZE, 0, k_s, k_n);
+    encryption::encrypt_float_sum_noise(res, sbuf, TEST_STEP_SIZE, noise);
+    assert(!std::memcmp(ref, res, bufsize));
+    encryption::decrypt_float_sum_aesni128_unroll(ref, TEST_STEP_SIZE, k_s, k_n);
+    encryption::decrypt_float_sum_noise(res, TEST_STEP_SIZE, noise);
+    assert(!std::memcmp(ref, res, bufsize));
+
+    /* MPI_INT + MPI_SUM decryption: the keystream starts at k_n + k_s[0] */
+    std::memcpy(ref, sbuf, bufsize);
+    std::memcpy(res, sbuf, bufsize);
+    encryption::aesni128_keystream(noise, TEST_STEP_SIZE, k_n + k_s[0]);
+    encryption::decrypt_int_sum_aesni128(reinterpret_cast<unsigned int *>(ref), TEST_STEP_SIZE, k_s, k_n);
+    encryption::decrypt_int_sum_noise(reinterpret_cast<unsigned int *>(res), TEST_STEP_SIZE, noise);
+    assert(!std::memcmp(ref, res, bufsize));
+  }
+
+  _mm_free(sbuf);
+  _mm_free(ref);
+  _mm_free(res);
+  _mm_free(noise);
+
+  std::cout << "keystream kernels match" << std::endl;
+
+  return 0;
+}
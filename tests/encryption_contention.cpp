@@ -0,0 +1,305 @@
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <functional>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <string>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+
+#include "encrypt.hpp"
+
+/*
+ * The kernels of encr_perf_test on 1..N threads at once, each pinned to its
+ * own physical core of one socket and working on buffers it first-touched,
+ * so that they compete for the socket's memory bandwidth. With nt=1 every
+ * L1-sized block is encrypted into a staging buffer and written out with
+ * non-temporal stores, which skips the read-for-ownership of the
+ * destination lines.
+ */
+
+using namespace std::chrono;
+
+const size_t warmup_niters = 25;
+/* elements per staging block, 16 KiB of L1 */
+const size_t nt_block = 4096;
+
+using encrypt_fn = std::function<void(void *, const void *, int, std::vector<unsigned int> &, unsigned int)>;
+using decrypt_fn = std::function<void(void *, int, std::vector<unsigned int> &, unsigned int)>;
+
+struct Result
+{
+    int core;
+    double encr_time;
+    double decr_time;
+};
+
+/* spins, the threads must leave it within nanoseconds of each other */
+class SpinBarrier
+{
+
+private:
+
+    std::atomic<int> _waiting;
+    std::atomic<int> _generation;
+    int _nthreads;
+
+public:
+
+    explicit SpinBarrier(int nthreads) : _waiting(0), _generation(0), _nthreads(nthreads) {}
+
+    void wait()
+    {
+	int generation = _generation.load();
+
+	if (_waiting.fetch_add(1) + 1 == _nthreads) {
+	    _waiting.store(0);
+	    _generation.fetch_add(1);
+	    return;
+	}
+	while (_generation.load() == generation)
+	    ;
+    }
+
+};
+
+/* the first hardware thread of each physical core of socket 0 */
+static std::vector<int> socket_cores()
+{
+    std::vector<int> cores;
+    std::set<std::string> seen;
+    int ncpus = std::thread::hardware_concurrency();
+
+    for (int cpu = 0; cpu < ncpus; cpu++) {
+	std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+	std::ifstream package_file(topology + "physical_package_id");
+	std::ifstream siblings_file(topology + "thread_siblings_list");
+	std::string siblings;
+	int package = 0;
+
+	if (package_file)
+	    package_file >> package;
+	if (siblings_file)
+	    siblings_file >> siblings;
+	if (package != 0 || !seen.insert(siblings).second)
+	    continue;
+	cores.push_back(cpu);
+    }
+
+    if (cores.empty())
+	cores.push_back(0);
+    return cores;
+}
+
+static void stream_copy(void *dst, const void *src, std::size_t bytes)
+{
+    __m256i *d = reinterpret_cast<__m256i *>(dst);
+    const __m256i *s = reinterpret_cast<const __m256i *>(src);
+
+    std::size_t nvecs = bytes / sizeof(__m256i);
+
+    for (std::size_t i = 0; i < nvecs; i++)
+	_mm256_stream_si256(d + i, _mm256_load_si256(s + i));
+    std::memcpy(d + nvecs, s + nvecs, bytes % sizeof(__m256i));
+}
+
+static bool select_kernels(const char *dtype, const char *func, encrypt_fn &encrypt, decrypt_fn &decrypt)
+{
+    if (!std::strcmp(dtype, "int")) {
+	void (*enc)(unsigned int *, const unsigned int *, int, int, std::vector<unsigned int> &, unsigned int, bool);
+	void (*dec)(unsigned int *, int, std::vector<unsigned int> &, unsigned int);
+
+	if (!std::strcmp(func, "aesni")) {
+	    enc = encryption::encrypt_int_sum_aesni128;
+	    dec = encryption::decrypt_int_sum_aesni128;
+	} else if (!std::strcmp(func, "aesni_unroll")) {
+	    enc = encryption::encrypt_int_sum_aesni128_unroll;
+	    dec = encryption::decrypt_int_sum_aesni128_unroll;
+	} else if (!std::strcmp(func, "sha1sse2")) {
+	    enc = encryption::encrypt_int_sum_sha1sse2;
+	    dec = encryption::decrypt_int_sum_sha1sse2;
+	} else if (!std::strcmp(func, "sha1avx2")) {
+	    enc = encryption::encrypt_int_sum_sha1avx2;
+	    dec = encryption::decrypt_int_sum_sha1avx2;
+	} else {
+	    return false;
+	}
+
+	encrypt = [enc](void *dst, const void *src, int count, std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    enc(static_cast<unsigned int *>(dst), static_cast<const unsigned int *>(src), count, 0, k_s, k_n, false);
+	};
+	decrypt = [dec](void *buf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    dec(static_cast<unsigned int *>(buf), count, k_s, k_n);
+	};
+	return true;
+    }
+
+    if (!std::strcmp(dtype, "float")) {
+	void (*enc)(float *, const float *, int, int, std::vector<unsigned int> &, unsigned int);
+	void (*dec)(float *, int, std::vector<unsigned int> &, unsigned int);
+
+	if (!std::strcmp(func, "aesni_unroll")) {
+	    enc = encryption::encrypt_float_sum_aesni128_unroll;
+	    dec = encryption::decrypt_float_sum_aesni128_unroll;
+	} else if (!std::strcmp(func, "aesni_narrow")) {
+	    enc = encryption::encrypt_float_sum_aesni128_narrow;
+	    dec = encryption::decrypt_float_sum_aesni128_narrow;
+	} else {
+	    return false;
+	}
+
+	encrypt = [enc](void *dst, const void *src, int count, std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    enc(static_cast<float *>(dst), static_cast<const float *>(src), count, 0, k_s, k_n);
+	};
+	decrypt = [dec](void *buf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) {
+	    dec(static_cast<float *>(buf), count, k_s, k_n);
+	};
+	return true;
+    }
+
+    return false;
+}
+
+static void run(int core, std::size_t niters, std::size_t nitems, bool nt,
+		const encrypt_fn &encrypt, const decrypt_fn &decrypt, SpinBarrier &barrier, Result &result)
+{
+    std::size_t bufsize = nitems * sizeof(int);
+    std::vector<unsigned int> k_s = {0x1234, 0x5678};
+    unsigned int k_n = 0x9abc;
+    cpu_set_t cpuset;
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+
+    /*
+     * First touch after pinning, the pages are local to the core. The
+     * kernels work in whole vectors, past count if it is not a multiple.
+     */
+    char *sbuf = static_cast<char *>(_mm_malloc(bufsize + 64, 64));
+    char *encr_sbuf = static_cast<char *>(_mm_malloc(bufsize + 64, 64));
+    char *stage = static_cast<char *>(_mm_malloc(nt_block * sizeof(int) + 64, 64));
+    std::mt19937 random_gen(core);
+
+    for (std::size_t i = 0; i < nitems; i++)
+	reinterpret_cast<unsigned int *>(sbuf)[i] = random_gen();
+    std::memset(encr_sbuf, 0, bufsize);
+
+    auto encrypt_all = [&]() {
+	if (!nt) {
+	    encrypt(encr_sbuf, sbuf, nitems, k_s, k_n);
+	    return;
+	}
+	for (std::size_t off = 0; off < nitems; off += nt_block) {
+	    std::size_t count = std::min(nt_block, nitems - off);
+
+	    encrypt(stage, sbuf + off * sizeof(int), count, k_s, k_n + off);
+	    stream_copy(encr_sbuf + off * sizeof(int), stage, count * sizeof(int));
+	}
+	_mm_sfence();
+    };
+
+    for (std::size_t i = 0; i < warmup_niters; i++)
+	encrypt_all();
+
+    barrier.wait();
+    high_resolution_clock::time_point t1_encr = high_resolution_clock::now();
+    for (std::size_t i = 0; i < niters; i++)
+	encrypt_all();
+    high_resolution_clock::time_point t2_encr = high_resolution_clock::now();
+
+    barrier.wait();
+    high_resolution_clock::time_point t1_decr = high_resolution_clock::now();
+    for (std::size_t i = 0; i < niters; i++)
+	decrypt(encr_sbuf, nitems, k_s, k_n);
+    high_resolution_clock::time_point t2_decr = high_resolution_clock::now();
+
+    result.core = core;
+    result.encr_time = duration_cast<duration<double>>(t2_encr - t1_encr).count();
+    result.decr_time = duration_cast<duration<double>>(t2_decr - t1_decr).count();
+
+    _mm_free(sbuf);
+    _mm_free(encr_sbuf);
+    _mm_free(stage);
+}
+
+int main(int argc, char **argv)
+{
+    /* ./encr_contention_test <niters> <nitems> <nthreads> <dtype> <func> <nt> */
+    if (argc != 7) {
+        std::cerr << "Bad arguments!" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::size_t niters = std::atoi(argv[1]);
+    std::size_t nitems = std::atoi(argv[2]);
+    std::size_t bufsize = nitems * sizeof(int);
+    int nthreads = std::atoi(argv[3]);
+    const char *dtype = argv[4];
+    const char *func = argv[5];
+    bool nt = std::atoi(argv[6]) != 0;
+    std::vector<int> cores = socket_cores();
+    encrypt_fn encrypt;
+    decrypt_fn decrypt;
+
+    if (!select_kernels(dtype, func, encrypt, decrypt)) {
+	std::cerr << "wrong dtype or func type" << std::endl;
+	exit(EXIT_FAILURE);
+    }
+    if (nthreads < 1 || nthreads > static_cast<int>(cores.size())) {
+	std::cerr << "nthreads must be between 1 and the " << cores.size() << " cores of socket 0" << std::endl;
+	exit(EXIT_FAILURE);
+    }
+
+    char encr_key[] = {0x2b, 0x7e, 0x15, 0x16,
+		       0x28, 0xae, 0xd2, 0xa6,
+		       0xab, 0xf7, 0x15, 0x88,
+		       0x09, 0xcf, 0x4f, 0x3c};
+
+    encryption::aesni128_load_key(encr_key);
+
+    SpinBarrier barrier(nthreads);
+    std::vector<Result> results(nthreads);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < nthreads; t++)
+	threads.emplace_back(run, cores[t], niters, nitems, nt, std::cref(encrypt), std::cref(decrypt),
+			     std::ref(barrier), std::ref(results[t]));
+    for (auto &thread : threads)
+	thread.join();
+
+    double max_encr_time = 0, max_decr_time = 0;
+
+    std::cout << "Buffer size: " << bufsize << " Bytes" << std::endl;
+    std::cout << "Dtype: " << dtype << std::endl;
+    std::cout << "Func: " << func << std::endl;
+    std::cout << "Threads: " << nthreads << std::endl;
+    std::cout << "NT stores: " << nt << std::endl;
+    for (const auto &result : results) {
+	std::cout << "Core " << result.core << " encryption throughput: "
+		  << bufsize * niters / 1e+9 / result.encr_time << " Gbytes/sec." << std::endl;
+	std::cout << "Core " << result.core << " decryption throughput: "
+		  << bufsize * niters / 1e+9 / result.decr_time << " Gbytes/sec." << std::endl;
+	max_encr_time = std::max(max_encr_time, result.encr_time);
+	max_decr_time = std::max(max_decr_time, result.decr_time);
+    }
+
+    /* all threads' bytes over the slowest thread's time */
+    double encr_tput = nthreads * bufsize * niters / 1e+9 / max_encr_time;
+    double decr_tput = nthreads * bufsize * niters / 1e+9 / max_decr_time;
+
+    std::cout << "Aggregate encryption throughput: " << encr_tput << " Gbytes/sec." << std::endl;
+    std::cout << "Per-core encryption throughput: " << encr_tput / nthreads << " Gbytes/sec." << std::endl;
+    std::cout << "Aggregate decryption throughput: " << decr_tput << " Gbytes/sec." << std::endl;
+    std::cout << "Per-core decryption throughput: " << decr_tput / nthreads << " Gbytes/sec." << std::endl;
+
+    return 0;
+}
@@ -4,8 +4,10 @@
 #include <random>
 #include <functional>
 #include <cstring>
+#include <memory>
 
 #include "encrypt.hpp"
+#include "jit.hpp"
 
 using namespace std::chrono;
 
@@ -50,6 +52,7 @@ int main(int argc, char **argv)
     std::function<void(unsigned int *, int, std::vector<unsigned int> &, unsigned int)> decrypt_block;
     std::function<void(float *, const float *, int, int, std::vector<unsigned int> &, unsigned int)> encrypt_block_f;
     std::function<void(float *, int, std::vector<unsigned int> &, unsigned int)> decrypt_block_f;
+    std::unique_ptr<jit::Kernels> jit_kernels;
 
     if (!std::strcmp(dtype, "int")) {
 	if (!std::strcmp(op, "sum")) {
@@ -59,6 +62,20 @@ int main(int argc, char **argv)
 	    } else if (!std::strcmp(func, "aesni_unroll")) {
 		encrypt_block = encryption::encrypt_int_sum_aesni128_unroll;
 		decrypt_block = encryption::decrypt_int_sum_aesni128_unroll;
+	    } else if (!std::strcmp(func, "jit")) {
+		jit_kernels.reset(new jit::Kernels(0));
+		if (!jit_kernels->valid()) {
+		    std::cerr << "jit kernels are not available" << std::endl;
+		    exit(EXIT_FAILURE);
+		}
+		jit::Kernels *kernels = jit_kernels.get();
+		encrypt_block = [kernels](unsigned int *encr_sbuf, const unsigned int *sbuf, int count, int rank,
+					  std::vector<unsigned int> &k_s, unsigned int k_n, bool is_edge) {
+		    kernels->encrypt_int_sum(encr_sbuf, sbuf, count, rank, k_s, k_n, is_edge);
+		};
+		decrypt_block = [kernels](unsigned int *rbuf, int count, std::vector<unsigned int> &k_s, unsigned int k_n) {
+		    kernels->decrypt_int_sum(rbuf, count, k_s, k_n);
+		};
 	    } else if (!std::strcmp(func, "sha1sse2")) {
 		encrypt_block = encryption::encrypt_int_sum_sha1sse2;
 		decrypt_block = encryption::decrypt_int_sum_sha1sse2;
@@ -82,6 +99,9 @@ int main(int argc, char **argv)
 	    if (!std::strcmp(func, "aesni_unroll")) {
 		encrypt_block_f = encryption::encrypt_float_sum_aesni128_unroll;
 		decrypt_block_f = encryption::decrypt_float_sum_aesni128_unroll;
+	    } else if (!std::strcmp(func, "aesni_narrow")) {
+		encrypt_block_f = encryption::encrypt_float_sum_aesni128_narrow;
+		decrypt_block_f = encryption::decrypt_float_sum_aesni128_narrow;
 	    } else if (!std::strcmp(func, "naive")) {
 		encrypt_block_f = encryption::encrypt_float_sum_naive;
 		decrypt_block_f = encryption::decrypt_float_sum_naive;
@@ -0,0 +1,38 @@
+#include <mpi.h>
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+
+#include "hear.hpp"
+
+const size_t arr_len = 100000;
+const int magic_num = 42;
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    std::vector<int> sbuf(arr_len, magic_num);
+    std::vector<int> rbuf(arr_len);
+    std::vector<int> seen(arr_len, 0);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+    auto scale = [&](int &elem, int i) {
+	elem /= comm_size;
+	seen[i]++;
+    };
+    HEAR_Allreduce_apply_elements(sbuf.data(), rbuf.data(), sbuf.size(),
+				  MPI_INT, MPI_SUM, MPI_COMM_WORLD, scale);
+
+    for (size_t i = 0; i < arr_len; i++) {
+	assert(rbuf[i] == magic_num);
+	assert(seen[i] == 1);
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <mpi.h>
+
+#include <cassert>
+#include <vector>
+
+#include "hear.hpp"
+
+const int block_len = 1000;
+const int magic_num = 42;
+const int rounds = 3;
+
+/* what rank src sends to rank dst in a round */
+static int value(int src, int dst, int i, int round)
+{
+    return magic_num + src * 1000003 + dst * 1009 + i + round;
+}
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    int my_rank;
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    std::vector<int> sbuf(comm_size * block_len), rbuf(comm_size * block_len);
+    std::vector<int> sendcounts(comm_size), sdispls(comm_size), recvcounts(comm_size), rdispls(comm_size);
+
+    for (int round = 0; round < rounds; round++) {
+	for (int dst = 0; dst < comm_size; dst++) {
+	    for (int i = 0; i < block_len; i++)
+		sbuf[dst * block_len + i] = value(my_rank, dst, i, round);
+	}
+
+	MPI_Alltoall(sbuf.data(), block_len, MPI_INT, rbuf.data(), block_len, MPI_INT, MPI_COMM_WORLD);
+	for (int src = 0; src < comm_size; src++) {
+	    for (int i = 0; i < block_len; i++)
+		assert(rbuf[src * block_len + i] == value(src, my_rank, i, round));
+	}
+
+	MPI_Alltoall(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, sbuf.data(), block_len, MPI_INT, MPI_COMM_WORLD);
+	for (int src = 0; src < comm_size; src++) {
+	    for (int i = 0; i < block_len; i++)
+		assert(sbuf[src * block_len + i] == value(src, my_rank, i, round));
+	}
+
+	/* src sends (src + dst + round) % block_len elements to dst, in reverse order of dst */
+	for (int rank = 0; rank < comm_size; rank++) {
+	    sendcounts[rank] = (my_rank + rank + round) % block_len;
+	    sdispls[rank] = (comm_size - 1 - rank) * block_len;
+	    recvcounts[rank] = (rank + my_rank + round) % block_len;
+	    rdispls[rank] = rank * block_len;
+	    for (int i = 0; i < sendcounts[rank]; i++)
+		sbuf[sdispls[rank] + i] = value(my_rank, rank, i, round);
+	}
+
+	MPI_Alltoallv(sbuf.data(), sendcounts.data(), sdispls.data(), MPI_INT,
+		      rbuf.data(), recvcounts.data(), rdispls.data(), MPI_INT, MPI_COMM_WORLD);
+	for (int src = 0; src < comm_size; src++) {
+	    for (int i = 0; i < recvcounts[src]; i++)
+		assert(rbuf[rdispls[src] + i] == value(src, my_rank, i, round));
+	}
+    }
+
+    /* rank 0 receives into every other int, the same signature with a gap, which all ranks leave to MPI */
+    MPI_Datatype spaced;
+    std::vector<int> spaced_buf(2 * comm_size * block_len);
+
+    MPI_Type_create_resized(MPI_INT, 0, 2 * sizeof(int), &spaced);
+    MPI_Type_commit(&spaced);
+    for (int dst = 0; dst < comm_size; dst++) {
+	for (int i = 0; i < block_len; i++)
+	    sbuf[dst * block_len + i] = value(my_rank, dst, i, rounds);
+    }
+    if (my_rank == 0)
+	MPI_Alltoall(sbuf.data(), block_len, MPI_INT, spaced_buf.data(), block_len, spaced, MPI_COMM_WORLD);
+    else
+	MPI_Alltoall(sbuf.data(), block_len, MPI_INT, rbuf.data(), block_len, MPI_INT, MPI_COMM_WORLD);
+    for (int src = 0; src < comm_size; src++) {
+	for (int i = 0; i < block_len; i++) {
+	    int index = src * block_len + i;
+
+	    assert((my_rank == 0 ? spaced_buf[2 * index] : rbuf[index]) == value(src, my_rank, i, rounds));
+	}
+    }
+    MPI_Type_free(&spaced);
+
+    /* and the encrypted exchanges after it still agree */
+    MPI_Alltoall(sbuf.data(), block_len, MPI_INT, rbuf.data(), block_len, MPI_INT, MPI_COMM_WORLD);
+    for (int src = 0; src < comm_size; src++) {
+	for (int i = 0; i < block_len; i++)
+	    assert(rbuf[src * block_len + i] == value(src, my_rank, i, rounds));
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <mpi.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "hear.hpp"
+
+/*
+ * Control-plane benchmark: storms of communicator creations through libhear
+ * against the same calls on plaintext MPI (PMPI_*), with libhear's share
+ * broken down by HEAR_Get_comm_profile.
+ *
+ *   mpirun --oversubscribe -np 16 ./comm_perf_test <niters>
+ *
+ * Times are per creation and rank, the slowest rank's, in microseconds.
+ */
+
+using create_fn = std::function<int(bool plain, MPI_Comm *newcomm)>;
+
+struct Pattern
+{
+    std::string name;
+    create_fn create;
+};
+
+static double max_over_ranks(double value)
+{
+    double max;
+
+    PMPI_Allreduce(&value, &max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return max;
+}
+
+static double time_storm(const Pattern &pattern, bool plain, int niters)
+{
+    MPI_Comm newcomm;
+    double start;
+    double elapsed = 0;
+
+    for (int i = 0; i < niters; i++) {
+	PMPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+	pattern.create(plain, &newcomm);
+	elapsed += MPI_Wtime() - start;
+
+	if (newcomm != MPI_COMM_NULL) {
+	    if (plain)
+		PMPI_Comm_free(&newcomm);
+	    else
+		MPI_Comm_free(&newcomm);
+	}
+    }
+
+    return max_over_ranks(elapsed / niters) * 1e6;
+}
+
+/* what libhear holds per live communicator, with niters of them alive at once */
+static double bytes_per_comm(const Pattern &pattern, int niters)
+{
+    std::vector<MPI_Comm> comms(niters);
+    HEAR_Comm_profile before, after;
+    int ncreated = 0;
+
+    HEAR_Get_comm_profile(&before);
+    for (auto &comm : comms) {
+	pattern.create(false, &comm);
+	ncreated += comm != MPI_COMM_NULL;
+    }
+    HEAR_Get_comm_profile(&after);
+
+    for (auto &comm : comms) {
+	if (comm != MPI_COMM_NULL)
+	    MPI_Comm_free(&comm);
+    }
+
+    return max_over_ranks(ncreated ? static_cast<double>(after.bytes - before.bytes) / ncreated : 0);
+}
+
+int main(int argc, char **argv)
+{
+    int niters = argc > 1 ? std::atoi(argv[1]) : 100;
+    int my_rank, comm_size;
+    HEAR_Comm_profile init;
+    MPI_Group world_group, even_group;
+    std::vector<int> even_ranks;
+    std::vector<Pattern> patterns;
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+    /* the cost of setting up MPI_COMM_WORLD in MPI_Init */
+    HEAR_Get_comm_profile(&init);
+
+    for (int rank = 0; rank < comm_size; rank += 2)
+	even_ranks.push_back(rank);
+    MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+    MPI_Group_incl(world_group, even_ranks.size(), even_ranks.data(), &even_group);
+
+    patterns.push_back({"dup", [](bool plain, MPI_Comm *newcomm) {
+	return plain ? PMPI_Comm_dup(MPI_COMM_WORLD, newcomm) : MPI_Comm_dup(MPI_COMM_WORLD, newcomm);
+    }});
+    /* cosmoflow.cpp's data-parallel groups, rank % model_shards, and the model-parallel ones */
+    for (int shards = 2; shards <= comm_size && shards <= 8; shards *= 2) {
+	patterns.push_back({"split%" + std::to_string(shards), [=](bool plain, MPI_Comm *newcomm) {
+	    int color = my_rank % shards;
+	    return plain ? PMPI_Comm_split(MPI_COMM_WORLD, color, my_rank, newcomm) :
+		MPI_Comm_split(MPI_COMM_WORLD, color, my_rank, newcomm);
+	}});
+	patterns.push_back({"split/" + std::to_string(shards), [=](bool plain, MPI_Comm *newcomm) {
+	    int color = my_rank / shards;
+	    return plain ? PMPI_Comm_split(MPI_COMM_WORLD, color, my_rank, newcomm) :
+		MPI_Comm_split(MPI_COMM_WORLD, color, my_rank, newcomm);
+	}});
+    }
+    patterns.push_back({"split_type", [=](bool plain, MPI_Comm *newcomm) {
+	return plain ? PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, newcomm) :
+	    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, newcomm);
+    }});
+    patterns.push_back({"create_even", [=](bool plain, MPI_Comm *newcomm) {
+	return plain ? PMPI_Comm_create(MPI_COMM_WORLD, even_group, newcomm) :
+	    MPI_Comm_create(MPI_COMM_WORLD, even_group, newcomm);
+    }});
+
+    if (my_rank == 0) {
+	std::printf("ranks=%d niters=%d\n", comm_size, niters);
+	std::printf("init: key_exchange=%.1f k_n_bcast=%.1f insertion=%.1f policy=%.1f\n",
+		    init.key_exchange * 1e6, init.k_n_bcast * 1e6, init.insertion * 1e6, init.policy * 1e6);
+	std::printf("%-12s %10s %10s %10s %12s %10s %10s %10s %10s\n", "pattern", "plain", "hear",
+		    "overhead", "key_exchange", "k_n_bcast", "insertion", "policy", "bytes");
+    }
+
+    for (const auto &pattern : patterns) {
+	HEAR_Comm_profile before, after;
+	double plain, hear, bytes;
+	double key_exchange, k_n_bcast, insertion, policy;
+	unsigned long long ncomms;
+
+	/* warm-up */
+	time_storm(pattern, true, 1);
+	time_storm(pattern, false, 1);
+
+	plain = time_storm(pattern, true, niters);
+	HEAR_Get_comm_profile(&before);
+	hear = time_storm(pattern, false, niters);
+	HEAR_Get_comm_profile(&after);
+	bytes = bytes_per_comm(pattern, niters);
+
+	/* ranks outside create_even's group set nothing up */
+	ncomms = after.ncomms - before.ncomms;
+	key_exchange = max_over_ranks(ncomms ? (after.key_exchange - before.key_exchange) / ncomms : 0) * 1e6;
+	k_n_bcast = max_over_ranks(ncomms ? (after.k_n_bcast - before.k_n_bcast) / ncomms : 0) * 1e6;
+	insertion = max_over_ranks(ncomms ? (after.insertion - before.insertion) / ncomms : 0) * 1e6;
+	policy = max_over_ranks(ncomms ? (after.policy - before.policy) / ncomms : 0) * 1e6;
+
+	if (my_rank == 0)
+	    std::printf("%-12s %10.1f %10.1f %10.1f %12.1f %10.1f %10.1f %10.1f %10.0f\n", pattern.name.c_str(),
+			plain, hear, hear - plain, key_exchange, k_n_bcast, insertion, policy, bytes);
+    }
+
+    MPI_Group_free(&even_group);
+    MPI_Group_free(&world_group);
+
+    MPI_Finalize();
+}
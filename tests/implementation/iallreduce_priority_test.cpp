@@ -0,0 +1,93 @@
+#include <mpi.h>
+
+#include <cassert>
+#include <vector>
+
+#include "hear.hpp"
+
+/* several pipelining blocks, with a partial one at the end */
+const int big_len = 3 * 32768 + 1000;
+const int small_len = 1000;
+const int magic_num = 42;
+const int rounds = 3;
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    int my_rank;
+    HEAR_Request reqs[4];
+    std::vector<int> big_sbuf(big_len), big_rbuf(big_len);
+    std::vector<int> small_buf(small_len);
+    std::vector<int> mid_sbuf(big_len), mid_rbuf(big_len);
+    std::vector<int> max_sbuf(small_len), max_rbuf(small_len);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    for (int round = 0; round < rounds; round++) {
+	for (int i = 0; i < big_len; i++) {
+	    big_sbuf[i] = magic_num + i + round;
+	    mid_sbuf[i] = my_rank - i;
+	}
+	for (int i = 0; i < small_len; i++) {
+	    small_buf[i] = magic_num - i + round;
+	    max_sbuf[i] = my_rank + i;
+	}
+
+	/* the small in-place one is posted last and goes out ahead of the others */
+	HEAR_Iallreduce(big_sbuf.data(), big_rbuf.data(), big_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 0, &reqs[0]);
+	HEAR_Iallreduce(mid_sbuf.data(), mid_rbuf.data(), big_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 1, &reqs[1]);
+	HEAR_Iallreduce(max_sbuf.data(), max_rbuf.data(), small_len, MPI_INT, MPI_MAX, MPI_COMM_WORLD, 1, &reqs[2]);
+	HEAR_Iallreduce(MPI_IN_PLACE, small_buf.data(), small_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 2, &reqs[3]);
+
+	assert(HEAR_Wait(&reqs[3]) == MPI_SUCCESS);
+	assert(reqs[3] == nullptr);
+	for (int i = 0; i < small_len; i++)
+	    assert(small_buf[i] == (magic_num - i + round) * comm_size);
+
+	/* waited for out of posting order */
+	assert(HEAR_Waitall(3, reqs) == MPI_SUCCESS);
+	for (int i = 0; i < big_len; i++) {
+	    assert(big_rbuf[i] == (magic_num + i + round) * comm_size);
+	    assert(mid_rbuf[i] == comm_size * (comm_size - 1) / 2 - i * comm_size);
+	}
+	for (int i = 0; i < small_len; i++)
+	    assert(max_rbuf[i] == comm_size - 1 + i);
+    }
+
+    /* driven by HEAR_Test and by an MPI_Allreduce in between, as during computation */
+    int done = 0;
+    std::vector<int> one(4, 1), sum(4);
+
+    for (int i = 0; i < big_len; i++)
+	big_sbuf[i] = magic_num + i;
+    HEAR_Iallreduce(big_sbuf.data(), big_rbuf.data(), big_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 0, &reqs[0]);
+    MPI_Allreduce(one.data(), sum.data(), 4, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    assert(sum[0] == comm_size);
+    while (!done)
+	assert(HEAR_Test(&reqs[0], &done) == MPI_SUCCESS);
+    assert(reqs[0] == nullptr);
+    for (int i = 0; i < big_len; i++)
+	assert(big_rbuf[i] == (magic_num + i) * comm_size);
+
+    /* one of them tested to completion, Waitall skips it */
+    HEAR_Iallreduce(small_buf.data(), max_rbuf.data(), small_len, MPI_INT, MPI_MAX, MPI_COMM_WORLD, 0, &reqs[0]);
+    HEAR_Iallreduce(big_sbuf.data(), big_rbuf.data(), big_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 5, &reqs[1]);
+    for (done = 0; !done;)
+	assert(HEAR_Test(&reqs[0], &done) == MPI_SUCCESS);
+    assert(HEAR_Test(&reqs[0], &done) == MPI_SUCCESS && done);
+    assert(HEAR_Waitall(2, reqs) == MPI_SUCCESS);
+    assert(reqs[1] == nullptr);
+    for (int i = 0; i < big_len; i++)
+	assert(big_rbuf[i] == (magic_num + i) * comm_size);
+
+    /* nothing to reduce */
+    HEAR_Iallreduce(big_sbuf.data(), big_rbuf.data(), 0, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 0, &reqs[0]);
+    assert(HEAR_Wait(&reqs[0]) == MPI_SUCCESS);
+
+    MPI_Finalize();
+
+    return 0;
+}
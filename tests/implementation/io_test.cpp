@@ -0,0 +1,135 @@
+#include <mpi.h>
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+
+#include "hear.hpp"
+
+/* odd on purpose, the chunks do not line up with the AES blocks */
+const size_t arr_len = (3 << 18) + 5;
+const int magic_num = 42;
+const char *filename = "hear_io_test.bin";
+
+int main(int argc, char **argv)
+{
+    int my_rank, comm_size;
+    MPI_File fh;
+    MPI_Offset offset;
+    std::vector<int> wbuf(arr_len);
+    std::vector<int> rbuf(arr_len);
+    std::vector<int> raw(arr_len);
+
+    /* small chunks and several threads, so that both are exercised */
+    setenv("HEAR_IO_KEY", "000102030405060708090a0b0c0d0e0f", 0);
+    setenv("HEAR_IO_CHUNK_BYTES", "1000000", 0);
+    setenv("HEAR_IO_THREADS", "4", 0);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+    for (size_t i = 0; i < arr_len; i++)
+	wbuf[i] = magic_num + my_rank * arr_len + i;
+    offset = static_cast<MPI_Offset>(my_rank) * arr_len * sizeof(int);
+
+    MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_CREATE | MPI_MODE_RDWR, MPI_INFO_NULL, &fh);
+    /* left over from a failed run */
+    MPI_File_set_size(fh, 0);
+    MPI_File_write_at_all(fh, offset, wbuf.data(), arr_len, MPI_INT, MPI_STATUS_IGNORE);
+    MPI_File_sync(fh);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /* what the storage sees */
+    PMPI_File_read_at(fh, offset, raw.data(), arr_len, MPI_INT, MPI_STATUS_IGNORE);
+    size_t same = 0;
+    for (size_t i = 0; i < arr_len; i++)
+	same += raw[i] == wbuf[i];
+    assert(same < arr_len / 1000);
+
+    /* the neighbour's block, read back by another rank */
+    MPI_Status status;
+    int count;
+    int neighbour = (my_rank + 1) % comm_size;
+
+    MPI_File_read_at_all(fh, static_cast<MPI_Offset>(neighbour) * arr_len * sizeof(int),
+			 rbuf.data(), arr_len, MPI_INT, &status);
+    MPI_Get_count(&status, MPI_INT, &count);
+    assert(count == static_cast<int>(arr_len));
+    for (size_t i = 0; i < arr_len; i++)
+	assert(rbuf[i] == static_cast<int>(magic_num + neighbour * arr_len + i));
+
+    /* random access, an unaligned byte range in the middle of the block */
+    std::vector<char> bytes(1001);
+    MPI_File_read_at(fh, offset + 4099, bytes.data(), bytes.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+    for (size_t i = 0; i < bytes.size(); i++)
+	assert(bytes[i] == reinterpret_cast<char *>(wbuf.data())[4099 + i]);
+
+    /* individual file pointer, in two steps */
+    MPI_File_seek(fh, offset, MPI_SEEK_SET);
+    MPI_File_read_all(fh, rbuf.data(), arr_len / 2, MPI_INT, MPI_STATUS_IGNORE);
+    MPI_File_read_all(fh, rbuf.data() + arr_len / 2, arr_len - arr_len / 2, MPI_INT, &status);
+    MPI_Get_count(&status, MPI_INT, &count);
+    assert(count == static_cast<int>(arr_len - arr_len / 2));
+    for (size_t i = 0; i < arr_len; i++)
+	assert(rbuf[i] == wbuf[i]);
+
+    /* split collective, done in the begin call */
+    MPI_File_read_at_all_begin(fh, offset, rbuf.data(), arr_len, MPI_INT);
+    MPI_File_read_at_all_end(fh, rbuf.data(), &status);
+    MPI_Get_count(&status, MPI_INT, &count);
+    assert(count == static_cast<int>(arr_len));
+    for (size_t i = 0; i < arr_len; i++)
+	assert(rbuf[i] == wbuf[i]);
+
+    /* no plaintext through the nonblocking calls */
+    MPI_Request request;
+    MPI_File_set_errhandler(fh, MPI_ERRORS_RETURN);
+    assert(MPI_File_iwrite_at(fh, offset, wbuf.data(), arr_len, MPI_INT, &request) != MPI_SUCCESS);
+    assert(request == MPI_REQUEST_NULL);
+
+    /*
+     * In etypes of 4 bytes and elements of 3, the chunks are not whole
+     * etypes unless they are rounded.
+     */
+    MPI_Datatype triple;
+    MPI_Type_contiguous(3, MPI_CHAR, &triple);
+    MPI_Type_commit(&triple);
+    MPI_File_set_view(fh, 0, MPI_INT, MPI_INT, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(fh, offset / sizeof(int), wbuf.data(), arr_len * sizeof(int) / 3 / 4 * 4,
+			  triple, MPI_STATUS_IGNORE);
+    MPI_File_read_at(fh, offset / sizeof(int), rbuf.data(), arr_len, MPI_INT, MPI_STATUS_IGNORE);
+    for (size_t i = 0; i < arr_len * sizeof(int) / 3 / 4 * 3; i++)
+	assert(rbuf[i] == wbuf[i]);
+    MPI_Type_free(&triple);
+
+    /* a short read at the end of the file moves the file pointer by what it read */
+    MPI_Offset end = static_cast<MPI_Offset>(comm_size) * arr_len;
+    MPI_Offset position;
+    MPI_File_seek(fh, end - 10, MPI_SEEK_SET);
+    MPI_File_read(fh, rbuf.data(), 20, MPI_INT, &status);
+    MPI_Get_count(&status, MPI_INT, &count);
+    assert(count == 10);
+    MPI_File_get_position(fh, &position);
+    assert(position == end);
+
+    /* a datatype with gaps on rank 0 only, the other ranks return from the collective as well */
+    MPI_Datatype spaced;
+    MPI_Type_create_resized(MPI_INT, 0, 2 * sizeof(int), &spaced);
+    MPI_Type_commit(&spaced);
+    assert(MPI_File_read_at_all(fh, 0, rbuf.data(), 10, my_rank ? MPI_INT : spaced, MPI_STATUS_IGNORE) !=
+	   MPI_SUCCESS);
+    MPI_Type_free(&spaced);
+
+    MPI_File_close(&fh);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (my_rank == 0) {
+	std::remove(filename);
+	std::cout << "Passed" << std::endl;
+    }
+
+    MPI_Finalize();
+}
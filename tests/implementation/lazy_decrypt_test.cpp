@@ -0,0 +1,62 @@
+#include <mpi.h>
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "hear.hpp"
+
+/* run with HEAR_LAZY_DECRYPT=1, and HEAR_NODE_KEYSTREAM=1 too */
+const size_t arr_len = 8 << 20;
+const int magic_num = 42;
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    int my_rank;
+    std::vector<int> sbuf(arr_len);
+    std::vector<int> rbuf(arr_len);
+    std::vector<int> rbuf2(arr_len);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    for (size_t i = 0; i < arr_len; i++)
+	sbuf[i] = magic_num + i;
+
+    MPI_Allreduce(sbuf.data(), rbuf.data(), arr_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    /* back to front, against the worker */
+    for (size_t i = arr_len; i-- > 0;)
+	assert(rbuf[i] == static_cast<int>(magic_num + i) * comm_size);
+
+    /* the result of one reduction as the input of the next */
+    MPI_Allreduce(sbuf.data(), rbuf.data(), arr_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(rbuf.data(), rbuf2.data(), arr_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    HEAR_Decrypt_wait(rbuf2.data(), arr_len * sizeof(int));
+
+    for (size_t i = 0; i < arr_len; i++)
+	assert(rbuf2[i] == static_cast<int>(magic_num + i) * comm_size * comm_size);
+
+    /* page-aligned on rank 0 only, the other ranks decrypt all of it right away */
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *mem;
+    assert(!posix_memalign(&mem, page_size, (arr_len + page_size) * sizeof(int)));
+    int *shifted = static_cast<int *>(mem) + (my_rank ? 4 : 0);
+
+    for (size_t i = 0; i < arr_len; i++)
+	shifted[i] = magic_num + i;
+    MPI_Allreduce(MPI_IN_PLACE, shifted, arr_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    for (size_t i = 0; i < arr_len; i++)
+	assert(shifted[i] == static_cast<int>(magic_num + i) * comm_size);
+    HEAR_Decrypt_wait(mem, (arr_len + page_size) * sizeof(int));
+    free(mem);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <mpi.h>
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+#include "hear.hpp"
+
+const size_t arr_len = 1000;
+
+struct Counter
+{
+    int hits;
+    char tag;
+    int total;
+};
+
+static void counter_sum(void *in, void *inout, int *len, MPI_Datatype *datatype)
+{
+    Counter *a = static_cast<Counter *>(in);
+    Counter *b = static_cast<Counter *>(inout);
+
+    for (int i = 0; i < *len; i++) {
+	b[i].hits += a[i].hits;
+	b[i].total += a[i].total;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    int my_rank;
+    MPI_Datatype counter_type;
+    MPI_Op counter_op;
+    std::vector<Counter> sbuf(arr_len);
+    std::vector<Counter> rbuf(arr_len);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    int blocklens[] = {1, 1, 1};
+    MPI_Aint displs[] = {offsetof(Counter, hits), offsetof(Counter, tag), offsetof(Counter, total)};
+    MPI_Datatype types[] = {MPI_INT, MPI_CHAR, MPI_INT};
+    MPI_Type_create_struct(3, blocklens, displs, types, &counter_type);
+    MPI_Type_create_resized(counter_type, 0, sizeof(Counter), &counter_type);
+    MPI_Type_commit(&counter_type);
+    MPI_Op_create(counter_sum, 1, &counter_op);
+
+    MPI_Aint field_displs[] = {offsetof(Counter, hits), offsetof(Counter, total)};
+    MPI_Datatype field_types[] = {MPI_INT, MPI_INT};
+    assert(HEAR_Op_declare_linear(counter_op, counter_type, 2, field_types, field_displs) == MPI_SUCCESS);
+
+    for (size_t i = 0; i < arr_len; i++)
+	sbuf[i] = {static_cast<int>(i) + my_rank, 'x', 3 * static_cast<int>(i)};
+
+    MPI_Allreduce(sbuf.data(), rbuf.data(), arr_len, counter_type, counter_op, MPI_COMM_WORLD);
+
+    for (size_t i = 0; i < arr_len; i++) {
+	assert(rbuf[i].hits == static_cast<int>(i) * comm_size + comm_size * (comm_size - 1) / 2);
+	assert(rbuf[i].total == 3 * static_cast<int>(i) * comm_size);
+    }
+
+    /* the fields are taken from recvbuf */
+    MPI_Allreduce(MPI_IN_PLACE, sbuf.data(), arr_len, counter_type, counter_op, MPI_COMM_WORLD);
+
+    for (size_t i = 0; i < arr_len; i++) {
+	assert(sbuf[i].hits == static_cast<int>(i) * comm_size + comm_size * (comm_size - 1) / 2);
+	assert(sbuf[i].total == 3 * static_cast<int>(i) * comm_size);
+    }
+
+    /* nonblocking, completed by polling */
+    HEAR_Request req;
+    int done = 0;
+
+    HEAR_Iallreduce(sbuf.data(), rbuf.data(), arr_len, counter_type, counter_op, MPI_COMM_WORLD, 0, &req);
+    while (!done)
+	assert(HEAR_Test(&req, &done) == MPI_SUCCESS);
+    assert(req == nullptr);
+
+    for (size_t i = 0; i < arr_len; i++) {
+	assert(rbuf[i].hits == sbuf[i].hits * comm_size);
+	assert(rbuf[i].total == sbuf[i].total * comm_size);
+    }
+
+    MPI_Op_free(&counter_op);
+    MPI_Type_free(&counter_type);
+
+    MPI_Finalize();
+
+    return 0;
+}
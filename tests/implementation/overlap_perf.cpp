@@ -0,0 +1,228 @@
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "hear.hpp"
+
+/*
+ * Overlap benchmark in the style of OSU's osu_iallreduce: an MPI_SUM of
+ * ints is posted, then compute that takes as long as the slower of the two
+ * reductions alone is run, then the reduction is waited for. Plaintext MPI
+ * (PMPI_Iallreduce) against libhear's encrypted HEAR_Iallreduce, for message
+ * sizes from 4 bytes to max_bytes.
+ *
+ *   mpirun -np 4 -x HEAR_ENABLE_AESNI=1 ./overlap_perf_test <max_bytes> <niters> <test_us>
+ *
+ * As with OSU's -t, the compute tests the reduction every test_us
+ * microseconds (50 by default, 0 for never): MPI_Test, or HEAR_Test, which
+ * is where libhear en-/decrypts blocks and issues the next ones. Without
+ * tests, HEAR_Iallreduce only has its first blocks in flight during the
+ * compute, so large messages hardly overlap.
+ *
+ * Block sizes and configurations are compared with the usual environment
+ * variables and build targets, e.g., HEAR_PIPELINING_BLOCK_SIZE or
+ * HEAR_ENABLE_JIT, which are printed with the results. For each size:
+ *
+ *   plain_pure, hear_pure    the reduction alone, posted and waited for
+ *   compute                  busy compute for the larger of the two pures,
+ *                            the same for plain and hear
+ *   plain_total, hear_total  posted, compute, waited for
+ *   comm_hidden              the share of plain_pure that plain_total hides,
+ *                            100 * (1 - (plain_total - compute) / plain_pure)
+ *   crypto                   hear_pure - plain_pure, what encryption adds to
+ *                            the reduction alone
+ *   exposed                  (hear_total - compute) - (plain_total - compute),
+ *                            what encryption adds to a step with this compute
+ *   crypto_hidden            the share of crypto that hear hides beyond what
+ *                            plain hides of the communication,
+ *                            100 * (1 - exposed / crypto)
+ *
+ * Each total is taken less the compute its side measured, which differs
+ * from compute only by the granularity of the compute loop. Times are the
+ * slowest rank's, in microseconds.
+ */
+
+struct Collective
+{
+    std::function<void(int count)> post;
+    std::function<void()> test;
+    std::function<void()> wait;
+};
+
+struct Result
+{
+    double compute;
+    double total;
+};
+
+static const char *config_vars[] = {"HEAR_ENABLE_AESNI", "HEAR_ENABLE_JIT", "HEAR_PIPELINING_BLOCK_SIZE",
+				    "HEAR_MPOOL_SBUF_LEN", "HEAR_NODE_KEYSTREAM", "HEAR_POLICY"};
+
+/* in cache, so that it does not compete with the reduction for memory bandwidth */
+static double compute_data[512];
+
+static double max_over_ranks(double value)
+{
+    double max;
+
+    PMPI_Allreduce(&value, &max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return max;
+}
+
+/*
+ * As OSU's dummy compute, until seconds have passed rather than a calibrated
+ * number of loops, with a test of collective every test_interval seconds.
+ */
+static void compute(double seconds, const Collective &collective, double test_interval)
+{
+    double start = MPI_Wtime();
+    double next_test = start + test_interval;
+
+    while (MPI_Wtime() - start < seconds) {
+	for (auto &x : compute_data)
+	    x = x * 0.999 + 0.001;
+	/* keeps the loop from being optimised away */
+	__asm__ volatile("" : : "r"(compute_data) : "memory");
+
+	if (test_interval > 0 && MPI_Wtime() >= next_test) {
+	    collective.test();
+	    next_test = MPI_Wtime() + test_interval;
+	}
+    }
+}
+
+/* the collective alone, posted and waited for */
+static double measure_pure(const Collective &collective, int count, int niters)
+{
+    double start, pure = 0;
+
+    /* warm-up */
+    collective.post(count);
+    collective.wait();
+
+    for (int iter = 0; iter < niters; iter++) {
+	PMPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+	collective.post(count);
+	collective.wait();
+	pure += MPI_Wtime() - start;
+    }
+    return max_over_ranks(pure / niters);
+}
+
+/* the collective posted, seconds of compute, waited for */
+static Result measure_overlap(const Collective &collective, int count, int niters, double test_interval,
+			      double seconds)
+{
+    Result result;
+    double start, compute_time = 0, total = 0;
+
+    for (int iter = 0; iter < niters; iter++) {
+	double compute_start;
+
+	PMPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+	collective.post(count);
+	compute_start = MPI_Wtime();
+	compute(seconds, collective, test_interval);
+	compute_time += MPI_Wtime() - compute_start;
+	collective.wait();
+	total += MPI_Wtime() - start;
+    }
+    result.compute = max_over_ranks(compute_time / niters);
+    result.total = max_over_ranks(total / niters);
+
+    return result;
+}
+
+/* 100 * (1 - exposed / time), clamped to [0, 100] */
+static double hidden(double exposed, double time)
+{
+    if (time <= 0)
+	return 0;
+    return std::max(0.0, std::min(100.0, 100 * (1 - exposed / time)));
+}
+
+int main(int argc, char **argv)
+{
+    long max_bytes = argc > 1 ? std::atol(argv[1]) : 1 << 24;
+    int niters = argc > 2 ? std::atoi(argv[2]) : 20;
+    double test_interval = (argc > 3 ? std::atof(argv[3]) : 50) * 1e-6;
+    int max_count = std::max<long>(max_bytes / sizeof(int), 1);
+    std::vector<int> sendbuf(max_count), recvbuf(max_count);
+    int my_rank, comm_size;
+    MPI_Request plain_req;
+    HEAR_Request hear_req;
+    int hear_done = 1;
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+    for (int i = 0; i < max_count; i++)
+	sendbuf[i] = my_rank + i;
+
+    Collective plain = {
+	[&](int count) {
+	    PMPI_Iallreduce(sendbuf.data(), recvbuf.data(), count, MPI_INT, MPI_SUM, MPI_COMM_WORLD, &plain_req);
+	},
+	[&]() {
+	    int flag;
+
+	    PMPI_Test(&plain_req, &flag, MPI_STATUS_IGNORE);
+	},
+	[&]() { PMPI_Wait(&plain_req, MPI_STATUS_IGNORE); }
+    };
+    /* HEAR_Test frees the request once it is complete */
+    Collective hear = {
+	[&](int count) {
+	    HEAR_Iallreduce(sendbuf.data(), recvbuf.data(), count, MPI_INT, MPI_SUM, MPI_COMM_WORLD, 0, &hear_req);
+	    hear_done = 0;
+	},
+	[&]() {
+	    if (!hear_done)
+		HEAR_Test(&hear_req, &hear_done);
+	},
+	[&]() {
+	    if (!hear_done)
+		HEAR_Wait(&hear_req);
+	    hear_done = 1;
+	}
+    };
+
+    if (my_rank == 0) {
+	std::printf("ranks=%d niters=%d test_us=%g\n", comm_size, niters, test_interval * 1e6);
+	for (const char *var : config_vars) {
+	    if (const char *value = std::getenv(var))
+		std::printf("%s=%s\n", var, value);
+	}
+	std::printf("%-10s %11s %10s %10s %11s %10s %12s %10s %10s %14s\n", "bytes", "plain_pure", "hear_pure",
+		    "compute", "plain_total", "hear_total", "comm_hidden", "crypto", "exposed", "crypto_hidden");
+    }
+
+    for (long bytes = sizeof(int); bytes <= max_bytes; bytes *= 2) {
+	int count = bytes / sizeof(int);
+	double plain_pure = measure_pure(plain, count, niters);
+	double hear_pure = measure_pure(hear, count, niters);
+	double seconds = std::max(plain_pure, hear_pure);
+	Result plain_result = measure_overlap(plain, count, niters, test_interval, seconds);
+	Result hear_result = measure_overlap(hear, count, niters, test_interval, seconds);
+	double plain_exposed = plain_result.total - plain_result.compute;
+	double hear_exposed = hear_result.total - hear_result.compute;
+	double crypto = hear_pure - plain_pure;
+	double exposed = hear_exposed - plain_exposed;
+
+	if (my_rank == 0)
+	    std::printf("%-10ld %11.1f %10.1f %10.1f %11.1f %10.1f %11.1f%% %10.1f %10.1f %13.1f%%\n", bytes,
+			plain_pure * 1e6, hear_pure * 1e6, seconds * 1e6, plain_result.total * 1e6,
+			hear_result.total * 1e6, hidden(plain_exposed, plain_pure), crypto * 1e6, exposed * 1e6,
+			hidden(exposed, crypto));
+    }
+
+    MPI_Finalize();
+}
@@ -0,0 +1,53 @@
+#include <mpi.h>
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+
+#include "hear.hpp"
+
+const int arr_len = 1000;
+const int magic_num = 42;
+const int rounds = 3;
+
+int main(int argc, char **argv)
+{
+    int comm_size;
+    int my_rank;
+    HEAR_Stage stage;
+    std::vector<int> rbuf(arr_len);
+
+    MPI_Init(&argc, &argv);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    HEAR_Stage_create(arr_len, MPI_INT, MPI_SUM, MPI_COMM_WORLD, &stage);
+    int *sbuf = static_cast<int *>(HEAR_Stage_buffer(stage));
+
+    for (int round = 0; round < rounds; round++) {
+	/* ranks produce the regions back to front, the first one is left to the allreduce */
+	for (int offset = arr_len / HEAR_STAGE_GRANULE * HEAR_STAGE_GRANULE; offset > HEAR_STAGE_GRANULE;
+	     offset -= HEAR_STAGE_GRANULE) {
+	    int count = std::min(HEAR_STAGE_GRANULE, arr_len - offset);
+
+	    for (int i = offset; i < offset + count; i++)
+		sbuf[i] = magic_num + i + round;
+	    assert(HEAR_Stage_ready(stage, offset, count) == MPI_SUCCESS);
+	    assert(HEAR_Stage_ready(stage, offset, count) == MPI_ERR_ARG);
+	}
+	for (int i = 0; i < 2 * HEAR_STAGE_GRANULE; i++)
+	    sbuf[i] = magic_num + i + round;
+
+	HEAR_Stage_allreduce(stage, rbuf.data());
+
+	for (int i = 0; i < arr_len; i++)
+	    assert(rbuf[i] == (magic_num + i + round) * comm_size);
+    }
+
+    HEAR_Stage_free(&stage);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "hear_plugin.hpp"
+
+/*
+ * Example kernel backend, see hear_plugin.hpp: a keystream of SHA-1 over
+ * the key and the counter, which libhear turns into all the sum kernels.
+ *
+ *   make example_plugin
+ *   mpirun -x HEAR_PLUGIN=$PWD/hear_example_plugin.so -x LD_PRELOAD=$PWD/libhear.so ./app
+ */
+
+static unsigned char plugin_key[16];
+
+static int example_init(const unsigned char *key, size_t key_len)
+{
+    if (key_len < sizeof(plugin_key))
+	return -1;
+    memcpy(plugin_key, key, sizeof(plugin_key));
+    return 0;
+}
+
+static void example_keystream(unsigned int *noise, int count, unsigned int ctr)
+{
+    unsigned char block[sizeof(plugin_key) + sizeof(unsigned int)];
+    unsigned char digest[SHA_DIGEST_LENGTH];
+
+    memcpy(block, plugin_key, sizeof(plugin_key));
+    for (int i = 0; i < count; i++) {
+	unsigned int c = ctr + i;
+
+	memcpy(block + sizeof(plugin_key), &c, sizeof(c));
+	SHA1(block, sizeof(block), digest);
+	memcpy(noise + i, digest, sizeof(unsigned int));
+    }
+}
+
+static const HEAR_Plugin example_plugin = {
+    .abi_version = HEAR_PLUGIN_ABI_VERSION,
+    .size = sizeof(HEAR_Plugin),
+    .name = "example",
+    .init = example_init,
+    .keystream = example_keystream,
+};
+
+const HEAR_Plugin *hear_plugin_entry(unsigned int abi_version)
+{
+    return abi_version == HEAR_PLUGIN_ABI_VERSION ? &example_plugin : NULL;
+}
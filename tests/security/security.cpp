@@ -5,6 +5,14 @@
 #include <string>
 #include <mpi.h>
 
+// Build with -D NARROW_NOISE=1 to enumerate HEAR_FLOAT_NARROW_NOISE noises
+#ifdef NARROW_NOISE
+#define NOISE_MANTISSA FLOAT_NARROW_NOISE_MANTISSA
+#else
+#define NOISE_MANTISSA FLOAT_MANTISSA
+#endif
+#define NOISE_SHIFT (FLOAT_MANTISSA - NOISE_MANTISSA)
+
 int power2(int a) {
   int result = 1;
   for (int i = 0; i < a; i++) {
@@ -25,23 +33,24 @@ std::vector<uint64_t> compute(int option1, int option2) {
     x[i].number().ieee_float.ieee.mantissa = 42;
   }
   uint64_t power = power2(FLOAT_MANTISSA);
+  uint64_t noise_power = power2(NOISE_MANTISSA);
   for (int j = option1; j < option2; j++) {
     std::vector<uint64_t> mantissas(power2(FLOAT_MANTISSA), 0);
     if (option1 == 0 and j % 10 == 0)
         std::cout << "Rank 0 processing iteration " << j << " out of " << option2 << std::endl;
-    for (uint64_t i = 0; i < power; i+= 4) {
+    for (uint64_t i = 0; i < noise_power; i+= 4) {
       n[0].number().crypto.sign = 0;
       n[0].number().crypto.exponent = 0;
-      n[0].number().crypto.mantissa = i;
+      n[0].number().crypto.mantissa = (i) << NOISE_SHIFT;
       n[1].number().crypto.sign = 0;
       n[1].number().crypto.exponent = 0;
-      n[1].number().crypto.mantissa = i + 1;
+      n[1].number().crypto.mantissa = (i + 1) << NOISE_SHIFT;
       n[2].number().crypto.sign = 0;
       n[2].number().crypto.exponent = 0;
-      n[2].number().crypto.mantissa = i + 2;
+      n[2].number().crypto.mantissa = (i + 2) << NOISE_SHIFT;
       n[3].number().crypto.sign = 0;
       n[3].number().crypto.exponent = 0;
-      n[3].number().crypto.mantissa = i + 3;
+      n[3].number().crypto.mantissa = (i + 3) << NOISE_SHIFT;
 
       x[0].number().ieee_float.ieee.mantissa = j;
       x[1].number().ieee_float.ieee.mantissa = j;
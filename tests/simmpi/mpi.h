@@ -0,0 +1,264 @@
+#ifndef SIMMPI_MPI_H
+#define SIMMPI_MPI_H
+
+/*
+ * The subset of MPI that libhear and its benchmarks use, implemented by
+ * simmpi.cpp over the threads of one process, see simmpi.hpp. Code built
+ * with -D HEAR_SIMMPI=1 finds this header instead of the MPI library's.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct simmpi_comm_s *MPI_Comm;
+typedef struct simmpi_group_s *MPI_Group;
+typedef struct simmpi_datatype_s *MPI_Datatype;
+typedef struct simmpi_op_s *MPI_Op;
+typedef struct simmpi_request_s *MPI_Request;
+typedef struct simmpi_win_s *MPI_Win;
+typedef struct simmpi_file_s *MPI_File;
+typedef int MPI_Info;
+typedef long MPI_Aint;
+typedef int MPI_Fint;
+typedef long long MPI_Offset;
+typedef long long MPI_Count;
+
+typedef struct MPI_Status
+{
+    int MPI_SOURCE;
+    int MPI_TAG;
+    int MPI_ERROR;
+    MPI_Count simmpi_nbytes;
+} MPI_Status;
+
+typedef void (MPI_User_function)(void *invec, void *inoutvec, int *len, MPI_Datatype *datatype);
+
+/* the calling rank's, MPI_COMM_WORLD differs between ranks */
+MPI_Comm simmpi_comm_world(void);
+MPI_Comm simmpi_comm_self(void);
+
+extern struct simmpi_datatype_s simmpi_char, simmpi_byte, simmpi_int, simmpi_unsigned,
+    simmpi_long, simmpi_unsigned_long, simmpi_long_long, simmpi_unsigned_long_long,
+    simmpi_float, simmpi_double;
+extern struct simmpi_op_s simmpi_sum, simmpi_prod, simmpi_max, simmpi_min, simmpi_band;
+
+#define MPI_COMM_WORLD (simmpi_comm_world())
+#define MPI_COMM_SELF (simmpi_comm_self())
+#define MPI_COMM_NULL ((MPI_Comm) 0)
+#define MPI_GROUP_NULL ((MPI_Group) 0)
+#define MPI_DATATYPE_NULL ((MPI_Datatype) 0)
+#define MPI_OP_NULL ((MPI_Op) 0)
+#define MPI_REQUEST_NULL ((MPI_Request) 0)
+#define MPI_WIN_NULL ((MPI_Win) 0)
+#define MPI_FILE_NULL ((MPI_File) 0)
+#define MPI_INFO_NULL 0
+
+#define MPI_CHAR (&simmpi_char)
+#define MPI_BYTE (&simmpi_byte)
+#define MPI_INT (&simmpi_int)
+#define MPI_UNSIGNED (&simmpi_unsigned)
+#define MPI_LONG (&simmpi_long)
+#define MPI_UNSIGNED_LONG (&simmpi_unsigned_long)
+#define MPI_LONG_LONG (&simmpi_long_long)
+#define MPI_UNSIGNED_LONG_LONG (&simmpi_unsigned_long_long)
+#define MPI_FLOAT (&simmpi_float)
+#define MPI_DOUBLE (&simmpi_double)
+
+#define MPI_SUM (&simmpi_sum)
+#define MPI_PROD (&simmpi_prod)
+#define MPI_MAX (&simmpi_max)
+#define MPI_MIN (&simmpi_min)
+#define MPI_BAND (&simmpi_band)
+
+#define MPI_IN_PLACE ((void *) 1)
+#define MPI_STATUS_IGNORE ((MPI_Status *) 0)
+#define MPI_STATUSES_IGNORE ((MPI_Status *) 0)
+
+#define MPI_SUCCESS 0
+#define MPI_ERR_BUFFER 1
+#define MPI_ERR_COUNT 2
+#define MPI_ERR_TYPE 3
+#define MPI_ERR_COMM 5
+#define MPI_ERR_RANK 6
+#define MPI_ERR_ROOT 7
+#define MPI_ERR_GROUP 8
+#define MPI_ERR_OP 9
+#define MPI_ERR_ARG 13
+#define MPI_ERR_OTHER 16
+#define MPI_ERR_UNSUPPORTED_OPERATION 52
+
+#define MPI_UNDEFINED (-32766)
+#define MPI_COMM_TYPE_SHARED 1
+#define MPI_MODE_NOCHECK 1024
+#define MPI_COMBINER_NAMED 1
+#define MPI_COMBINER_CONTIGUOUS 2
+#define MPI_SEEK_SET 600
+#define MPI_SEEK_CUR 602
+#define MPI_SEEK_END 604
+
+#define MPI_THREAD_SINGLE 0
+#define MPI_THREAD_FUNNELED 1
+#define MPI_THREAD_SERIALIZED 2
+#define MPI_THREAD_MULTIPLE 3
+
+#define MPI_MAX_OBJECT_NAME 64
+#define MPI_MAX_LIBRARY_VERSION_STRING 256
+#define MPI_MAX_DATAREP_STRING 128
+
+/* MPI_* are weak aliases of PMPI_*, as with a real MPI library */
+#define SIMMPI_DECLARE(ret, name, args) ret MPI_##name args; ret PMPI_##name args;
+
+SIMMPI_DECLARE(int, Init, (int *argc, char ***argv))
+SIMMPI_DECLARE(int, Init_thread, (int *argc, char ***argv, int required, int *provided))
+SIMMPI_DECLARE(int, Finalize, (void))
+SIMMPI_DECLARE(int, Abort, (MPI_Comm comm, int errorcode))
+SIMMPI_DECLARE(int, Get_library_version, (char *version, int *resultlen))
+SIMMPI_DECLARE(double, Wtime, (void))
+
+SIMMPI_DECLARE(int, Comm_rank, (MPI_Comm comm, int *rank))
+SIMMPI_DECLARE(int, Comm_size, (MPI_Comm comm, int *size))
+SIMMPI_DECLARE(int, Comm_dup, (MPI_Comm comm, MPI_Comm *newcomm))
+SIMMPI_DECLARE(int, Comm_split, (MPI_Comm comm, int color, int key, MPI_Comm *newcomm))
+SIMMPI_DECLARE(int, Comm_split_type, (MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm *newcomm))
+SIMMPI_DECLARE(int, Comm_create, (MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm))
+SIMMPI_DECLARE(int, Comm_free, (MPI_Comm *comm))
+SIMMPI_DECLARE(int, Comm_group, (MPI_Comm comm, MPI_Group *group))
+SIMMPI_DECLARE(int, Comm_get_name, (MPI_Comm comm, char *name, int *resultlen))
+SIMMPI_DECLARE(int, Comm_set_name, (MPI_Comm comm, const char *name))
+SIMMPI_DECLARE(MPI_Fint, Comm_c2f, (MPI_Comm comm))
+
+SIMMPI_DECLARE(int, Group_size, (MPI_Group group, int *size))
+SIMMPI_DECLARE(int, Group_rank, (MPI_Group group, int *rank))
+SIMMPI_DECLARE(int, Group_incl, (MPI_Group group, int n, const int ranks[], MPI_Group *newgroup))
+SIMMPI_DECLARE(int, Group_translate_ranks, (MPI_Group group1, int n, const int ranks1[],
+					    MPI_Group group2, int ranks2[]))
+SIMMPI_DECLARE(int, Group_free, (MPI_Group *group))
+
+SIMMPI_DECLARE(int, Barrier, (MPI_Comm comm))
+SIMMPI_DECLARE(int, Bcast, (void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm))
+SIMMPI_DECLARE(int, Allgather, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+				void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm))
+SIMMPI_DECLARE(int, Allreduce, (const void *sendbuf, void *recvbuf, int count,
+				MPI_Datatype datatype, MPI_Op op, MPI_Comm comm))
+SIMMPI_DECLARE(int, Iallreduce, (const void *sendbuf, void *recvbuf, int count,
+				 MPI_Datatype datatype, MPI_Op op, MPI_Comm comm, MPI_Request *request))
+SIMMPI_DECLARE(int, Wait, (MPI_Request *request, MPI_Status *status))
+SIMMPI_DECLARE(int, Waitall, (int count, MPI_Request requests[], MPI_Status statuses[]))
+SIMMPI_DECLARE(int, Test, (MPI_Request *request, int *flag, MPI_Status *status))
+SIMMPI_DECLARE(int, Waitany, (int count, MPI_Request requests[], int *index, MPI_Status *status))
+
+SIMMPI_DECLARE(int, Type_size, (MPI_Datatype datatype, int *size))
+SIMMPI_DECLARE(int, Type_get_extent, (MPI_Datatype datatype, MPI_Aint *lb, MPI_Aint *extent))
+SIMMPI_DECLARE(int, Type_get_true_extent, (MPI_Datatype datatype, MPI_Aint *true_lb, MPI_Aint *true_extent))
+SIMMPI_DECLARE(int, Type_get_envelope, (MPI_Datatype datatype, int *num_integers, int *num_addresses,
+					int *num_datatypes, int *combiner))
+SIMMPI_DECLARE(int, Type_contiguous, (int count, MPI_Datatype oldtype, MPI_Datatype *newtype))
+SIMMPI_DECLARE(int, Type_commit, (MPI_Datatype *datatype))
+SIMMPI_DECLARE(int, Type_free, (MPI_Datatype *datatype))
+SIMMPI_DECLARE(int, Op_create, (MPI_User_function *user_fn, int commute, MPI_Op *op))
+SIMMPI_DECLARE(int, Op_free, (MPI_Op *op))
+SIMMPI_DECLARE(int, Get_count, (const MPI_Status *status, MPI_Datatype datatype, int *count))
+SIMMPI_DECLARE(int, Status_set_elements_x, (MPI_Status *status, MPI_Datatype datatype, MPI_Count count))
+
+SIMMPI_DECLARE(int, Alloc_mem, (MPI_Aint size, MPI_Info info, void *baseptr))
+SIMMPI_DECLARE(int, Free_mem, (void *base))
+SIMMPI_DECLARE(int, Win_allocate_shared, (MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm,
+					  void *baseptr, MPI_Win *win))
+SIMMPI_DECLARE(int, Win_shared_query, (MPI_Win win, int rank, MPI_Aint *size, int *disp_unit, void *baseptr))
+SIMMPI_DECLARE(int, Win_lock_all, (int assert, MPI_Win win))
+SIMMPI_DECLARE(int, Win_unlock_all, (MPI_Win win))
+SIMMPI_DECLARE(int, Win_sync, (MPI_Win win))
+SIMMPI_DECLARE(int, Win_free, (MPI_Win *win))
+
+/* no point-to-point messages, these fail, and with them encrypted MPI_Alltoall(v) */
+SIMMPI_DECLARE(int, Isend, (const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+			    MPI_Comm comm, MPI_Request *request))
+SIMMPI_DECLARE(int, Irecv, (void *buf, int count, MPI_Datatype datatype, int source, int tag,
+			    MPI_Comm comm, MPI_Request *request))
+SIMMPI_DECLARE(int, Testsome, (int incount, MPI_Request requests[], int *outcount, int indices[],
+			       MPI_Status statuses[]))
+SIMMPI_DECLARE(int, Waitsome, (int incount, MPI_Request requests[], int *outcount, int indices[],
+			       MPI_Status statuses[]))
+SIMMPI_DECLARE(int, Cancel, (MPI_Request *request))
+SIMMPI_DECLARE(int, Alltoall, (const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+			       void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm))
+SIMMPI_DECLARE(int, Alltoallv, (const void *sendbuf, const int sendcounts[], const int sdispls[],
+				MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+				const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm))
+
+/* there is no file system behind the simulated ranks, these fail */
+SIMMPI_DECLARE(int, File_open, (MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh))
+SIMMPI_DECLARE(int, File_close, (MPI_File *fh))
+SIMMPI_DECLARE(int, File_get_view, (MPI_File fh, MPI_Offset *disp, MPI_Datatype *etype,
+				    MPI_Datatype *filetype, char *datarep))
+SIMMPI_DECLARE(int, File_seek, (MPI_File fh, MPI_Offset offset, int whence))
+SIMMPI_DECLARE(int, File_get_position, (MPI_File fh, MPI_Offset *offset))
+SIMMPI_DECLARE(int, File_write_at_all, (MPI_File fh, MPI_Offset offset, const void *buf, int count,
+					MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_at_all, (MPI_File fh, MPI_Offset offset, void *buf, int count,
+				       MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write_all, (MPI_File fh, const void *buf, int count,
+				     MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_all, (MPI_File fh, void *buf, int count,
+				    MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write_at, (MPI_File fh, MPI_Offset offset, const void *buf, int count,
+				    MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_at, (MPI_File fh, MPI_Offset offset, void *buf, int count,
+				   MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write, (MPI_File fh, const void *buf, int count,
+				 MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read, (MPI_File fh, void *buf, int count,
+				MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write_at_all_begin, (MPI_File fh, MPI_Offset offset, const void *buf, int count,
+					      MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_write_at_all_end, (MPI_File fh, const void *buf, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_at_all_begin, (MPI_File fh, MPI_Offset offset, void *buf, int count,
+					     MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_read_at_all_end, (MPI_File fh, void *buf, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write_all_begin, (MPI_File fh, const void *buf, int count, MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_write_all_end, (MPI_File fh, const void *buf, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_all_begin, (MPI_File fh, void *buf, int count, MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_read_all_end, (MPI_File fh, void *buf, MPI_Status *status))
+SIMMPI_DECLARE(int, File_iwrite_at, (MPI_File fh, MPI_Offset offset, const void *buf, int count,
+				     MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iread_at, (MPI_File fh, MPI_Offset offset, void *buf, int count,
+				    MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iwrite_at_all, (MPI_File fh, MPI_Offset offset, const void *buf, int count,
+					 MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iread_at_all, (MPI_File fh, MPI_Offset offset, void *buf, int count,
+					MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iwrite, (MPI_File fh, const void *buf, int count,
+				  MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iread, (MPI_File fh, void *buf, int count,
+				 MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iwrite_all, (MPI_File fh, const void *buf, int count,
+				      MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iread_all, (MPI_File fh, void *buf, int count,
+				     MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_write_shared, (MPI_File fh, const void *buf, int count,
+					MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_shared, (MPI_File fh, void *buf, int count,
+				       MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_iwrite_shared, (MPI_File fh, const void *buf, int count,
+					 MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_iread_shared, (MPI_File fh, void *buf, int count,
+					MPI_Datatype datatype, MPI_Request *request))
+SIMMPI_DECLARE(int, File_write_ordered, (MPI_File fh, const void *buf, int count,
+					 MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_ordered, (MPI_File fh, void *buf, int count,
+					MPI_Datatype datatype, MPI_Status *status))
+SIMMPI_DECLARE(int, File_write_ordered_begin, (MPI_File fh, const void *buf, int count, MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_write_ordered_end, (MPI_File fh, const void *buf, MPI_Status *status))
+SIMMPI_DECLARE(int, File_read_ordered_begin, (MPI_File fh, void *buf, int count, MPI_Datatype datatype))
+SIMMPI_DECLARE(int, File_read_ordered_end, (MPI_File fh, void *buf, MPI_Status *status))
+
+#undef SIMMPI_DECLARE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
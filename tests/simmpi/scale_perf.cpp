@@ -0,0 +1,146 @@
+#include <mpi.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "hear.hpp"
+#include "simmpi.hpp"
+
+/*
+ * Scale test of the interception layer on simulated ranks, see simmpi.hpp:
+ * MPI_Init, ncomms communicators kept alive at once and encrypted
+ * MPI_Allreduce of count ints on MPI_COMM_WORLD, with what libhear holds
+ * and what the process has resident after each step.
+ *
+ *   HEAR_ENABLE_AESNI=1 ./sim_scale_test <nranks> <ncomms> <count> <niters>
+ *
+ * Times are the slowest rank's, in microseconds. The memory pool is per
+ * rank, so unless HEAR_MPOOL_SIZE and HEAR_MPOOL_SBUF_LEN say otherwise it
+ * is cut down to two buffers of one pipelining block.
+ */
+
+static int ncomms, count, niters;
+
+static double max_over_ranks(double value)
+{
+    double max;
+
+    PMPI_Allreduce(&value, &max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return max;
+}
+
+static unsigned long long sum_over_ranks(unsigned long long value)
+{
+    unsigned long long sum;
+
+    PMPI_Allreduce(&value, &sum, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    return sum;
+}
+
+/* of the whole process, all ranks, once they are all there */
+static long resident_kib()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    PMPI_Barrier(MPI_COMM_WORLD);
+    while (std::getline(status, line)) {
+	if (!line.compare(0, 6, "VmRSS:"))
+	    return std::atol(line.c_str() + 6);
+    }
+    return 0;
+}
+
+static void report(int my_rank, const char *step, double time, long rss)
+{
+    HEAR_Comm_profile profile;
+    unsigned long long bytes;
+
+    HEAR_Get_comm_profile(&profile);
+    bytes = sum_over_ranks(profile.bytes);
+
+    if (my_rank == 0)
+	std::printf("%-10s %12.1f %16llu %12ld\n", step, time, bytes, rss);
+}
+
+static int rank_main(int argc, char **argv)
+{
+    std::vector<MPI_Comm> comms(ncomms);
+    std::vector<int> sendbuf(count), recvbuf(count);
+    int my_rank, comm_size;
+    long errors = 0;
+    double start, time;
+
+    /* includes waiting for the other rank threads to start */
+    start = MPI_Wtime();
+    MPI_Init(&argc, &argv);
+    time = MPI_Wtime() - start;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    time = max_over_ranks(time) * 1e6;
+
+    if (my_rank == 0) {
+	std::printf("ranks=%d ncomms=%d count=%d niters=%d\n", comm_size, ncomms, count, niters);
+	std::printf("%-10s %12s %16s %12s\n", "step", "time", "hear_bytes", "rss_kib");
+    }
+    report(my_rank, "init", time, resident_kib());
+
+    /* cosmoflow.cpp's data-parallel groups, with two model shards */
+    start = MPI_Wtime();
+    for (auto &comm : comms)
+	MPI_Comm_split(MPI_COMM_WORLD, my_rank % 2, my_rank, &comm);
+    time = max_over_ranks(ncomms ? (MPI_Wtime() - start) / ncomms : 0) * 1e6;
+    report(my_rank, "split", time, resident_kib());
+
+    for (int i = 0; i < count; i++)
+	sendbuf[i] = my_rank + i;
+
+    time = 0;
+    for (int iter = 0; iter < niters; iter++) {
+	PMPI_Barrier(MPI_COMM_WORLD);
+	start = MPI_Wtime();
+	MPI_Allreduce(sendbuf.data(), recvbuf.data(), count, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+	time += MPI_Wtime() - start;
+    }
+    time = max_over_ranks(niters ? time / niters : 0) * 1e6;
+
+    /* sums wrap around like the reduction does */
+    for (int i = 0; niters && i < count; i++) {
+	unsigned int expected = static_cast<unsigned int>(comm_size) * (comm_size - 1) / 2 +
+	    static_cast<unsigned int>(comm_size) * i;
+
+	errors += static_cast<unsigned int>(recvbuf[i]) != expected;
+    }
+    report(my_rank, "allreduce", time, resident_kib());
+
+    for (auto &comm : comms)
+	MPI_Comm_free(&comm);
+    report(my_rank, "free", 0, resident_kib());
+
+    errors = sum_over_ranks(errors);
+    if (my_rank == 0 && errors)
+	std::printf("allreduce: %ld wrong elements\n", errors);
+
+    MPI_Finalize();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    int nranks = argc > 1 ? std::atoi(argv[1]) : 1024;
+
+    ncomms = argc > 2 ? std::atoi(argv[2]) : 16;
+    count = argc > 3 ? std::atoi(argv[3]) : 65536;
+    niters = argc > 4 ? std::atoi(argv[4]) : 10;
+
+    setenv("HEAR_MPOOL_SIZE", "2", 0);
+    setenv("HEAR_MPOOL_SBUF_LEN", "262144", 0);
+
+    return simmpi::run(nranks, rank_main, argc, argv);
+}
@@ -0,0 +1,1280 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+#include "mpi.h"
+#include "simmpi.hpp"
+
+namespace simmpi {
+
+enum Kind { CHAR, BYTE, INT, UNSIGNED, LONG, UNSIGNED_LONG, LONG_LONG, UNSIGNED_LONG_LONG, FLOAT, DOUBLE };
+enum Builtin { SUM, PROD, MAX, MIN, BAND };
+
+struct Config
+{
+    double latency;
+    double bandwidth;
+    int ranks_per_node;
+    std::size_t stack_bytes;
+};
+
+static Config config;
+
+/* MPI_Win_allocate_shared, one allocation for all ranks */
+struct Window
+{
+    char *mem;
+    std::vector<MPI_Aint> offsets;
+    std::vector<MPI_Aint> sizes;
+    std::vector<int> disp_units;
+
+    ~Window() { std::free(mem); }
+};
+
+/* a communicator, shared by its ranks */
+struct Context
+{
+    std::vector<int> world_ranks;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int arrived;
+    unsigned long long generation;
+    double deadline;
+
+    /* per rank, for the collective in progress */
+    std::vector<const void *> in;
+    std::vector<long long> args;
+    std::vector<std::pair<std::shared_ptr<Context>, int>> assignment;
+
+    std::vector<char> result;
+    std::shared_ptr<Window> window;
+
+    explicit Context(std::vector<int> ranks);
+    int size() const { return static_cast<int>(world_ranks.size()); }
+
+    /*
+     * Returns once every rank of the communicator has called it. The last
+     * one to arrive runs last, with the lock held, and sets the deadline of
+     * the collective to cost from now, which is returned to all.
+     */
+    double barrier(const std::function<void()> &last, double cost);
+};
+
+}
+
+struct simmpi_datatype_s
+{
+    int size;
+    int kind;
+    int combiner;
+    /* MPI_COMBINER_CONTIGUOUS: count elements of base */
+    MPI_Datatype base;
+    int count;
+};
+
+struct simmpi_op_s
+{
+    /* nullptr for the predefined operations */
+    MPI_User_function *fn;
+    int builtin;
+};
+
+static MPI_Fint next_comm_handle()
+{
+    static std::atomic<MPI_Fint> next(0);
+
+    return next++;
+}
+
+struct simmpi_comm_s
+{
+    std::shared_ptr<simmpi::Context> ctx;
+    int rank;
+    std::string name;
+    MPI_Fint handle = next_comm_handle();
+};
+
+struct simmpi_group_s
+{
+    std::vector<int> world_ranks;
+};
+
+struct simmpi_request_s
+{
+    double deadline;
+};
+
+struct simmpi_win_s
+{
+    std::shared_ptr<simmpi::Window> window;
+};
+
+struct simmpi_datatype_s simmpi_char = {sizeof(char), simmpi::CHAR, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_byte = {1, simmpi::BYTE, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_int = {sizeof(int), simmpi::INT, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_unsigned = {sizeof(unsigned), simmpi::UNSIGNED, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_long = {sizeof(long), simmpi::LONG, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_unsigned_long = {sizeof(unsigned long), simmpi::UNSIGNED_LONG,
+						 MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_long_long = {sizeof(long long), simmpi::LONG_LONG, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_unsigned_long_long = {sizeof(unsigned long long), simmpi::UNSIGNED_LONG_LONG,
+						      MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_float = {sizeof(float), simmpi::FLOAT, MPI_COMBINER_NAMED, nullptr, 1};
+struct simmpi_datatype_s simmpi_double = {sizeof(double), simmpi::DOUBLE, MPI_COMBINER_NAMED, nullptr, 1};
+
+struct simmpi_op_s simmpi_sum = {nullptr, simmpi::SUM};
+struct simmpi_op_s simmpi_prod = {nullptr, simmpi::PROD};
+struct simmpi_op_s simmpi_max = {nullptr, simmpi::MAX};
+struct simmpi_op_s simmpi_min = {nullptr, simmpi::MIN};
+struct simmpi_op_s simmpi_band = {nullptr, simmpi::BAND};
+
+namespace simmpi {
+
+static thread_local MPI_Comm world = MPI_COMM_NULL;
+static thread_local MPI_Comm self = MPI_COMM_NULL;
+static thread_local int world_rank;
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* of a collective over size ranks that moves bytes through each rank's link */
+static double cost(int size, double bytes)
+{
+    int steps = 0;
+
+    while ((1 << steps) < size)
+	steps++;
+
+    return config.latency * steps + (config.bandwidth > 0 ? bytes / config.bandwidth : 0);
+}
+
+static void complete(double deadline)
+{
+    double left = deadline - now();
+
+    if (left > 0)
+	std::this_thread::sleep_for(std::chrono::duration<double>(left));
+}
+
+Context::Context(std::vector<int> ranks)
+    : world_ranks(std::move(ranks)), arrived(0), generation(0), deadline(0)
+{
+    in.resize(world_ranks.size());
+    args.resize(2 * world_ranks.size());
+    assignment.resize(world_ranks.size());
+}
+
+double Context::barrier(const std::function<void()> &last, double cost)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    unsigned long long gen = generation;
+
+    if (++arrived == size()) {
+	if (last)
+	    last();
+	deadline = now() + cost;
+	arrived = 0;
+	generation++;
+	cv.notify_all();
+    } else {
+	cv.wait(lock, [&] { return generation != gen; });
+    }
+
+    return deadline;
+}
+
+/* integer sums and products wrap around, the integer kernels count on it */
+template <typename T, bool = std::is_integral<T>::value>
+struct Arithmetic { using type = T; };
+
+template <typename T>
+struct Arithmetic<T, true> { using type = typename std::make_unsigned<T>::type; };
+
+/* MPI defines MPI_BAND for integers only */
+template <typename T>
+static typename std::enable_if<std::is_integral<T>::value, T>::type bitwise_and(T a, T b) { return a & b; }
+
+template <typename T>
+static typename std::enable_if<!std::is_integral<T>::value, T>::type bitwise_and(T, T b) { return b; }
+
+template <typename T>
+static void reduce_typed(const void *in, void *inout, int count, int op)
+{
+    using U = typename Arithmetic<T>::type;
+    const T *a = static_cast<const T *>(in);
+    T *b = static_cast<T *>(inout);
+
+    for (int i = 0; i < count; i++) {
+	switch (op) {
+	case SUM:
+	    b[i] = static_cast<T>(static_cast<U>(a[i]) + static_cast<U>(b[i]));
+	    break;
+	case PROD:
+	    b[i] = static_cast<T>(static_cast<U>(a[i]) * static_cast<U>(b[i]));
+	    break;
+	case MAX:
+	    b[i] = std::max(a[i], b[i]);
+	    break;
+	case MIN:
+	    b[i] = std::min(a[i], b[i]);
+	    break;
+	case BAND:
+	    b[i] = bitwise_and(a[i], b[i]);
+	    break;
+	}
+    }
+}
+
+/* inout = in op inout, as for MPI_User_function */
+static void reduce(const void *in, void *inout, int count, MPI_Datatype datatype, MPI_Op op)
+{
+    if (op->fn) {
+	op->fn(const_cast<void *>(in), inout, &count, &datatype);
+	return;
+    }
+
+    while (datatype->combiner == MPI_COMBINER_CONTIGUOUS) {
+	count *= datatype->count;
+	datatype = datatype->base;
+    }
+
+    switch (datatype->kind) {
+    case CHAR: reduce_typed<signed char>(in, inout, count, op->builtin); break;
+    case BYTE: reduce_typed<unsigned char>(in, inout, count, op->builtin); break;
+    case INT: reduce_typed<int>(in, inout, count, op->builtin); break;
+    case UNSIGNED: reduce_typed<unsigned>(in, inout, count, op->builtin); break;
+    case LONG: reduce_typed<long>(in, inout, count, op->builtin); break;
+    case UNSIGNED_LONG: reduce_typed<unsigned long>(in, inout, count, op->builtin); break;
+    case LONG_LONG: reduce_typed<long long>(in, inout, count, op->builtin); break;
+    case UNSIGNED_LONG_LONG: reduce_typed<unsigned long long>(in, inout, count, op->builtin); break;
+    case FLOAT: reduce_typed<float>(in, inout, count, op->builtin); break;
+    case DOUBLE: reduce_typed<double>(in, inout, count, op->builtin); break;
+    }
+}
+
+/*
+ * Every rank reduces its share of the elements over all ranks, in rank
+ * order, and then copies the whole result. Returns the deadline.
+ */
+static double allreduce(const void *sendbuf, void *recvbuf, int count,
+			MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    Context &ctx = *comm->ctx;
+    int rank = comm->rank;
+    int size = ctx.size();
+    std::size_t extent = datatype->size;
+    std::size_t bytes = static_cast<std::size_t>(count) * extent;
+    long long lo = static_cast<long long>(count) * rank / size;
+    long long hi = static_cast<long long>(count) * (rank + 1) / size;
+    double deadline;
+
+    ctx.in[rank] = sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf;
+    ctx.barrier([&ctx, bytes] { ctx.result.resize(bytes); }, 0);
+
+    if (hi > lo) {
+	char *res = ctx.result.data() + lo * extent;
+
+	std::memcpy(res, static_cast<const char *>(ctx.in[size - 1]) + lo * extent, (hi - lo) * extent);
+	for (int q = size - 2; q >= 0; q--)
+	    reduce(static_cast<const char *>(ctx.in[q]) + lo * extent, res, hi - lo, datatype, op);
+    }
+
+    deadline = ctx.barrier(nullptr, cost(size, 2.0 * (size - 1) / size * bytes));
+    if (bytes)
+	std::memcpy(recvbuf, ctx.result.data(), bytes);
+
+    return deadline;
+}
+
+/* MPI_UNDEFINED as color leaves newcomm MPI_COMM_NULL */
+static int split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm)
+{
+    Context &ctx = *comm->ctx;
+    int rank = comm->rank;
+    int size = ctx.size();
+    double deadline;
+
+    ctx.args[2 * rank] = color;
+    ctx.args[2 * rank + 1] = key;
+    deadline = ctx.barrier([&ctx, size] {
+	std::map<long long, std::vector<std::pair<long long, int>>> colors;
+
+	for (int r = 0; r < size; r++) {
+	    if (ctx.args[2 * r] != MPI_UNDEFINED)
+		colors[ctx.args[2 * r]].push_back({ctx.args[2 * r + 1], r});
+	    else
+		ctx.assignment[r] = {nullptr, MPI_UNDEFINED};
+	}
+
+	for (auto &members : colors) {
+	    std::vector<int> ranks;
+
+	    /* by key, ties by rank */
+	    std::sort(members.second.begin(), members.second.end());
+	    for (auto &member : members.second)
+		ranks.push_back(ctx.world_ranks[member.second]);
+
+	    auto child = std::make_shared<Context>(std::move(ranks));
+	    for (std::size_t i = 0; i < members.second.size(); i++)
+		ctx.assignment[members.second[i].second] = {child, static_cast<int>(i)};
+	}
+    }, cost(size, 2.0 * sizeof(int) * (size - 1)));
+
+    if (ctx.assignment[rank].first)
+	*newcomm = new simmpi_comm_s{std::move(ctx.assignment[rank].first), ctx.assignment[rank].second, ""};
+    else
+	*newcomm = MPI_COMM_NULL;
+    ctx.assignment[rank].first.reset();
+    complete(deadline);
+
+    return MPI_SUCCESS;
+}
+
+struct RankArgs
+{
+    int rank;
+    int (*rank_main)(int, char **);
+    int argc;
+    char **argv;
+    std::shared_ptr<Context> world;
+    int result;
+};
+
+static void *rank_thread(void *arg)
+{
+    RankArgs &args = *static_cast<RankArgs *>(arg);
+    simmpi_comm_s world_comm{args.world, args.rank, "MPI_COMM_WORLD"};
+    simmpi_comm_s self_comm{std::make_shared<Context>(std::vector<int>{args.rank}), 0, "MPI_COMM_SELF"};
+
+    world = &world_comm;
+    self = &self_comm;
+    world_rank = args.rank;
+
+    args.result = args.rank_main(args.argc, args.argv);
+
+    world = self = MPI_COMM_NULL;
+    return nullptr;
+}
+
+int run(int nranks, int (*rank_main)(int, char **), int argc, char **argv)
+{
+    std::vector<int> ranks(nranks);
+    std::vector<RankArgs> args(nranks);
+    std::vector<pthread_t> threads(nranks);
+    pthread_attr_t attr;
+    std::shared_ptr<Context> world_ctx;
+
+    config.latency = 0;
+    config.bandwidth = 0;
+    config.ranks_per_node = nranks;
+    config.stack_bytes = 1048576;
+
+    if (const char* env = std::getenv("HEAR_SIM_LATENCY_US"))
+	config.latency = std::atof(env) * 1e-6;
+
+    if (const char* env = std::getenv("HEAR_SIM_BANDWIDTH"))
+	config.bandwidth = std::atof(env);
+
+    if (const char* env = std::getenv("HEAR_SIM_RANKS_PER_NODE"))
+	config.ranks_per_node = std::max(std::atoi(env), 1);
+
+    if (const char* env = std::getenv("HEAR_SIM_STACK_BYTES"))
+	config.stack_bytes = std::atoll(env);
+
+    std::iota(ranks.begin(), ranks.end(), 0);
+    world_ctx = std::make_shared<Context>(std::move(ranks));
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, config.stack_bytes);
+    for (int rank = 0; rank < nranks; rank++) {
+	args[rank] = {rank, rank_main, argc, argv, world_ctx, 0};
+	if (pthread_create(&threads[rank], &attr, rank_thread, &args[rank])) {
+	    /* the ranks already started would wait for this one forever */
+	    std::cerr << "simmpi: could not start rank " << rank << std::endl;
+	    std::exit(EXIT_FAILURE);
+	}
+    }
+    pthread_attr_destroy(&attr);
+
+    for (int rank = 0; rank < nranks; rank++)
+	pthread_join(threads[rank], nullptr);
+
+    for (auto &rank_args : args) {
+	if (rank_args.result)
+	    return rank_args.result;
+    }
+    return 0;
+}
+
+}
+
+using simmpi::Context;
+
+extern "C" {
+
+MPI_Comm simmpi_comm_world(void)
+{
+    return simmpi::world;
+}
+
+MPI_Comm simmpi_comm_self(void)
+{
+    return simmpi::self;
+}
+
+int PMPI_Init(int *argc, char ***argv)
+{
+    return MPI_SUCCESS;
+}
+
+int PMPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{
+    *provided = required;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Finalize(void)
+{
+    return PMPI_Barrier(simmpi::world);
+}
+
+int PMPI_Abort(MPI_Comm comm, int errorcode)
+{
+    std::cerr << "simmpi: rank " << simmpi::world_rank << " called MPI_Abort" << std::endl;
+    std::exit(errorcode);
+}
+
+int PMPI_Get_library_version(char *version, int *resultlen)
+{
+    std::string text = "simmpi, " + std::to_string(simmpi::world->ctx->size()) + " simulated ranks";
+
+    std::strncpy(version, text.c_str(), MPI_MAX_LIBRARY_VERSION_STRING - 1);
+    version[MPI_MAX_LIBRARY_VERSION_STRING - 1] = '\0';
+    *resultlen = std::strlen(version);
+    return MPI_SUCCESS;
+}
+
+double PMPI_Wtime(void)
+{
+    return simmpi::now();
+}
+
+/*
+ * Communicators and groups
+ */
+
+int PMPI_Comm_rank(MPI_Comm comm, int *rank)
+{
+    *rank = comm->rank;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Comm_size(MPI_Comm comm, int *size)
+{
+    *size = comm->ctx->size();
+    return MPI_SUCCESS;
+}
+
+int PMPI_Comm_dup(MPI_Comm comm, MPI_Comm *newcomm)
+{
+    return simmpi::split(comm, 0, comm->rank, newcomm);
+}
+
+int PMPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm)
+{
+    return simmpi::split(comm, color, key, newcomm);
+}
+
+int PMPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm *newcomm)
+{
+    int color = MPI_UNDEFINED;
+
+    if (split_type == MPI_COMM_TYPE_SHARED)
+	color = simmpi::world_rank / simmpi::config.ranks_per_node;
+
+    return simmpi::split(comm, color, key, newcomm);
+}
+
+int PMPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm *newcomm)
+{
+    auto &members = group->world_ranks;
+    auto it = std::find(members.begin(), members.end(), simmpi::world_rank);
+
+    /* in group order */
+    if (it == members.end())
+	return simmpi::split(comm, MPI_UNDEFINED, 0, newcomm);
+    return simmpi::split(comm, 0, it - members.begin(), newcomm);
+}
+
+int PMPI_Comm_free(MPI_Comm *comm)
+{
+    if (*comm == simmpi::world || *comm == simmpi::self)
+	return MPI_ERR_COMM;
+
+    delete *comm;
+    *comm = MPI_COMM_NULL;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Comm_group(MPI_Comm comm, MPI_Group *group)
+{
+    *group = new simmpi_group_s{comm->ctx->world_ranks};
+    return MPI_SUCCESS;
+}
+
+int PMPI_Comm_get_name(MPI_Comm comm, char *name, int *resultlen)
+{
+    std::strncpy(name, comm->name.c_str(), MPI_MAX_OBJECT_NAME - 1);
+    name[MPI_MAX_OBJECT_NAME - 1] = '\0';
+    *resultlen = std::strlen(name);
+    return MPI_SUCCESS;
+}
+
+MPI_Fint PMPI_Comm_c2f(MPI_Comm comm)
+{
+    return comm->handle;
+}
+
+int PMPI_Comm_set_name(MPI_Comm comm, const char *name)
+{
+    comm->name = name;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Group_size(MPI_Group group, int *size)
+{
+    *size = group->world_ranks.size();
+    return MPI_SUCCESS;
+}
+
+int PMPI_Group_rank(MPI_Group group, int *rank)
+{
+    auto &members = group->world_ranks;
+    auto it = std::find(members.begin(), members.end(), simmpi::world_rank);
+
+    *rank = it == members.end() ? MPI_UNDEFINED : static_cast<int>(it - members.begin());
+    return MPI_SUCCESS;
+}
+
+int PMPI_Group_incl(MPI_Group group, int n, const int ranks[], MPI_Group *newgroup)
+{
+    std::vector<int> members(n);
+
+    for (int i = 0; i < n; i++) {
+	if (ranks[i] < 0 || ranks[i] >= static_cast<int>(group->world_ranks.size()))
+	    return MPI_ERR_RANK;
+	members[i] = group->world_ranks[ranks[i]];
+    }
+
+    *newgroup = new simmpi_group_s{std::move(members)};
+    return MPI_SUCCESS;
+}
+
+int PMPI_Group_translate_ranks(MPI_Group group1, int n, const int ranks1[],
+			       MPI_Group group2, int ranks2[])
+{
+    std::unordered_map<int, int> index;
+
+    for (std::size_t i = 0; i < group2->world_ranks.size(); i++)
+	index[group2->world_ranks[i]] = i;
+
+    for (int i = 0; i < n; i++) {
+	auto it = index.find(group1->world_ranks[ranks1[i]]);
+
+	ranks2[i] = it == index.end() ? MPI_UNDEFINED : it->second;
+    }
+    return MPI_SUCCESS;
+}
+
+int PMPI_Group_free(MPI_Group *group)
+{
+    delete *group;
+    *group = MPI_GROUP_NULL;
+    return MPI_SUCCESS;
+}
+
+/*
+ * Collectives
+ */
+
+int PMPI_Barrier(MPI_Comm comm)
+{
+    simmpi::complete(comm->ctx->barrier(nullptr, simmpi::cost(comm->ctx->size(), 0)));
+    return MPI_SUCCESS;
+}
+
+int PMPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm)
+{
+    Context &ctx = *comm->ctx;
+    std::size_t bytes = static_cast<std::size_t>(count) * datatype->size;
+    double deadline;
+
+    if (root < 0 || root >= ctx.size())
+	return MPI_ERR_ROOT;
+
+    ctx.in[comm->rank] = buffer;
+    ctx.barrier(nullptr, 0);
+    if (comm->rank != root && bytes)
+	std::memcpy(buffer, ctx.in[root], bytes);
+    /* the root's buffer has to stay until everyone has copied it */
+    deadline = ctx.barrier(nullptr, simmpi::cost(ctx.size(), bytes));
+
+    simmpi::complete(deadline);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+		   void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    Context &ctx = *comm->ctx;
+    std::size_t block = static_cast<std::size_t>(recvcount) * recvtype->size;
+    char *dst = static_cast<char *>(recvbuf);
+    double deadline;
+
+    ctx.in[comm->rank] = sendbuf == MPI_IN_PLACE ? dst + comm->rank * block : sendbuf;
+    ctx.barrier(nullptr, 0);
+    for (int q = 0; q < ctx.size(); q++) {
+	if (ctx.in[q] != dst + q * block)
+	    std::memcpy(dst + q * block, ctx.in[q], block);
+    }
+    deadline = ctx.barrier(nullptr, simmpi::cost(ctx.size(), static_cast<double>(ctx.size() - 1) * block));
+
+    simmpi::complete(deadline);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
+		   MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    simmpi::complete(simmpi::allreduce(sendbuf, recvbuf, count, datatype, op, comm));
+    return MPI_SUCCESS;
+}
+
+int PMPI_Iallreduce(const void *sendbuf, void *recvbuf, int count,
+		    MPI_Datatype datatype, MPI_Op op, MPI_Comm comm, MPI_Request *request)
+{
+    *request = new simmpi_request_s{simmpi::allreduce(sendbuf, recvbuf, count, datatype, op, comm)};
+    return MPI_SUCCESS;
+}
+
+int PMPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+    if (*request) {
+	simmpi::complete((*request)->deadline);
+	delete *request;
+	*request = MPI_REQUEST_NULL;
+    }
+
+    if (status != MPI_STATUS_IGNORE) {
+	status->MPI_ERROR = MPI_SUCCESS;
+	status->simmpi_nbytes = 0;
+    }
+    return MPI_SUCCESS;
+}
+
+int PMPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+    for (int i = 0; i < count; i++)
+	PMPI_Wait(&requests[i], statuses == MPI_STATUS_IGNORE ? MPI_STATUS_IGNORE : &statuses[i]);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Test(MPI_Request *request, int *flag, MPI_Status *status)
+{
+    *flag = !*request || (*request)->deadline <= simmpi::now();
+    if (*flag)
+	PMPI_Wait(request, status);
+    return MPI_SUCCESS;
+}
+
+/* the request that completes first */
+int PMPI_Waitany(int count, MPI_Request requests[], int *index, MPI_Status *status)
+{
+    *index = MPI_UNDEFINED;
+    for (int i = 0; i < count; i++) {
+	if (requests[i] && (*index == MPI_UNDEFINED || requests[i]->deadline < requests[*index]->deadline))
+	    *index = i;
+    }
+
+    if (*index != MPI_UNDEFINED)
+	PMPI_Wait(&requests[*index], status);
+    return MPI_SUCCESS;
+}
+
+/*
+ * Datatypes and operations, named and contiguous types only
+ */
+
+int PMPI_Type_size(MPI_Datatype datatype, int *size)
+{
+    *size = datatype->size;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Type_get_extent(MPI_Datatype datatype, MPI_Aint *lb, MPI_Aint *extent)
+{
+    *lb = 0;
+    *extent = datatype->size;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Type_get_true_extent(MPI_Datatype datatype, MPI_Aint *true_lb, MPI_Aint *true_extent)
+{
+    return PMPI_Type_get_extent(datatype, true_lb, true_extent);
+}
+
+int PMPI_Type_get_envelope(MPI_Datatype datatype, int *num_integers, int *num_addresses,
+			   int *num_datatypes, int *combiner)
+{
+    bool named = datatype->combiner == MPI_COMBINER_NAMED;
+
+    *num_integers = named ? 0 : 1;
+    *num_addresses = 0;
+    *num_datatypes = named ? 0 : 1;
+    *combiner = datatype->combiner;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Type_contiguous(int count, MPI_Datatype oldtype, MPI_Datatype *newtype)
+{
+    if (count < 0)
+	return MPI_ERR_COUNT;
+
+    *newtype = new simmpi_datatype_s{count * oldtype->size, oldtype->kind, MPI_COMBINER_CONTIGUOUS, oldtype, count};
+    return MPI_SUCCESS;
+}
+
+int PMPI_Type_commit(MPI_Datatype *datatype)
+{
+    return MPI_SUCCESS;
+}
+
+int PMPI_Type_free(MPI_Datatype *datatype)
+{
+    if ((*datatype)->combiner == MPI_COMBINER_NAMED)
+	return MPI_ERR_TYPE;
+
+    delete *datatype;
+    *datatype = MPI_DATATYPE_NULL;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Op_create(MPI_User_function *user_fn, int commute, MPI_Op *op)
+{
+    *op = new simmpi_op_s{user_fn, -1};
+    return MPI_SUCCESS;
+}
+
+int PMPI_Op_free(MPI_Op *op)
+{
+    if (!(*op)->fn)
+	return MPI_ERR_OP;
+
+    delete *op;
+    *op = MPI_OP_NULL;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Get_count(const MPI_Status *status, MPI_Datatype datatype, int *count)
+{
+    *count = datatype->size ? status->simmpi_nbytes / datatype->size : 0;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Status_set_elements_x(MPI_Status *status, MPI_Datatype datatype, MPI_Count count)
+{
+    status->simmpi_nbytes = count * datatype->size;
+    return MPI_SUCCESS;
+}
+
+/*
+ * Memory and shared windows
+ */
+
+int PMPI_Alloc_mem(MPI_Aint size, MPI_Info info, void *baseptr)
+{
+    void *mem = std::malloc(size ? size : 1);
+
+    if (!mem)
+	return MPI_ERR_BUFFER;
+    *static_cast<void **>(baseptr) = mem;
+    return MPI_SUCCESS;
+}
+
+int PMPI_Free_mem(void *base)
+{
+    std::free(base);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_allocate_shared(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm,
+			     void *baseptr, MPI_Win *win)
+{
+    Context &ctx = *comm->ctx;
+    int rank = comm->rank;
+    int nranks = ctx.size();
+    std::shared_ptr<simmpi::Window> window;
+    double deadline;
+
+    ctx.args[2 * rank] = size;
+    ctx.args[2 * rank + 1] = disp_unit;
+    deadline = ctx.barrier([&ctx, nranks] {
+	auto shared = std::make_shared<simmpi::Window>();
+	MPI_Aint total = 0;
+
+	for (int r = 0; r < nranks; r++) {
+	    shared->offsets.push_back(total);
+	    shared->sizes.push_back(ctx.args[2 * r]);
+	    shared->disp_units.push_back(ctx.args[2 * r + 1]);
+	    total += (ctx.args[2 * r] + 63) & ~MPI_Aint(63);
+	}
+	shared->mem = static_cast<char *>(std::aligned_alloc(64, total ? total : 64));
+	ctx.window = shared;
+    }, simmpi::cost(nranks, 0));
+
+    window = ctx.window;
+    if (!window->mem)
+	return MPI_ERR_OTHER;
+
+    *static_cast<void **>(baseptr) = window->mem + window->offsets[rank];
+    *win = new simmpi_win_s{std::move(window)};
+    simmpi::complete(deadline);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_shared_query(MPI_Win win, int rank, MPI_Aint *size, int *disp_unit, void *baseptr)
+{
+    simmpi::Window &window = *win->window;
+
+    if (rank < 0 || rank >= static_cast<int>(window.offsets.size()))
+	return MPI_ERR_RANK;
+
+    *size = window.sizes[rank];
+    *disp_unit = window.disp_units[rank];
+    *static_cast<void **>(baseptr) = window.mem + window.offsets[rank];
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_lock_all(int assert, MPI_Win win)
+{
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_unlock_all(MPI_Win win)
+{
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_sync(MPI_Win win)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return MPI_SUCCESS;
+}
+
+int PMPI_Win_free(MPI_Win *win)
+{
+    delete *win;
+    *win = MPI_WIN_NULL;
+    return MPI_SUCCESS;
+}
+
+/*
+ * Point-to-point
+ */
+
+int PMPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+	       MPI_Comm comm, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag,
+	       MPI_Comm comm, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Testsome(int incount, MPI_Request requests[], int *outcount, int indices[], MPI_Status statuses[])
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Waitsome(int incount, MPI_Request requests[], int *outcount, int indices[], MPI_Status statuses[])
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Cancel(MPI_Request *request)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+		  void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[],
+		   MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+		   const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+/*
+ * MPI-IO
+ */
+
+int PMPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh)
+{
+    *fh = MPI_FILE_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_close(MPI_File *fh)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_get_view(MPI_File fh, MPI_Offset *disp, MPI_Datatype *etype,
+		       MPI_Datatype *filetype, char *datarep)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_seek(MPI_File fh, MPI_Offset offset, int whence)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_get_position(MPI_File fh, MPI_Offset *offset)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+			   MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+			  MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_all(MPI_File fh, const void *buf, int count,
+			MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_all(MPI_File fh, void *buf, int count,
+		       MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+		       MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+		      MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write(MPI_File fh, const void *buf, int count,
+		    MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read(MPI_File fh, void *buf, int count,
+		   MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_at_all_begin(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+				 MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_at_all_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_at_all_begin(MPI_File fh, MPI_Offset offset, void *buf, int count,
+				MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_at_all_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_all_begin(MPI_File fh, const void *buf, int count, MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_all_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_all_begin(MPI_File fh, void *buf, int count, MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_all_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iwrite_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+			MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iread_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+		       MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iwrite_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+			    MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iread_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+			   MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iwrite(MPI_File fh, const void *buf, int count,
+		     MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iread(MPI_File fh, void *buf, int count,
+		    MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iwrite_all(MPI_File fh, const void *buf, int count,
+			 MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iread_all(MPI_File fh, void *buf, int count,
+			MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_shared(MPI_File fh, const void *buf, int count,
+			   MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_shared(MPI_File fh, void *buf, int count,
+			  MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iwrite_shared(MPI_File fh, const void *buf, int count,
+			    MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_iread_shared(MPI_File fh, void *buf, int count,
+			   MPI_Datatype datatype, MPI_Request *request)
+{
+    *request = MPI_REQUEST_NULL;
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_ordered(MPI_File fh, const void *buf, int count,
+			    MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_ordered(MPI_File fh, void *buf, int count,
+			   MPI_Datatype datatype, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_ordered_begin(MPI_File fh, const void *buf, int count, MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_write_ordered_end(MPI_File fh, const void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_ordered_begin(MPI_File fh, void *buf, int count, MPI_Datatype datatype)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+int PMPI_File_read_ordered_end(MPI_File fh, void *buf, MPI_Status *status)
+{
+    return MPI_ERR_UNSUPPORTED_OPERATION;
+}
+
+}
+
+/* libhear defines the MPI_* it intercepts, those take precedence */
+#pragma weak MPI_Init = PMPI_Init
+#pragma weak MPI_Init_thread = PMPI_Init_thread
+#pragma weak MPI_Finalize = PMPI_Finalize
+#pragma weak MPI_Abort = PMPI_Abort
+#pragma weak MPI_Get_library_version = PMPI_Get_library_version
+#pragma weak MPI_Wtime = PMPI_Wtime
+#pragma weak MPI_Comm_rank = PMPI_Comm_rank
+#pragma weak MPI_Comm_size = PMPI_Comm_size
+#pragma weak MPI_Comm_dup = PMPI_Comm_dup
+#pragma weak MPI_Comm_split = PMPI_Comm_split
+#pragma weak MPI_Comm_split_type = PMPI_Comm_split_type
+#pragma weak MPI_Comm_create = PMPI_Comm_create
+#pragma weak MPI_Comm_free = PMPI_Comm_free
+#pragma weak MPI_Comm_group = PMPI_Comm_group
+#pragma weak MPI_Comm_get_name = PMPI_Comm_get_name
+#pragma weak MPI_Comm_set_name = PMPI_Comm_set_name
+#pragma weak MPI_Comm_c2f = PMPI_Comm_c2f
+#pragma weak MPI_Group_size = PMPI_Group_size
+#pragma weak MPI_Group_rank = PMPI_Group_rank
+#pragma weak MPI_Group_incl = PMPI_Group_incl
+#pragma weak MPI_Group_translate_ranks = PMPI_Group_translate_ranks
+#pragma weak MPI_Group_free = PMPI_Group_free
+#pragma weak MPI_Barrier = PMPI_Barrier
+#pragma weak MPI_Bcast = PMPI_Bcast
+#pragma weak MPI_Allgather = PMPI_Allgather
+#pragma weak MPI_Allreduce = PMPI_Allreduce
+#pragma weak MPI_Iallreduce = PMPI_Iallreduce
+#pragma weak MPI_Wait = PMPI_Wait
+#pragma weak MPI_Waitall = PMPI_Waitall
+#pragma weak MPI_Test = PMPI_Test
+#pragma weak MPI_Waitany = PMPI_Waitany
+#pragma weak MPI_Type_size = PMPI_Type_size
+#pragma weak MPI_Type_get_extent = PMPI_Type_get_extent
+#pragma weak MPI_Type_get_true_extent = PMPI_Type_get_true_extent
+#pragma weak MPI_Type_get_envelope = PMPI_Type_get_envelope
+#pragma weak MPI_Type_contiguous = PMPI_Type_contiguous
+#pragma weak MPI_Type_commit = PMPI_Type_commit
+#pragma weak MPI_Type_free = PMPI_Type_free
+#pragma weak MPI_Op_create = PMPI_Op_create
+#pragma weak MPI_Op_free = PMPI_Op_free
+#pragma weak MPI_Get_count = PMPI_Get_count
+#pragma weak MPI_Status_set_elements_x = PMPI_Status_set_elements_x
+#pragma weak MPI_Alloc_mem = PMPI_Alloc_mem
+#pragma weak MPI_Free_mem = PMPI_Free_mem
+#pragma weak MPI_Win_allocate_shared = PMPI_Win_allocate_shared
+#pragma weak MPI_Win_shared_query = PMPI_Win_shared_query
+#pragma weak MPI_Win_lock_all = PMPI_Win_lock_all
+#pragma weak MPI_Win_unlock_all = PMPI_Win_unlock_all
+#pragma weak MPI_Win_sync = PMPI_Win_sync
+#pragma weak MPI_Win_free = PMPI_Win_free
+#pragma weak MPI_Isend = PMPI_Isend
+#pragma weak MPI_Irecv = PMPI_Irecv
+#pragma weak MPI_Testsome = PMPI_Testsome
+#pragma weak MPI_Waitsome = PMPI_Waitsome
+#pragma weak MPI_Cancel = PMPI_Cancel
+#pragma weak MPI_Alltoall = PMPI_Alltoall
+#pragma weak MPI_Alltoallv = PMPI_Alltoallv
+#pragma weak MPI_File_open = PMPI_File_open
+#pragma weak MPI_File_close = PMPI_File_close
+#pragma weak MPI_File_get_view = PMPI_File_get_view
+#pragma weak MPI_File_seek = PMPI_File_seek
+#pragma weak MPI_File_get_position = PMPI_File_get_position
+#pragma weak MPI_File_write_at_all = PMPI_File_write_at_all
+#pragma weak MPI_File_read_at_all = PMPI_File_read_at_all
+#pragma weak MPI_File_write_all = PMPI_File_write_all
+#pragma weak MPI_File_read_all = PMPI_File_read_all
+#pragma weak MPI_File_write_at = PMPI_File_write_at
+#pragma weak MPI_File_read_at = PMPI_File_read_at
+#pragma weak MPI_File_write = PMPI_File_write
+#pragma weak MPI_File_read = PMPI_File_read
+#pragma weak MPI_File_write_at_all_begin = PMPI_File_write_at_all_begin
+#pragma weak MPI_File_write_at_all_end = PMPI_File_write_at_all_end
+#pragma weak MPI_File_read_at_all_begin = PMPI_File_read_at_all_begin
+#pragma weak MPI_File_read_at_all_end = PMPI_File_read_at_all_end
+#pragma weak MPI_File_write_all_begin = PMPI_File_write_all_begin
+#pragma weak MPI_File_write_all_end = PMPI_File_write_all_end
+#pragma weak MPI_File_read_all_begin = PMPI_File_read_all_begin
+#pragma weak MPI_File_read_all_end = PMPI_File_read_all_end
+#pragma weak MPI_File_iwrite_at = PMPI_File_iwrite_at
+#pragma weak MPI_File_iread_at = PMPI_File_iread_at
+#pragma weak MPI_File_iwrite_at_all = PMPI_File_iwrite_at_all
+#pragma weak MPI_File_iread_at_all = PMPI_File_iread_at_all
+#pragma weak MPI_File_iwrite = PMPI_File_iwrite
+#pragma weak MPI_File_iread = PMPI_File_iread
+#pragma weak MPI_File_iwrite_all = PMPI_File_iwrite_all
+#pragma weak MPI_File_iread_all = PMPI_File_iread_all
+#pragma weak MPI_File_write_shared = PMPI_File_write_shared
+#pragma weak MPI_File_read_shared = PMPI_File_read_shared
+#pragma weak MPI_File_iwrite_shared = PMPI_File_iwrite_shared
+#pragma weak MPI_File_iread_shared = PMPI_File_iread_shared
+#pragma weak MPI_File_write_ordered = PMPI_File_write_ordered
+#pragma weak MPI_File_read_ordered = PMPI_File_read_ordered
+#pragma weak MPI_File_write_ordered_begin = PMPI_File_write_ordered_begin
+#pragma weak MPI_File_write_ordered_end = PMPI_File_write_ordered_end
+#pragma weak MPI_File_read_ordered_begin = PMPI_File_read_ordered_begin
+#pragma weak MPI_File_read_ordered_end = PMPI_File_read_ordered_end
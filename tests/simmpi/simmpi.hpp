@@ -0,0 +1,42 @@
+#ifndef SIMMPI_HPP
+#define SIMMPI_HPP
+
+#include <cstddef>
+
+/*
+ * Simulated MPI for scale tests of libhear on one machine.
+ *
+ * Every rank is a thread of the calling process, and libhear is linked in
+ * statically, built with -D HEAR_SIMMPI=1 so that its per-rank state is
+ * thread_local. Collectives meet in the communicator's shared state and move
+ * the data with memcpy. Each one then completes no earlier than its modelled
+ * cost after the last rank arrived:
+ *
+ *   HEAR_SIM_LATENCY_US     per step, collectives take ceil(log2(size)) steps
+ *   HEAR_SIM_BANDWIDTH      bytes per second, unset or 0 for no limit
+ *
+ * MPI_Iallreduce moves the data right away, MPI_Wait sleeps out the rest of
+ * the cost and MPI_Test completes once it has passed, so en-/decryption can
+ * be overlapped with it as with a real network. HEAR_SIM_RANKS_PER_NODE (all
+ * by default) places consecutive world ranks on the same node for
+ * MPI_COMM_TYPE_SHARED, and HEAR_SIM_STACK_BYTES (1 MiB) is the stack size of
+ * the rank threads.
+ *
+ * The simulated ranks share the machine's cores and memory, so times measure
+ * the interception layer and not the kernels at scale. HEAR_LAZY_DECRYPT and
+ * HEAR_IO_KEY are not supported, there is one fault thread per process and
+ * no file system, and neither are point-to-point messages and
+ * MPI_Alltoall(v).
+ */
+
+namespace simmpi {
+
+/*
+ * Runs rank_main on nranks threads, each with a rank of MPI_COMM_WORLD of its
+ * own, and returns the first nonzero result, or 0.
+ */
+int run(int nranks, int (*rank_main)(int, char **), int argc, char **argv);
+
+}
+
+#endif